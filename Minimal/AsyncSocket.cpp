@@ -0,0 +1,172 @@
+#include "AsyncSocket.h"
+#include <string.h>
+
+
+SocketReactor::SocketReactor(ServerNetwork & serverNetwork) : network(serverNetwork)
+{
+}
+
+SocketReactor::~SocketReactor(void)
+{
+    while (!sockets.empty())
+    {
+        AsyncSocket * socket = sockets.begin()->second;
+
+        if (socket->waiting == NULL)
+        {
+            sockets.erase(sockets.begin());
+            continue;
+        }
+
+        // runs the frame's destructors, the socket's among them, which
+        // takes it out of the map
+        socket->waiting->coroutine.destroy();
+    }
+}
+
+void SocketReactor::dispatch()
+{
+    network.flushWritable();
+
+    // coroutines only ever add to closedClients, so the lists hold
+    // still while they run
+    for (size_t i = 0; i < network.readyClients.size(); i++)
+        wake(network.readyClients[i], true);
+
+    for (size_t i = 0; i < network.writableClients.size(); i++)
+        wake(network.writableClients[i], false);
+
+    // a coroutine closing another connection adds it here, so drain
+    // until empty
+    while (!network.closedClients.empty())
+    {
+        unsigned int session = network.closedClients.back();
+        network.closedClients.pop_back();
+        wake(session, false);
+    }
+}
+
+void SocketReactor::wake(unsigned int session, bool readable)
+{
+    std::map<unsigned int, AsyncSocket *>::iterator iter = sockets.find(session);
+
+    if (iter == sockets.end())
+        return;
+
+    AsyncSocket * socket = iter->second;
+
+    if (readable)
+        socket->readable = true;
+
+    SocketWait * wait = socket->waiting;
+
+    if (wait == NULL || !wait->attempt())
+        return;
+
+    // the coroutine may end and take the socket with it
+    socket->waiting = NULL;
+    wait->coroutine.resume();
+}
+
+
+AsyncSocket::AsyncSocket(SocketReactor & socketReactor, unsigned int id)
+    : session(id), reactor(socketReactor), frames(NULL), waiting(NULL), readable(false)
+{
+    // readiness is level triggered: whatever is queued already is
+    // reported by the next wait, no need to try a recv for it now
+    reactor.sockets[session] = this;
+}
+
+AsyncSocket::~AsyncSocket(void)
+{
+    reactor.sockets.erase(session);
+    delete frames;
+}
+
+AsyncSocket::Write AsyncSocket::write(const char * data, int length, bool latestWins)
+{
+    reactor.network.sendTo(session, data, length, latestWins);
+
+    return Write(*this);
+}
+
+SOCKET AsyncSocket::release(LocalChannel ** channel)
+{
+    reactor.sockets.erase(session);
+
+    return reactor.network.releaseClient(session, channel);
+}
+
+void AsyncSocket::unread(const char * data, int length)
+{
+    if (frames == NULL)
+        frames = new FrameBuffer(reactor.bufferPool);
+
+    // a first message, or the start of one: a fresh ring has room
+    int count = length < frames->writable() ? length : frames->writable();
+
+    memcpy(frames->writePtr(), data, count);
+    frames->commit(count);
+}
+
+bool AsyncSocket::ReadFrame::attempt()
+{
+    ServerNetwork & network = socket.reactor.network;
+
+    if (socket.frames == NULL)
+        socket.frames = new FrameBuffer(socket.reactor.bufferPool);
+
+    FrameBuffer & frames = *socket.frames;
+
+    while (!frames.nextFrame(frame.payload, frame.length))
+    {
+        // nothing more will come
+        if (frames.corrupt() || !network.sessions.contains(socket.session))
+        {
+            frame = Frame();
+            return true;
+        }
+
+        // one recv per wakeup, like a polled session got: what it
+        // leaves behind wakes us again
+        if (!socket.readable)
+            return false;
+
+        socket.readable = false;
+
+        int received = network.receiveData(socket.session, frames.writePtr(), frames.writable());
+
+        if (received > 0)
+            frames.commit(received);
+    }
+
+    return true;
+}
+
+bool AsyncSocket::Read::attempt()
+{
+    ServerNetwork & network = socket.reactor.network;
+
+    if (!network.sessions.contains(socket.session))
+    {
+        result = 0;
+        return true;
+    }
+
+    if (!socket.readable)
+        return false;
+
+    // taken, so the socket is only ready again once more arrives
+    socket.readable = false;
+    result = network.receiveData(socket.session, buffer, bufSize);
+
+    // something read, or the connection closed
+    return result > 0 || !network.sessions.contains(socket.session);
+}
+
+bool AsyncSocket::Write::attempt()
+{
+    Session * state = socket.reactor.network.sessions.find(socket.session);
+
+    return state == NULL || !state->waitingForWritable;
+}
@@ -0,0 +1,188 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <map>
+#include "ServerNetwork.h"
+#include "FrameBuffer.h"
+#include "BufferPool.h"
+
+// A coroutine run for what it does rather than what it returns. It
+// starts at once, runs until it first waits on a socket and frees its
+// own frame when it returns. Nothing holds it but the AsyncSocket it
+// is waiting on.
+struct Task
+{
+    struct promise_type
+    {
+        Task get_return_object() { return Task(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// a complete frame's payload, or none once the connection is gone
+struct Frame
+{
+    const char * payload = NULL;
+    int length = 0;
+
+    explicit operator bool() const { return payload != NULL; }
+};
+
+// something a coroutine is suspended on. attempt() finishes it if the
+// socket allows, and only then is the coroutine resumed
+struct SocketWait
+{
+    virtual bool attempt() = 0;
+
+    std::coroutine_handle<> coroutine;
+};
+
+class AsyncSocket;
+
+// Resumes coroutines waiting on a ServerNetwork's sessions.
+//
+// The network still does the waiting: after each waitForEvents the
+// owner calls dispatch, which looks up the AsyncSocket of every
+// session that came up readable, writable or closed and resumes its
+// coroutine if what it waits for is done. A suspended session costs
+// its coroutine frame and a map entry, nothing is polled.
+class SocketReactor
+{
+public:
+    SocketReactor(ServerNetwork & network);
+
+    // destroys the coroutines still waiting, without resuming them
+    ~SocketReactor(void);
+
+    // after network.waitForEvents: send what writable sockets take
+    // and resume every coroutine whose wait is over. closedClients is
+    // drained here, each session's coroutine sees its connection end
+    void dispatch();
+
+    // sessions with a coroutine attached
+    size_t size() const { return sockets.size(); }
+
+    ServerNetwork & network;
+
+    // receive buffers of every socket
+    BufferPool bufferPool;
+
+private:
+    SocketReactor(const SocketReactor &);
+    SocketReactor & operator=(const SocketReactor &);
+
+    friend class AsyncSocket;
+
+    // resume session's coroutine if its wait is over
+    void wake(unsigned int session, bool readable);
+
+    std::map<unsigned int, AsyncSocket *> sockets;
+};
+
+// One session as seen from the coroutine serving it. It lives in that
+// coroutine's frame and is what the reactor resumes it through, so the
+// protocol reads top to bottom:
+//
+//     AsyncSocket socket(reactor, session);
+//     while (Frame frame = co_await socket.readFrame())
+//         handle(frame);
+//
+// Only the coroutine that made it may wait on it, one wait at a time.
+class AsyncSocket
+{
+public:
+    AsyncSocket(SocketReactor & reactor, unsigned int session);
+    ~AsyncSocket(void);
+
+    struct ReadFrame : SocketWait
+    {
+        ReadFrame(AsyncSocket & owner) : socket(owner) {}
+
+        bool await_ready() { return attempt(); }
+        void await_suspend(std::coroutine_handle<> waiter) { coroutine = waiter; socket.waiting = this; }
+        Frame await_resume() { return frame; }
+
+        bool attempt() override;
+
+        AsyncSocket & socket;
+        Frame frame;
+    };
+
+    struct Read : SocketWait
+    {
+        Read(AsyncSocket & owner, char * into, int size) : socket(owner), buffer(into), bufSize(size) {}
+
+        bool await_ready() { return attempt(); }
+        void await_suspend(std::coroutine_handle<> waiter) { coroutine = waiter; socket.waiting = this; }
+        int await_resume() { return result; }
+
+        bool attempt() override;
+
+        AsyncSocket & socket;
+        char * buffer;
+        int bufSize;
+        int result = 0;
+    };
+
+    struct Write : SocketWait
+    {
+        Write(AsyncSocket & owner) : socket(owner) {}
+
+        bool await_ready() { return attempt(); }
+        void await_suspend(std::coroutine_handle<> waiter) { coroutine = waiter; socket.waiting = this; }
+        bool await_resume() { return socket.reactor.network.sessions.contains(socket.session); }
+
+        bool attempt() override;
+
+        AsyncSocket & socket;
+    };
+
+    // the next complete frame, waiting for it as long as it takes. no
+    // frame once the connection closed or sent a corrupt one. the
+    // payload stays valid until the next readFrame
+    ReadFrame readFrame() { return ReadFrame(*this); }
+
+    // what has arrived, up to bufSize, without framing. waits until
+    // something has; 0 or less once the connection closed
+    Read read(char * buffer, int bufSize) { return Read(*this, buffer, bufSize); }
+
+    // bytes read off the connection before it came here, which
+    // readFrame hands out ahead of anything received after them
+    void unread(const char * data, int length);
+
+    // queue data and send what the socket takes. if it didn't take it
+    // all, wait until it has: a client that stops reading stops being
+    // read from. false if the client was dropped
+    Write write(const char * data, int length, bool latestWins = false);
+
+    // stop serving the session and take its socket out of the network.
+    // INVALID_SOCKET if the connection is gone. a local session's
+    // channel comes with it, see ServerNetwork::releaseClient
+    SOCKET release(LocalChannel ** channel = NULL);
+
+    // the connection sent a frame bigger than allowed
+    bool corrupt() const { return frames != NULL && frames->corrupt(); }
+
+    const unsigned int session;
+
+private:
+    AsyncSocket(const AsyncSocket &);
+    AsyncSocket & operator=(const AsyncSocket &);
+
+    friend class SocketReactor;
+
+    SocketReactor & reactor;
+
+    // made on the first readFrame or unread: a socket only read
+    // without framing never needs one
+    FrameBuffer * frames;
+
+    // what the coroutine is suspended on, NULL while it runs
+    SocketWait * waiting;
+
+    // the socket may have data no recv has taken yet
+    bool readable;
+};
@@ -0,0 +1,41 @@
+#include "Board.h"
+
+
+void Board::clear()
+{
+	for (int row = 0; row < BOARD_SIZE; row++)
+		for (int column = 0; column < BOARD_SIZE; column++)
+			cells[row][column] = CELL_EMPTY;
+
+	hits = 0;
+}
+
+void Board::placeShip(const std::vector<std::pair<int, int> > & ship)
+{
+	for (size_t i = 0; i < ship.size(); i++)
+	{
+		if (inside(ship[i].first, ship[i].second))
+			cells[ship[i].first][ship[i].second] = CELL_MARKED;
+	}
+}
+
+int Board::shoot(int row, int column)
+{
+	if (!inside(row, column))
+		return SHOT_INVALID;
+
+	int & cell = cells[row][column];
+
+	if (cell == CELL_MARKED) {
+		cell = CELL_SHOOTED;
+		hits++;
+		return SHOT_HIT;
+	}
+
+	if (cell == CELL_EMPTY) {
+		cell = CELL_MISSED;
+		return SHOT_MISS;
+	}
+
+	return SHOT_INVALID;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stddef.h>
+#include <utility>
+#include <vector>
+
+// battleship rules shared by the headset game and the dedicated server
+
+#define BOARD_SIZE 10
+
+// cells covered by the whole fleet: 5 + 4 + 3 + 2 + 2
+#define FLEET_CELLS 16
+
+enum CellStates {
+
+	CELL_MISSED = -1,
+
+	CELL_EMPTY = 0,
+
+	CELL_MARKED = 1,    // a ship sits here
+
+	CELL_SHOOTED = 2,   // a ship was hit here
+
+};
+
+enum ShotResults {
+
+	SHOT_INVALID = -1,  // off the board or fired at before
+
+	SHOT_MISS = 0,
+
+	SHOT_HIT = 1,
+
+};
+
+// One player's 10x10 grid. board[row][column] reads a cell like the
+// plain array it replaces.
+struct Board
+{
+	int cells[BOARD_SIZE][BOARD_SIZE];
+
+	// ship cells shot so far
+	int hits = 0;
+
+	Board(void) { clear(); }
+
+	void clear();
+
+	int * operator[](int row) { return cells[row]; }
+	const int * operator[](int row) const { return cells[row]; }
+
+	static bool inside(int row, int column)
+	{
+		return row >= 0 && row < BOARD_SIZE && column >= 0 && column < BOARD_SIZE;
+	}
+
+	// put a ship on the listed cells
+	void placeShip(const std::vector<std::pair<int, int> > & ship);
+
+	// resolve a shot at this board
+	int shoot(int row, int column);
+
+	// every ship cell has been hit
+	bool defeated() const { return hits >= FLEET_CELLS; }
+};
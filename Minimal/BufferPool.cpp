@@ -0,0 +1,74 @@
+#include "BufferPool.h"
+
+BufferPool::BufferPool(void)
+{
+    for (int i = 0; i < NUM_CLASSES; i++)
+        freeLists[i] = NULL;
+
+    inUse = 0;
+    reserved = 0;
+}
+
+BufferPool::~BufferPool(void)
+{
+    for (size_t i = 0; i < slabs.size(); i++)
+        delete[] slabs[i];
+}
+
+int BufferPool::sizeClass(size_t size)
+{
+    int cls = 0;
+    size_t block = POOL_MIN_BLOCK;
+
+    while (block < size)
+    {
+        block <<= 1;
+        cls++;
+    }
+
+    return cls;
+}
+
+char * BufferPool::acquire(size_t & size)
+{
+    if (size > POOL_MAX_BLOCK)
+        return NULL;
+
+    int cls = sizeClass(size);
+    size = (size_t)POOL_MIN_BLOCK << cls;
+
+    if (freeLists[cls] == NULL)
+    {
+        // refill the class from a fresh slab, big blocks get a slab each
+        size_t slabSize = size > POOL_SLAB_SIZE ? size : POOL_SLAB_SIZE;
+        char * slab = new char[slabSize];
+        slabs.push_back(slab);
+        reserved += slabSize;
+
+        for (size_t off = 0; off + size <= slabSize; off += size)
+        {
+            FreeBlock * block = (FreeBlock *)(slab + off);
+            block->next = freeLists[cls];
+            freeLists[cls] = block;
+        }
+    }
+
+    FreeBlock * block = freeLists[cls];
+    freeLists[cls] = block->next;
+    inUse += size;
+
+    return (char *)block;
+}
+
+void BufferPool::release(char * data, size_t size)
+{
+    if (data == NULL)
+        return;
+
+    int cls = sizeClass(size);
+
+    FreeBlock * block = (FreeBlock *)data;
+    block->next = freeLists[cls];
+    freeLists[cls] = block;
+    inUse -= size;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+
+// smallest and largest block the pool hands out
+#define POOL_MIN_BLOCK 256
+#define POOL_MAX_BLOCK (128 * 1024)
+
+// memory carved into small blocks at a time
+#define POOL_SLAB_SIZE (16 * 1024)
+
+// Slab allocator for per-connection buffers.
+//
+// Blocks come in power-of-two size classes. Each class keeps a free
+// list threaded through the free blocks themselves, and is refilled by
+// carving a slab, so thousands of idle sessions cost a few hundred
+// bytes each instead of a malloc per buffer. Not thread safe: each
+// network thread owns its own pool.
+class BufferPool
+{
+public:
+    BufferPool(void);
+    ~BufferPool(void);
+
+    // a block of at least size bytes; size is rounded up to its class
+    char * acquire(size_t & size);
+
+    // hand a block back; size must be what acquire() returned
+    void release(char * block, size_t size);
+
+    // bytes currently handed out
+    size_t bytesInUse() const { return inUse; }
+
+    // bytes taken from the system for slabs
+    size_t bytesReserved() const { return reserved; }
+
+private:
+    BufferPool(const BufferPool &);
+    BufferPool & operator=(const BufferPool &);
+
+    static int sizeClass(size_t size);
+
+    struct FreeBlock
+    {
+        FreeBlock * next;
+    };
+
+    enum { NUM_CLASSES = 10 };    // 256 B .. 128 KB
+
+    FreeBlock * freeLists[NUM_CLASSES];
+
+    std::vector<char *> slabs;
+
+    size_t inUse;
+    size_t reserved;
+};
@@ -0,0 +1,49 @@
+#include "ClockSync.h"
+#include <chrono>
+
+uint64_t clockMicros()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ClockSync::addSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3)
+{
+    // a reply to nothing we sent, or from a peer whose clock ran backwards
+    if (t3 < t0 || t2 < t1)
+        return;
+
+    int64_t roundTrip = (int64_t)(t3 - t0) - (int64_t)(t2 - t1);
+    if (roundTrip < 0)
+        roundTrip = 0;
+
+    int64_t sampleOffset = ((int64_t)(t1 - t0) + (int64_t)(t2 - t3)) / 2;
+
+    uint32_t sampleRtt = roundTrip > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)roundTrip;
+
+    if (samples > 0)
+    {
+        uint32_t change = sampleRtt > rtt ? sampleRtt - rtt : rtt - sampleRtt;
+        jitter += ((int32_t)change - (int32_t)jitter) / 16;
+        jitterHistogram.record(change);
+    }
+
+    rtt = sampleRtt;
+    rttHistogram.record(sampleRtt);
+
+    int slot = samples % CLOCK_FILTER_SAMPLES;
+    filterRtt[slot] = sampleRtt;
+    filterOffset[slot] = sampleOffset;
+    samples++;
+
+    int filled = samples < CLOCK_FILTER_SAMPLES ? (int)samples : CLOCK_FILTER_SAMPLES;
+    int best = 0;
+
+    for (int i = 1; i < filled; i++)
+    {
+        if (filterRtt[i] < filterRtt[best])
+            best = i;
+    }
+
+    offset = filterOffset[best];
+}
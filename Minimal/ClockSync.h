@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include "Histogram.h"
+
+// how often a session is pinged
+#define PING_INTERVAL_MS 250
+
+// recent samples the offset estimate is picked from
+#define CLOCK_FILTER_SAMPLES 8
+
+// local monotonic clock in microseconds. The server's copy of it is
+// the shared clock every pose timestamp is expressed in
+uint64_t clockMicros();
+
+// Round trip time and clock offset to one peer, from PING/PONG
+// exchanges. With t0 = our send, t1 = their receive, t2 = their send
+// and t3 = our receive:
+//
+//     rtt    = (t3 - t0) - (t2 - t1)
+//     offset = ((t1 - t0) + (t2 - t3)) / 2
+//
+// Queueing delay only ever adds to the rtt and skews the offset, so
+// like NTP the offset comes from the lowest rtt sample among the last
+// few. Trivially copyable, so it can be published through a SeqLock.
+struct ClockSync
+{
+    // remote clock minus local clock
+    int64_t offset = 0;
+
+    // latest round trip, and its smoothed variation (RFC 3550 style)
+    uint32_t rtt = 0;
+    uint32_t jitter = 0;
+
+    uint32_t samples = 0;
+
+    // when the last PING went out, local clock
+    uint64_t lastPing = 0;
+
+    Histogram rttHistogram;
+    Histogram jitterHistogram;
+
+    void addSample(uint64_t t0, uint64_t t1, uint64_t t2, uint64_t t3);
+
+    bool synced() const { return samples > 0; }
+
+    uint64_t toLocal(uint64_t remoteTime) const { return remoteTime - offset; }
+    uint64_t toRemote(uint64_t localTime) const { return localTime + offset; }
+
+private:
+    uint32_t filterRtt[CLOCK_FILTER_SAMPLES];
+    int64_t filterOffset[CLOCK_FILTER_SAMPLES];
+};
@@ -0,0 +1,187 @@
+#include "Compression.h"
+#include <stdint.h>
+#include <string.h>
+
+static uint32_t read32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static int hash32(uint32_t value)
+{
+    return (int)((value * 2654435761u) >> (32 - LZ_HASH_BITS));
+}
+
+// a length past the token's 15, as a run of 255s and a remainder
+static bool writeLength(uint8_t *& out, const uint8_t * end, int length)
+{
+    while (length >= 255)
+    {
+        if (out >= end)
+            return false;
+        *out++ = 255;
+        length -= 255;
+    }
+
+    if (out >= end)
+        return false;
+    *out++ = (uint8_t)length;
+
+    return true;
+}
+
+static bool readLength(const uint8_t *& in, const uint8_t * end, int & length)
+{
+    uint8_t b;
+
+    do
+    {
+        if (in >= end)
+            return false;
+        b = *in++;
+        length += b;
+
+        // far longer than any input, and about to overflow
+        if (length > (1 << 30))
+            return false;
+    }
+    while (b == 255);
+
+    return true;
+}
+
+// literals from anchor, then a match of matchLength at offset back.
+// matchLength 0 is the closing literals-only sequence
+static bool writeSequence(uint8_t *& out, const uint8_t * end, const uint8_t * literals, int literalLength,
+                          int offset, int matchLength)
+{
+    int matchCode = matchLength > 0 ? matchLength - LZ_MIN_MATCH : 0;
+
+    if (out >= end)
+        return false;
+
+    *out++ = (uint8_t)(((literalLength < 15 ? literalLength : 15) << 4) | (matchCode < 15 ? matchCode : 15));
+
+    if (literalLength >= 15 && !writeLength(out, end, literalLength - 15))
+        return false;
+
+    if (end - out < literalLength)
+        return false;
+
+    memcpy(out, literals, literalLength);
+    out += literalLength;
+
+    if (matchLength == 0)
+        return true;
+
+    if (end - out < 2)
+        return false;
+
+    *out++ = (uint8_t)(offset & 0xFF);
+    *out++ = (uint8_t)(offset >> 8);
+
+    if (matchCode >= 15 && !writeLength(out, end, matchCode - 15))
+        return false;
+
+    return true;
+}
+
+int lzCompress(const char * source, int length, char * dest, int capacity)
+{
+    const uint8_t * src = (const uint8_t *)source;
+    uint8_t * out = (uint8_t *)dest;
+    const uint8_t * end = out + capacity;
+
+    // last position each 4 byte prefix was seen at
+    int table[1 << LZ_HASH_BITS];
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++)
+        table[i] = -1;
+
+    int anchor = 0;
+    int pos = 0;
+
+    while (pos + LZ_MIN_MATCH <= length)
+    {
+        uint32_t prefix = read32(src + pos);
+        int h = hash32(prefix);
+        int candidate = table[h];
+        table[h] = pos;
+
+        if (candidate < 0 || pos - candidate > 0xFFFF || read32(src + candidate) != prefix)
+        {
+            pos++;
+            continue;
+        }
+
+        int matchLength = LZ_MIN_MATCH;
+        while (pos + matchLength < length && src[candidate + matchLength] == src[pos + matchLength])
+            matchLength++;
+
+        if (!writeSequence(out, end, src + anchor, pos - anchor, pos - candidate, matchLength))
+            return -1;
+
+        pos += matchLength;
+        anchor = pos;
+    }
+
+    if (!writeSequence(out, end, src + anchor, length - anchor, 0, 0))
+        return -1;
+
+    return (int)(out - (uint8_t *)dest);
+}
+
+bool lzDecompress(const char * source, int length, char * dest, int size)
+{
+    const uint8_t * in = (const uint8_t *)source;
+    const uint8_t * inEnd = in + length;
+    uint8_t * out = (uint8_t *)dest;
+    uint8_t * outEnd = out + size;
+
+    // the stream must end on a closing sequence, even one of nothing,
+    // or it was cut short
+    bool closed = false;
+
+    while (in < inEnd)
+    {
+        uint8_t token = *in++;
+
+        int literalLength = token >> 4;
+        if (literalLength == 15 && !readLength(in, inEnd, literalLength))
+            return false;
+
+        if (inEnd - in < literalLength || outEnd - out < literalLength)
+            return false;
+
+        memcpy(out, in, literalLength);
+        in += literalLength;
+        out += literalLength;
+
+        // the closing sequence has no match, and says so
+        if (in == inEnd)
+        {
+            closed = (token & 15) == 0;
+            break;
+        }
+
+        if (inEnd - in < 2)
+            return false;
+
+        int offset = in[0] | (in[1] << 8);
+        in += 2;
+
+        int matchLength = token & 15;
+        if (matchLength == 15 && !readLength(in, inEnd, matchLength))
+            return false;
+        matchLength += LZ_MIN_MATCH;
+
+        if (offset == 0 || offset > out - (uint8_t *)dest || outEnd - out < matchLength)
+            return false;
+
+        // byte by byte: a match may overlap the bytes it produces
+        const uint8_t * match = out - offset;
+        for (int i = 0; i < matchLength; i++)
+            *out++ = match[i];
+    }
+
+    return closed && out == outEnd;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// LZ77 compression in the LZ4 block layout, for the occasional large
+// message such as a full match resync. Each sequence is a token byte
+// (literal count in the high nibble, match length - 4 in the low one,
+// 15 meaning more length bytes follow), the literals, then a 2 byte
+// little-endian offset back to the match. The last sequence is
+// literals only. Small and fast rather than tight: one hash probe per
+// position, no lazy matching.
+
+// shortest match worth a 3 byte token plus offset
+#define LZ_MIN_MATCH 4
+
+// log2 of the match finder's hash table entries
+#define LZ_HASH_BITS 12
+
+// worst case compressed size of length bytes that don't compress
+#define LZ_BOUND(length) ((length) + (length) / 255 + 16)
+
+// compress length bytes of source into dest. returns the compressed
+// size, or -1 if it didn't fit in capacity
+int lzCompress(const char * source, int length, char * dest, int capacity);
+
+// undo lzCompress of size bytes into dest, which holds size. false if
+// the input is malformed, cut short, or doesn't come to exactly size:
+// a stream cut at the end of a sequence can look whole, so the size
+// has to come from outside
+bool lzDecompress(const char * source, int length, char * dest, int size);
@@ -0,0 +1,48 @@
+#include "DeadReckoning.h"
+#include <math.h>
+#include "WireFormat.h"
+
+DeadReckoning::DeadReckoning(float positionThreshold_m, float angleThreshold_rad, uint64_t keepalive_us)
+    : positionThreshold(positionThreshold_m), angleThreshold(angleThreshold_rad), keepalive(keepalive_us),
+      sentPoses(0), lastSent(0)
+{
+}
+
+bool DeadReckoning::due(const glm::mat4 & pose, uint64_t time) const
+{
+    // this pose, or a newer one, already went
+    if (lastSent != 0 && time <= lastSent)
+        return false;
+
+    glm::mat4 guess;
+
+    if (!sentPoses.sample(time, guess) || time - lastSent >= keepalive)
+        return true;
+
+    glm::vec3 offset = posePosition(pose) - posePosition(guess);
+
+    if (glm::dot(offset, offset) > positionThreshold * positionThreshold)
+        return true;
+
+    // angle between the two orientations
+    float d = fabsf(glm::dot(poseOrientation(pose), poseOrientation(guess)));
+    float angle = 2.0f * acosf(d > 1.0f ? 1.0f : d);
+
+    if (angle > angleThreshold)
+        return true;
+
+    held++;
+    return false;
+}
+
+void DeadReckoning::sent(const glm::mat4 & pose, uint64_t time)
+{
+    sentPoses.push(pose, time);
+    lastSent = time;
+}
+
+void DeadReckoning::reset()
+{
+    sentPoses.clear();
+    lastSent = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include "PoseBuffer.h"
+
+// how far the receiver's guess may be off before a pose goes out
+#define RECKONING_POSITION_M 0.01f
+#define RECKONING_ANGLE_RAD 0.035f
+
+// a pose goes out at least this often however still the head is: 5 Hz
+#define RECKONING_KEEPALIVE_US 200000
+
+// Decides when a head pose is worth sending.
+//
+// The receiver keeps a moving head moving by extrapolating from the
+// last two poses it got (PoseBuffer). This runs the same extrapolation
+// over the poses that were sent, and a new pose is only due once the
+// real head has drifted from that guess by more than a threshold, or
+// when the keepalive runs out. A still head then costs the keepalive
+// rate instead of the frame rate, and a moving one costs what it takes
+// to keep the far side within the thresholds.
+class DeadReckoning
+{
+public:
+    DeadReckoning(float positionThreshold_m = RECKONING_POSITION_M,
+                  float angleThreshold_rad = RECKONING_ANGLE_RAD,
+                  uint64_t keepalive_us = RECKONING_KEEPALIVE_US);
+
+    // should pose, sampled at time, be sent
+    bool due(const glm::mat4 & pose, uint64_t time) const;
+
+    // pose went out, the receiver extrapolates from it now
+    void sent(const glm::mat4 & pose, uint64_t time);
+
+    // forget what was sent, so the next pose is due
+    void reset();
+
+    float positionThreshold;
+    float angleThreshold;
+    uint64_t keepalive;
+
+    // poses found not due
+    mutable uint64_t held = 0;
+
+private:
+    // what the receiver holds, sampled without its playout delay
+    PoseBuffer sentPoses;
+    uint64_t lastSent;
+};
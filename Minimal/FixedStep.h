@@ -0,0 +1,53 @@
+#pragma once
+
+// Game logic and networking run at this rate, however fast we render
+#define SIM_TICK_HZ 90.0
+// After a long stall, give up catching up instead of spiralling
+#define MAX_TICKS_PER_FRAME 5
+
+// Turns frame times into a whole number of fixed length ticks.
+//
+// Each frame hands advance() the time it started and runs as many
+// ticks as it returns. What a tick does (input, rules, sending) then
+// happens at the tick rate, whatever the frame rate or however many
+// times a frame draws.
+class FixedStep
+{
+public:
+	FixedStep(double hz = SIM_TICK_HZ) : rate(hz) {}
+
+	void setRate(double hz) { rate = hz; }
+
+	double getRate() const { return rate; }
+
+	// ticks due by now, in seconds. the first call only starts the
+	// clock. more than MAX_TICKS_PER_FRAME owed are forgotten rather
+	// than run back to back
+	int advance(double now)
+	{
+		if (last == 0.0)
+			last = now;
+
+		accumulator += now - last;
+		last = now;
+
+		double step = 1.0 / rate;
+		int ticks = 0;
+
+		while (accumulator >= step && ticks < MAX_TICKS_PER_FRAME)
+		{
+			accumulator -= step;
+			ticks++;
+		}
+
+		if (ticks == MAX_TICKS_PER_FRAME)
+			accumulator = 0.0;
+
+		return ticks;
+	}
+
+private:
+	double rate;
+	double last = 0.0;
+	double accumulator = 0.0;
+};
@@ -0,0 +1,146 @@
+#include "FrameBuffer.h"
+#include <string.h>
+
+static uint32_t roundUpPow2(uint32_t n)
+{
+    uint32_t p = 1;
+    while (p < n)
+        p <<= 1;
+    return p;
+}
+
+FrameBuffer::FrameBuffer(BufferPool & bufferPool, unsigned int initial, unsigned int highWater)
+    : pool(bufferPool)
+{
+    initialCapacity = roundUpPow2(initial < FRAME_HEADER_SIZE ? FRAME_HEADER_SIZE : initial);
+    maxCapacity = roundUpPow2(highWater < initial ? initial : highWater);
+
+    // the pool's biggest block holds the ring plus its slack
+    if (maxCapacity > POOL_MAX_BLOCK / 2)
+        maxCapacity = POOL_MAX_BLOCK / 2;
+    if (initialCapacity > maxCapacity)
+        initialCapacity = maxCapacity;
+
+    data = NULL;
+    blockSize = 0;
+    capacity = 0;
+    mask = 0;
+    readPos = 0;
+    writePos = 0;
+    filled = false;
+    bad = false;
+
+    resize(initialCapacity);
+}
+
+FrameBuffer::~FrameBuffer(void)
+{
+    pool.release(data, blockSize);
+}
+
+bool FrameBuffer::resize(uint32_t newCapacity)
+{
+    // a wrapped frame is never longer than the ring, so slack == ring
+    size_t newBlockSize = (size_t)newCapacity * 2;
+    char * newData = pool.acquire(newBlockSize);
+
+    if (newData == NULL)
+        return false;
+
+    // linearize whatever is pending at the front of the new ring
+    uint32_t count = writePos - readPos;
+    for (uint32_t i = 0; i < count; i++)
+        newData[i] = data[(readPos + i) & mask];
+
+    pool.release(data, blockSize);
+
+    data = newData;
+    blockSize = newBlockSize;
+    capacity = newCapacity;
+    mask = newCapacity - 1;
+    readPos = 0;
+    writePos = count;
+
+    return true;
+}
+
+void FrameBuffer::adapt()
+{
+    // grow while the sender is outpacing us, shrink back once idle
+    if (filled && capacity < maxCapacity)
+        resize(capacity * 2);
+    else if (!filled && readPos == writePos && capacity > initialCapacity)
+        resize(initialCapacity);
+
+    filled = false;
+}
+
+char * FrameBuffer::writePtr()
+{
+    return data + (writePos & mask);
+}
+
+int FrameBuffer::writable() const
+{
+    uint32_t free = capacity - (writePos - readPos);
+    uint32_t toEnd = capacity - (writePos & mask);
+    return (int)(free < toEnd ? free : toEnd);
+}
+
+void FrameBuffer::commit(int n)
+{
+    filled = n > 0 && n == writable();
+    writePos += n;
+}
+
+bool FrameBuffer::nextFrame(const char *& payload, int & length)
+{
+    uint32_t available = writePos - readPos;
+
+    if (bad)
+        return false;
+
+    if (available < FRAME_HEADER_SIZE)
+    {
+        adapt();
+        return false;
+    }
+
+    // the header itself may straddle the end of the ring
+    unsigned char header[FRAME_HEADER_SIZE];
+    for (int i = 0; i < FRAME_HEADER_SIZE; i++)
+        header[i] = data[(readPos + i) & mask];
+
+    length = readFrameHeader((const char *)header);
+
+    uint32_t frameSize = FRAME_HEADER_SIZE + length;
+
+    if (length > MAX_FRAME_SIZE || frameSize > maxCapacity) {
+        bad = true;
+        return false;
+    }
+
+    // make room for the whole frame before its bytes arrive
+    if (frameSize > capacity && !resize(roundUpPow2(frameSize))) {
+        bad = true;
+        return false;
+    }
+
+    if (available < frameSize)
+    {
+        adapt();
+        return false;
+    }
+
+    uint32_t start = (readPos + FRAME_HEADER_SIZE) & mask;
+    uint32_t toEnd = capacity - start;
+
+    // mirror the wrapped tail behind the ring so the payload is contiguous
+    if ((uint32_t)length > toEnd)
+        memcpy(data + capacity, data, length - toEnd);
+
+    payload = data + start;
+    readPos += frameSize;
+
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include "NetworkData.h"
+#include "BufferPool.h"
+
+// Per-session reassembly buffer for the length-prefixed stream.
+//
+// recv() writes straight into the ring and complete frames are handed
+// out as pointers into it, so nothing is copied or memmove'd in the
+// common case. A frame that wraps past the end of the ring has its
+// wrapped tail mirrored into slack space behind the ring so it still
+// reads as one contiguous block.
+//
+// The ring starts small and lives in a BufferPool block. It doubles
+// when a frame does not fit or a recv fills it, up to highWater, and
+// falls back to its initial size once drained.
+class FrameBuffer
+{
+public:
+    FrameBuffer(BufferPool & pool, unsigned int initial = RECV_BUFFER_INITIAL,
+                unsigned int highWater = RECV_BUFFER_HIGH_WATER);
+    ~FrameBuffer(void);
+
+    // contiguous free space recv() may fill
+    char * writePtr();
+    int writable() const;
+
+    // mark n bytes at writePtr() as received
+    void commit(int n);
+
+    // next complete frame payload, or false if more bytes are needed.
+    // the pointer stays valid until the next commit() or nextFrame()
+    bool nextFrame(const char *& payload, int & length);
+
+    // a frame was bigger than MAX_FRAME_SIZE or the high-water mark
+    bool corrupt() const { return bad; }
+
+    // bytes received but not yet handed out
+    int pending() const { return (int)(writePos - readPos); }
+
+    // current ring size
+    unsigned int size() const { return capacity; }
+
+private:
+    FrameBuffer(const FrameBuffer &);
+    FrameBuffer & operator=(const FrameBuffer &);
+
+    // move to a ring of newCapacity, keeping pending bytes
+    bool resize(uint32_t newCapacity);
+
+    // pick the ring size for the next recv once all frames are out
+    void adapt();
+
+    BufferPool & pool;
+
+    char * data;
+    size_t blockSize;
+
+    uint32_t capacity;
+    uint32_t mask;
+    uint32_t initialCapacity;
+    uint32_t maxCapacity;
+
+    // free running positions, wrapped with mask on access
+    uint32_t readPos;
+    uint32_t writePos;
+
+    // the last commit filled all the space it was offered
+    bool filled;
+
+    bool bad;
+};
@@ -0,0 +1,90 @@
+#include "Histogram.h"
+#include <string.h>
+#include <math.h>
+
+#define SUB_COUNT (1 << HISTOGRAM_SUB_BITS)
+
+void Histogram::clear()
+{
+    memset(buckets, 0, sizeof(buckets));
+    total = 0;
+    sum = 0;
+    smallest = 0xFFFFFFFF;
+    largest = 0;
+}
+
+// values below SUB_COUNT get a bucket each; above that, the position
+// of the top bit picks the power of two and the next bits split it
+int Histogram::bucketOf(uint32_t value)
+{
+    if (value < SUB_COUNT)
+        return (int)value;
+
+    int top = 31;
+    while (!(value & (1u << top)))
+        top--;
+
+    int shift = top - HISTOGRAM_SUB_BITS;
+    int sub = (int)((value >> shift) & (SUB_COUNT - 1));
+
+    return ((shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+uint32_t Histogram::bucketTop(int bucket)
+{
+    if (bucket < SUB_COUNT)
+        return (uint32_t)bucket;
+
+    int shift = (bucket >> HISTOGRAM_SUB_BITS) - 1;
+    uint64_t sub = (uint64_t)(bucket & (SUB_COUNT - 1));
+    uint64_t top = ((SUB_COUNT + sub + 1) << shift) - 1;
+
+    return top > 0xFFFFFFFFull ? 0xFFFFFFFF : (uint32_t)top;
+}
+
+void Histogram::record(uint32_t value)
+{
+    buckets[bucketOf(value)]++;
+    total++;
+    sum += value;
+
+    if (value < smallest)
+        smallest = value;
+    if (value > largest)
+        largest = value;
+}
+
+uint32_t Histogram::percentile(double p) const
+{
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = (uint64_t)ceil(p * total);
+    if (rank < 1)
+        rank = 1;
+
+    uint64_t seen = 0;
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+            return bucketTop(i) < largest ? bucketTop(i) : largest;
+    }
+
+    return largest;
+}
+
+void Histogram::merge(const Histogram & other)
+{
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+        buckets[i] += other.buckets[i];
+
+    total += other.total;
+    sum += other.sum;
+
+    if (other.total && other.smallest < smallest)
+        smallest = other.smallest;
+    if (other.largest > largest)
+        largest = other.largest;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+
+// sub-buckets per power of two: each bucket spans at most 1/4 of its
+// value, so percentiles are within 25%
+#define HISTOGRAM_SUB_BITS 2
+#define HISTOGRAM_BUCKETS ((32 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+// Log-linear histogram of 32 bit samples (microseconds, bytes, ...).
+// Fixed size and trivially copyable, so it can be published through a
+// SeqLock or copied out for a dashboard.
+class Histogram
+{
+public:
+    Histogram(void) { clear(); }
+
+    void clear();
+
+    void record(uint32_t value);
+
+    uint64_t count() const { return total; }
+    uint32_t min() const { return total ? smallest : 0; }
+    uint32_t max() const { return largest; }
+    double mean() const { return total ? (double)sum / total : 0.0; }
+
+    // upper bound of the bucket holding the p-th sample (0 < p <= 1)
+    uint32_t percentile(double p) const;
+
+    // fold another histogram into this one
+    void merge(const Histogram & other);
+
+private:
+    static int bucketOf(uint32_t value);
+    static uint32_t bucketTop(int bucket);
+
+    uint32_t buckets[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint32_t smallest;
+    uint32_t largest;
+};
@@ -0,0 +1,414 @@
+#include "LocalChannel.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <time.h>
+#endif
+
+// first word of a segment, so a client knows what it mapped
+#define LOCAL_MAGIC 0x4C565253u
+
+#ifndef _WIN32
+static socklen_t localAddress(const char * port, struct sockaddr_un & address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    // abstract: a leading zero, nothing to clean up on disk
+    int length = snprintf(address.sun_path + 1, sizeof(address.sun_path) - 1, "%s%s", LOCAL_SOCKET_PREFIX, port);
+
+    return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + length);
+}
+
+static void futexWake(std::atomic<uint32_t> & word)
+{
+    NetworkServices::syscalls++;
+    syscall(SYS_futex, &word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+#endif
+
+LocalChannel::LocalChannel(SOCKET unixSocket, LocalSegment * shared, bool serverEnd)
+    : socket(unixSocket), server(serverEnd), segment(shared)
+{
+    in = server ? &segment->toServer : &segment->toClient;
+    out = server ? &segment->toClient : &segment->toServer;
+}
+
+LocalChannel::~LocalChannel(void)
+{
+    hangUp();
+
+#ifndef _WIN32
+    // the peer sees its doorbell hang up too
+    if (socket != INVALID_SOCKET)
+        closesocket(socket);
+
+    munmap(segment, sizeof(LocalSegment));
+#endif
+}
+
+SOCKET LocalChannel::listen(const char * port)
+{
+#ifdef _WIN32
+    return INVALID_SOCKET;
+#else
+    struct sockaddr_un address;
+    socklen_t length = localAddress(port, address);
+
+    SOCKET listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (listener == INVALID_SOCKET)
+        return INVALID_SOCKET;
+
+    if (bind(listener, (struct sockaddr *)&address, length) == SOCKET_ERROR ||
+        ::listen(listener, SOMAXCONN) == SOCKET_ERROR)
+    {
+        closesocket(listener);
+        return INVALID_SOCKET;
+    }
+
+    return listener;
+#endif
+}
+
+LocalChannel * LocalChannel::accept(SOCKET listener)
+{
+#ifdef _WIN32
+    return NULL;
+#else
+    SOCKET socket = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (socket == INVALID_SOCKET)
+        return NULL;
+
+    // fresh pages read as zero, which is an empty ring nobody waits on
+    int memory = memfd_create("VR_Server local", MFD_CLOEXEC);
+    void * mapped = MAP_FAILED;
+
+    if (memory >= 0 && ftruncate(memory, sizeof(LocalSegment)) == 0)
+        mapped = mmap(NULL, sizeof(LocalSegment), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+
+    if (mapped == MAP_FAILED)
+    {
+        printf("local connection refused, no shared memory: %d\n", errno);
+        if (memory >= 0)
+            close(memory);
+        closesocket(socket);
+        return NULL;
+    }
+
+    LocalSegment * segment = (LocalSegment *)mapped;
+    segment->magic = LOCAL_MAGIC;
+    segment->size = sizeof(LocalSegment);
+
+    // hand the client the memory, as the one byte it waits for
+    char byte = 0;
+    struct iovec part;
+    part.iov_base = &byte;
+    part.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &memory, sizeof(int));
+
+    ssize_t sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+
+    // the mapping keeps the memory
+    close(memory);
+
+    if (sent != 1)
+    {
+        munmap(mapped, sizeof(LocalSegment));
+        closesocket(socket);
+        return NULL;
+    }
+
+    return new LocalChannel(socket, segment, true);
+#endif
+}
+
+LocalChannel * LocalChannel::connect(const char * port)
+{
+#ifdef _WIN32
+    return NULL;
+#else
+    struct sockaddr_un address;
+    socklen_t length = localAddress(port, address);
+
+    SOCKET socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    if (socket == INVALID_SOCKET)
+        return NULL;
+
+    if (::connect(socket, (struct sockaddr *)&address, length) == SOCKET_ERROR)
+    {
+        closesocket(socket);
+        return NULL;
+    }
+
+    // a server busy elsewhere accepts on its next pump, not at once
+    struct timeval timeout;
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    char byte;
+    struct iovec part;
+    part.iov_base = &byte;
+    part.iov_len = 1;
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &part;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr * header = NULL;
+
+    if (recvmsg(socket, &message, MSG_CMSG_CLOEXEC) == 1)
+        header = CMSG_FIRSTHDR(&message);
+
+    if (header == NULL || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+    {
+        closesocket(socket);
+        return NULL;
+    }
+
+    int memory;
+    memcpy(&memory, CMSG_DATA(header), sizeof(int));
+
+    void * mapped = mmap(NULL, sizeof(LocalSegment), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+    close(memory);
+
+    if (mapped == MAP_FAILED)
+    {
+        closesocket(socket);
+        return NULL;
+    }
+
+    LocalSegment * segment = (LocalSegment *)mapped;
+
+    // a server built with other ring sizes
+    if (segment->magic != LOCAL_MAGIC || segment->size != sizeof(LocalSegment))
+    {
+        printf("local server speaks another version, use tcp\n");
+        munmap(mapped, sizeof(LocalSegment));
+        closesocket(socket);
+        return NULL;
+    }
+
+    NetworkServices::setNonBlocking(socket);
+
+    return new LocalChannel(socket, segment, false);
+#endif
+}
+
+int LocalChannel::write(const char * const * buffers, const int * lengths, int count)
+{
+    uint32_t tail = out->tail.load(std::memory_order_relaxed);
+    uint32_t queued = tail - out->head.load(std::memory_order_acquire);
+
+    // the peer can write anywhere in the segment: positions no ring
+    // can have would have us copy past its data
+    if (queued > LOCAL_RING_SIZE)
+    {
+        printf("local peer broke its ring, hanging up\n");
+        hangUp();
+        errno = EPIPE;
+        return SOCKET_ERROR;
+    }
+
+    uint32_t room = LOCAL_RING_SIZE - queued;
+    uint32_t written = 0;
+
+    for (int i = 0; i < count && written < room; i++)
+    {
+        uint32_t length = (uint32_t)lengths[i];
+        if (length > room - written)
+            length = room - written;
+
+        uint32_t start = (tail + written) & (LOCAL_RING_SIZE - 1);
+        uint32_t toEnd = LOCAL_RING_SIZE - start;
+        uint32_t first = length < toEnd ? length : toEnd;
+
+        memcpy(out->data + start, buffers[i], first);
+        memcpy(out->data, buffers[i] + first, length - first);
+        written += length;
+    }
+
+    if (written == 0)
+        return 0;
+
+    // publish, then look for a sleeper. paired with the reader arming
+    // before it looks at the tail, one of the two sees the other
+    out->tail.store(tail + written, std::memory_order_seq_cst);
+
+    if (out->waiting.load(std::memory_order_seq_cst) != LOCAL_AWAKE)
+        ring(out->waiting.exchange(LOCAL_AWAKE), out->tail);
+
+    return (int)written;
+}
+
+int LocalChannel::read(char * buffer, int bufSize, bool take)
+{
+    uint32_t head = in->head.load(std::memory_order_relaxed);
+    uint32_t available = in->tail.load(std::memory_order_acquire) - head;
+
+    // as in write, and seen as the peer hanging up
+    if (available > LOCAL_RING_SIZE)
+    {
+        printf("local peer broke its ring, hanging up\n");
+        hangUp();
+        return 0;
+    }
+
+    if (available == 0)
+    {
+        if (closed())
+            return 0;
+
+        // nothing yet, like a nonblocking recv
+        errno = EAGAIN;
+        return SOCKET_ERROR;
+    }
+
+    uint32_t length = available < (uint32_t)bufSize ? available : (uint32_t)bufSize;
+    uint32_t start = head & (LOCAL_RING_SIZE - 1);
+    uint32_t toEnd = LOCAL_RING_SIZE - start;
+    uint32_t first = length < toEnd ? length : toEnd;
+
+    memcpy(buffer, in->data + start, first);
+    memcpy(buffer + first, in->data, length - first);
+
+    if (!take)
+        return (int)length;
+
+    in->head.store(head + length, std::memory_order_seq_cst);
+
+    if (in->spaceWanted.load(std::memory_order_seq_cst) != LOCAL_AWAKE)
+        ring(in->spaceWanted.exchange(LOCAL_AWAKE), in->head);
+
+    return (int)length;
+}
+
+bool LocalChannel::wait(int timeout_ms)
+{
+#ifdef _WIN32
+    return readable() || closed();
+#else
+    struct timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000l;
+
+    for (;;)
+    {
+        in->waiting.store(LOCAL_FUTEX, std::memory_order_seq_cst);
+
+        uint32_t tail = in->tail.load(std::memory_order_seq_cst);
+
+        if (tail != in->head.load(std::memory_order_relaxed) || closed())
+        {
+            quiet();
+            return true;
+        }
+
+        // sleeps only while the tail still is what we saw
+        NetworkServices::syscalls++;
+        long result = syscall(SYS_futex, &in->tail, FUTEX_WAIT, tail, timeout_ms >= 0 ? &timeout : NULL, NULL, 0);
+
+        quiet();
+
+        if (result == -1 && errno == ETIMEDOUT)
+            return readable() || closed();
+    }
+#endif
+}
+
+bool LocalChannel::sleep()
+{
+    in->waiting.store(LOCAL_DOORBELL, std::memory_order_seq_cst);
+
+    if (in->tail.load(std::memory_order_seq_cst) != in->head.load(std::memory_order_relaxed) || closed())
+    {
+        quiet();
+        return false;
+    }
+
+    return true;
+}
+
+bool LocalChannel::drain()
+{
+    char bytes[64];
+
+    for (;;)
+    {
+        int received = NetworkServices::receiveMessage(socket, bytes, sizeof(bytes));
+
+        // rung fewer times than fit: that was all of it
+        if (received > 0 && received < (int)sizeof(bytes))
+            return true;
+
+        if (received > 0)
+            continue;
+
+        if (received == SOCKET_ERROR && NetworkServices::wouldBlock())
+            return true;
+
+        // gone without hanging up, a crash
+        segment->closed.store(1, std::memory_order_seq_cst);
+        return false;
+    }
+}
+
+void LocalChannel::wantSpace(bool enable)
+{
+    out->spaceWanted.store(enable ? LOCAL_DOORBELL : LOCAL_AWAKE, std::memory_order_seq_cst);
+}
+
+void LocalChannel::hangUp()
+{
+    if (segment->closed.exchange(1) != 0)
+        return;
+
+    // a peer asleep on the futex wouldn't notice the socket go
+    if (out->waiting.load() == LOCAL_FUTEX)
+        ring(out->waiting.exchange(LOCAL_AWAKE), out->tail);
+}
+
+void LocalChannel::ring(int waiter, std::atomic<uint32_t> & word)
+{
+#ifndef _WIN32
+    if (waiter == LOCAL_FUTEX)
+        futexWake(word);
+    else if (waiter == LOCAL_DOORBELL)
+    {
+        // full means it has been rung already
+        char byte = 0;
+        NetworkServices::syscalls++;
+        send(socket, &byte, 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    }
+#endif
+}
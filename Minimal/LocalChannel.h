@@ -0,0 +1,154 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "NetworkServices.h"
+
+// bytes each direction of a local connection holds, like a socket's
+// buffer. a power of two
+#define LOCAL_RING_SIZE (64 * 1024)
+
+// abstract unix socket a server takes local connections on, followed
+// by its port number
+#define LOCAL_SOCKET_PREFIX "VR_Server."
+
+// how the reader of a ring sleeps, so the writer knows how to wake it
+enum LocalWaiters {
+
+    LOCAL_AWAKE = 0,        // it isn't: writing costs no syscall
+
+    LOCAL_FUTEX = 1,        // blocked in wait, woken through the futex
+
+    LOCAL_DOORBELL = 2,     // polling its socket with others, woken by a byte on it
+
+};
+
+// One direction of a local connection, in memory both processes map.
+// Positions only ever grow; each field is written by one side only,
+// and the two sides' fields sit on different cache lines.
+struct LocalRing
+{
+    // written by the writer
+    alignas(64) std::atomic<uint32_t> tail;
+
+    // LocalWaiters of a writer waiting for room
+    std::atomic<uint32_t> spaceWanted;
+
+    // written by the reader
+    alignas(64) std::atomic<uint32_t> head;
+
+    // LocalWaiters of the reader
+    std::atomic<uint32_t> waiting;
+
+    alignas(64) char data[LOCAL_RING_SIZE];
+};
+
+// what a local connection maps: a ring each way, and whether either
+// side has hung up
+struct LocalSegment
+{
+    uint32_t magic;
+    uint32_t size;
+
+    LocalRing toServer;
+    LocalRing toClient;
+
+    alignas(64) std::atomic<uint32_t> closed;
+};
+
+// A connection to a server on the same host through shared memory.
+//
+// The client connects to the server's LOCAL_SOCKET_PREFIX socket, and
+// the server answers with a memfd holding a LocalSegment. From then on
+// a message is a copy into the ring by the sender and a copy out by
+// the reader, with no kernel in between: as long as the reader is
+// awake, sending and receiving are plain loads and stores.
+//
+// A reader with nothing to read says how it sleeps first (waiting).
+// One blocked on this connection alone sleeps on a futex on the tail;
+// one polling it among sockets arms the doorbell, and the writer sends
+// a byte down the unix socket to wake it. Either way the writer only
+// makes the syscall when the reader really is asleep, and one wake
+// disarms it. The socket also tells each side when the other is gone.
+//
+// The peer is another process, and can write anything to the
+// segment: positions that can't be are taken as it hanging up.
+//
+// Linux only: elsewhere listen, accept and connect fail.
+class LocalChannel
+{
+public:
+    // server: the socket local connections arrive on for port, or
+    // INVALID_SOCKET
+    static SOCKET listen(const char * port);
+
+    // server: the next connection waiting on listener, NULL once none are
+    static LocalChannel * accept(SOCKET listener);
+
+    // client: connect to the server on port of this host, NULL if
+    // there is none
+    static LocalChannel * connect(const char * port);
+
+    // hangs up and closes the socket
+    ~LocalChannel(void);
+
+    // copy as much of count buffers as the ring has room for. returns
+    // the bytes taken, which may stop part way into a buffer, or
+    // SOCKET_ERROR after hanging up on a peer that broke the ring
+    int write(const char * const * buffers, const int * lengths, int count);
+
+    // copy out what has arrived, taking it unless peeking. like recv:
+    // 0 once the peer hung up and everything before was read, or broke
+    // the ring, SOCKET_ERROR with EAGAIN if nothing is there yet
+    int read(char * buffer, int bufSize, bool take = true);
+
+    // something to read
+    bool readable() const { return in->tail.load(std::memory_order_acquire) != in->head.load(std::memory_order_relaxed); }
+
+    // the ring out has room
+    bool writable() const { return out->tail.load(std::memory_order_relaxed) - out->head.load(std::memory_order_acquire) < LOCAL_RING_SIZE; }
+
+    // either side hung up
+    bool closed() const { return segment->closed.load(std::memory_order_acquire) != 0; }
+
+    // block up to timeout_ms (-1 = forever) until there is something
+    // to read or the peer hung up. false on timeout
+    bool wait(int timeout_ms);
+
+    // before polling socket: arm the doorbell. false if there is
+    // something to read already, and nothing was armed
+    bool sleep();
+
+    // after polling: disarm the doorbell
+    void quiet() { in->waiting.store(LOCAL_AWAKE, std::memory_order_relaxed); }
+
+    // take the doorbell bytes once socket polled readable. false if
+    // the peer's end of it closed, which counts as hanging up
+    bool drain();
+
+    // ask for the doorbell once the peer reads, after a write that
+    // didn't fit
+    void wantSpace(bool enable);
+
+    // tell the peer nothing more comes, waking it wherever it sleeps
+    void hangUp();
+
+    // the unix socket: the doorbell, and the peer's liveness
+    SOCKET socket;
+
+    // this is the server's end
+    const bool server;
+
+private:
+    LocalChannel(SOCKET socket, LocalSegment * segment, bool server);
+    LocalChannel(const LocalChannel &);
+    LocalChannel & operator=(const LocalChannel &);
+
+    // wake whoever waits on word as waiter says
+    void ring(int waiter, std::atomic<uint32_t> & word);
+
+    LocalSegment * segment;
+
+    // the ring this side reads, and the one it writes
+    LocalRing * in;
+    LocalRing * out;
+};
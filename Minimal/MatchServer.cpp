@@ -0,0 +1,931 @@
+#include "MatchServer.h"
+#include "Metrics.h"
+#include <set>
+#include <algorithm>
+
+
+MatchShard::MatchShard(unsigned int shardIndex, unsigned int shards, int engine)
+    : index(shardIndex), matches(0), players(0), spectators(0), messagesRelayed(0), spectatorSends(0),
+      messagesReceived(0), syscalls(0),
+      random(std::random_device()()),
+      shardCount(shards), running(false)
+{
+    network = new ServerNetwork(NULL, false, engine);
+    network->heartbeat_ms = HEARTBEAT_INTERVAL_MS;
+    network->idle_timeout_ms = IDLE_TIMEOUT_MS;
+    reactor = new SocketReactor(*network);
+    waiting = NULL;
+    nextMatch = 0;
+}
+
+MatchShard::~MatchShard(void)
+{
+    stop();
+
+    // sockets handed over but never adopted
+    Arrival arrival;
+    while (incoming.pop(arrival))
+    {
+        if (arrival.channel != NULL)
+            delete arrival.channel;
+        else
+            closesocket(arrival.socket);
+    }
+
+    // every full match is listed by id, and the one still filling is
+    // referenced from its seated player
+    std::set<Match *> owned;
+    std::map<unsigned int, Match *>::iterator iter;
+    for (iter = matchOf.begin(); iter != matchOf.end(); iter++)
+        owned.insert(iter->second);
+    for (iter = matchById.begin(); iter != matchById.end(); iter++)
+        owned.insert(iter->second);
+
+    std::set<Match *>::iterator match;
+    for (match = owned.begin(); match != owned.end(); match++)
+        delete *match;
+
+    // the sessions' coroutines go without leaving their matches, which
+    // are gone already
+    delete reactor;
+    delete network;
+}
+
+void MatchShard::start()
+{
+    if (running)
+        return;
+
+    running = true;
+
+    thread = std::thread([this]() {
+        while (running)
+            pump(SHARD_WAIT_MS);
+    });
+}
+
+void MatchShard::stop()
+{
+    if (!running)
+        return;
+
+    running = false;
+    thread.join();
+}
+
+bool MatchShard::hand(SOCKET socket, int kind, uint64_t key, LocalChannel * channel,
+    const char * greeting, int greetingLength)
+{
+    Arrival arrival;
+    arrival.socket = socket;
+    arrival.channel = channel;
+    arrival.kind = kind;
+    arrival.key = key;
+
+    if (greetingLength > GREETING_MAX_SIZE)
+        greetingLength = GREETING_MAX_SIZE;
+
+    if (greetingLength > 0)
+        memcpy(arrival.greeting, greeting, greetingLength);
+    arrival.greetingLength = greetingLength;
+
+    return incoming.push(arrival);
+}
+
+void MatchShard::pump(int timeout_ms)
+{
+    Arrival arrival;
+
+    Metrics::set(METRIC_HANDOFF_QUEUE, incoming.depth());
+
+    while (incoming.pop(arrival))
+    {
+        unsigned int session = network->adoptClient(arrival.socket, arrival.channel);
+
+        if (session != INVALID_SESSION)
+            serve(session, arrival);
+    }
+
+    // sessions closed since the last pump are ended here too, along
+    // with what arrived
+    network->waitForEvents(timeout_ms);
+    uint64_t woke = clockMicros();
+
+    reactor->dispatch();
+
+    publish();
+
+    checkTimers();
+
+    syscalls = NetworkServices::syscalls;
+    Metrics::record(METRIC_TICK_US, clockMicros() - woke);
+}
+
+Task MatchShard::serve(unsigned int session, Arrival arrival)
+{
+    AsyncSocket socket(*reactor, session);
+
+    // the first message, as the connection sent it
+    socket.unread(arrival.greeting, arrival.greetingLength);
+
+    if (arrival.kind == ARRIVAL_RESUME)
+        resume(session, arrival.key);
+    else if (arrival.kind == ARRIVAL_SPECTATOR)
+        spectate(session, arrival.key);
+    else
+        seat(session);
+
+    while (Frame frame = co_await socket.readFrame())
+    {
+        messagesReceived++;
+
+        unsigned int type = peekPacketType(frame.payload, frame.length);
+        Metrics::packetIn(type);
+
+        // clock probes are between a player and the server, which
+        // keeps the shared clock
+        if (type == PING)
+        {
+            char reply[FRAME_HEADER_SIZE + CLOCK_PACKET_MAX_SIZE];
+            int size = answerPing(frame.payload, frame.length, reply);
+
+            // a player not taking its replies isn't read from until it does
+            if (size > 0 && !co_await socket.write(reply, size))
+                break;
+
+            continue;
+        }
+
+        apply(session, frame.payload, frame.length);
+    }
+
+    if (socket.corrupt())
+    {
+        printf("bad frame from shard %d session %d, disconnecting\n", index, session);
+        network->closeClient(session);
+    }
+
+    leave(session);
+}
+
+void MatchShard::seat(unsigned int session)
+{
+    if (waiting == NULL)
+    {
+        waiting = new Match();
+        waiting->id = nextMatch++ * shardCount + index;
+    }
+
+    Match * match = waiting;
+    match->seats[match->filled++] = session;
+    matchOf[session] = match;
+    players++;
+
+    if (match->filled == MATCH_SEATS)
+    {
+        waiting = NULL;
+        matches++;
+        matchById[match->id] = match;
+
+        // what each player needs to get its seat back later
+        for (int s = 0; s < MATCH_SEATS; s++)
+        {
+            TokenPacket token;
+            token.packet_type = SESSION_TOKEN;
+            token.token = newToken();
+            token.match = match->id;
+
+            match->tokens[s] = token.token;
+            matchOfToken[token.token] = match;
+
+            char frame[FRAME_HEADER_SIZE + TOKEN_PACKET_MAX_SIZE];
+            int size = token.serialize(frame + FRAME_HEADER_SIZE);
+            writeFrameHeader(frame, size);
+
+            network->sendTo(match->seats[s], frame, FRAME_HEADER_SIZE + size);
+        }
+
+        // tell both players their seats straight away
+        match->dirty = true;
+        dirtyMatches.push_back(match);
+    }
+}
+
+void MatchShard::resume(unsigned int session, uint64_t token)
+{
+    std::map<uint64_t, Match *>::iterator iter = matchOfToken.find(token);
+
+    if (iter == matchOfToken.end())
+    {
+        // the match ended, or the token was never ours
+        printf("unknown session token on shard %d, disconnecting\n", index);
+        network->closeClient(session);
+        return;
+    }
+
+    Match * match = iter->second;
+    int seat = match->tokens[0] == token ? 0 : 1;
+
+    network->timers.cancel(match->graceTimer[seat]);
+    match->graceTimer[seat] = 0;
+
+    // the old connection may not have been noticed dead yet. the newest
+    // one with the token wins
+    unsigned int old = match->seats[seat];
+    if (old != INVALID_SESSION)
+    {
+        matchOf.erase(old);
+        players--;
+        network->closeClient(old);
+    }
+
+    match->seats[seat] = session;
+    matchOf[session] = match;
+    players++;
+
+    // the resync must be a snapshot deltas can be taken against
+    MatchState & state = match->state;
+    if (match->history.find(state.seq) == NULL)
+    {
+        state.seq++;
+        match->history.store(state);
+    }
+
+    char frame[FRAME_HEADER_SIZE + RESYNC_MAX_SIZE];
+    int size = state.writeResync(seat, frame + FRAME_HEADER_SIZE);
+    writeFrameHeader(frame, size);
+
+    // the stream delivers it, so deltas can start from it at once
+    match->acked[seat] = state.seq;
+    match->sent[seat] = state.seq;
+
+    network->sendTo(session, frame, FRAME_HEADER_SIZE + size);
+}
+
+void MatchShard::spectate(unsigned int session, uint64_t matchId)
+{
+    std::map<unsigned int, Match *>::iterator iter = matchById.end();
+
+    if (matchId <= 0xFFFFFFFFu)
+        iter = matchById.find((unsigned int)matchId);
+
+    if (iter == matchById.end())
+    {
+        printf("no match %llu to watch on shard %d, disconnecting\n", (unsigned long long)matchId, index);
+        network->closeClient(session);
+        return;
+    }
+
+    Match * match = iter->second;
+
+    // nobody was watching, so nothing kept the spectators' base current
+    if (match->spectators.empty())
+    {
+        match->watched = match->state;
+        if (match->resync != NULL)
+        {
+            match->resync->release();
+            match->resync = NULL;
+        }
+    }
+
+    // everyone joining before the next change shares one resync
+    if (match->resync == NULL)
+    {
+        char frame[FRAME_HEADER_SIZE + RESYNC_MAX_SIZE];
+        int size = match->watched.writeResync(SPECTATOR_SEAT, frame + FRAME_HEADER_SIZE);
+
+        if (size > 0)
+        {
+            writeFrameHeader(frame, size);
+            match->resync = SharedBuffer::create(frame, FRAME_HEADER_SIZE + size);
+        }
+
+        if (match->resync == NULL)
+        {
+            network->closeClient(session);
+            return;
+        }
+    }
+
+    match->spectators.push_back(session);
+    watching[session] = match;
+    spectators++;
+
+    // the snapshots that follow are deltas against this
+    network->sendShared(session, match->resync);
+}
+
+void MatchShard::apply(unsigned int from, const char * payload, int length)
+{
+    unsigned int type = peekPacketType(payload, length);
+
+    // the answer to a heartbeat, which carries when it went out
+    if (type == PONG)
+    {
+        ClockPacket clock;
+        uint64_t now = clockMicros();
+
+        if (clock.deserialize(payload, length) && clock.origin != 0 && clock.origin <= now)
+            Metrics::record(METRIC_RTT_US, now - clock.origin);
+        return;
+    }
+
+    // the acceptor already read the token off a RESUME or SPECTATE
+    if (type == RESUME || type == SPECTATE)
+        return;
+
+    // spectators only watch
+    if (watching.count(from))
+        return;
+
+    std::map<unsigned int, Match *>::iterator iter = matchOf.find(from);
+
+    // a seat given up on, or a resume that found nothing to resume
+    if (iter == matchOf.end())
+        return;
+
+    Match * match = iter->second;
+
+    // nothing to play with until the match fills
+    if (match->filled < MATCH_SEATS)
+        return;
+
+    int seat = match->seatOf(from);
+
+    if (type == FLEET)
+    {
+        takeFleet(match, seat, payload, length);
+        return;
+    }
+
+    Packet packet;
+
+    if (!packet.deserialize(payload, length))
+    {
+        printf("malformed packet from shard %d session %d\n", index, from);
+        return;
+    }
+
+    MatchState & state = match->state;
+
+    // acks only move forward, and only to snapshots that were sent
+    if (packet.ack > match->acked[seat] && packet.ack <= state.seq)
+        match->acked[seat] = packet.ack;
+
+    if (packet.packet_type != ACTION_EVENT)
+        return;
+
+    int other = 1 - seat;
+
+    if (packet.attack.first != -1)
+    {
+        int row = packet.attack.first;
+        int column = packet.attack.second;
+
+        // an invalid shot is dropped, and nothing else in the packet
+        // is taken from a client that sent it
+        if (state.shoot(seat, row, column) == SHOT_INVALID)
+        {
+            printf("bad shot from shard %d session %d\n", index, from);
+            return;
+        }
+
+        // with the target's ships known the result goes out in the same
+        // snapshot as the shot
+        if (match->fleetKnown[other] && match->fleets[other].shoot(row, column) == SHOT_HIT)
+            state.reportHit(other, row, column);
+
+        startTurn(match);
+    }
+
+    // a player whose fleet we hold has nothing to report: its hits
+    // were resolved here already
+    if (packet.damage.first != -1 && !match->fleetKnown[seat] &&
+        !state.reportHit(seat, packet.damage.first, packet.damage.second))
+        printf("bad hit report from shard %d session %d\n", index, from);
+
+    state.position[seat] = posePosition(packet.headPose);
+    state.orientation[seat] = poseOrientation(packet.headPose);
+    state.poseTime[seat] = packet.timestamp;
+    state.done[seat] = packet.done;
+
+    // the first turn starts once both fleets are placed
+    if (match->turnTimer == 0 && state.done[0] && state.done[1])
+        startTurn(match);
+
+    if (!match->dirty)
+    {
+        match->dirty = true;
+        dirtyMatches.push_back(match);
+    }
+}
+
+void MatchShard::takeFleet(Match * match, int seat, const char * payload, int length)
+{
+    // ships stay where they were first put: a second fleet could move
+    // them away from shots already fired
+    if (match->fleetKnown[seat])
+        return;
+
+    FleetPacket fleet;
+
+    if (!fleet.deserialize(payload, length) || !fleet.toBoard(match->fleets[seat]))
+    {
+        printf("bad fleet from shard %d match %d\n", index, match->id);
+        match->fleets[seat].clear();
+        return;
+    }
+
+    // shots fired before it arrived were left for this player to
+    // report; settle the ones it hasn't
+    MatchState & state = match->state;
+    int other = 1 - seat;
+    bool changed = false;
+
+    for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+    {
+        int row = i / BOARD_SIZE;
+        int column = i % BOARD_SIZE;
+
+        if (state.shots[other][i] == CELL_EMPTY)
+            continue;
+
+        if (match->fleets[seat].shoot(row, column) == SHOT_HIT && state.reportHit(seat, row, column))
+            changed = true;
+    }
+
+    match->fleetKnown[seat] = true;
+
+    if (changed && !match->dirty)
+    {
+        match->dirty = true;
+        dirtyMatches.push_back(match);
+    }
+}
+
+void MatchShard::publish()
+{
+    char frame[FRAME_HEADER_SIZE + SNAPSHOT_MAX_SIZE];
+
+    for (size_t i = 0; i < dirtyMatches.size(); i++)
+    {
+        Match * match = dirtyMatches[i];
+        match->dirty = false;
+
+        MatchState & state = match->state;
+        state.seq++;
+        match->history.store(state);
+
+        for (int seat = 0; seat < MATCH_SEATS; seat++)
+        {
+            // nobody to send to until the seat is resumed
+            if (match->seats[seat] == INVALID_SESSION)
+                continue;
+
+            // the stream delivers what was sent, so acks lagging by a
+            // round trip is no reason to send the same change twice
+            const MatchState * last = match->history.find(match->sent[seat]);
+
+            if (last != NULL && state.writeSnapshot(last, seat, frame + FRAME_HEADER_SIZE) == 0)
+                continue;
+
+            // a seat that has acked nothing recent gets everything
+            const MatchState * base = match->history.find(match->acked[seat]);
+
+            int size = state.writeSnapshot(base, seat, frame + FRAME_HEADER_SIZE);
+
+            if (size <= 0)
+                continue;
+
+            match->sent[seat] = state.seq;
+
+            writeFrameHeader(frame, size);
+
+            // each snapshot holds everything since the seat's ack, so a
+            // newer one can always replace one that hasn't gone out
+            if (network->sendTo(match->seats[seat], frame, FRAME_HEADER_SIZE + size, true))
+                messagesRelayed++;
+        }
+
+        if (!match->spectators.empty())
+            publishToSpectators(match);
+    }
+
+    dirtyMatches.clear();
+}
+
+void MatchShard::publishToSpectators(Match * match)
+{
+    char frame[FRAME_HEADER_SIZE + SNAPSHOT_MAX_SIZE];
+
+    // spectators are never behind one another: everything queued for
+    // one is queued for all, so one delta chain serves every one
+    int size = match->state.writeSnapshot(&match->watched, SPECTATOR_SEAT, frame + FRAME_HEADER_SIZE);
+
+    if (size <= 0)
+        return;
+
+    writeFrameHeader(frame, size);
+
+    SharedBuffer * buffer = SharedBuffer::create(frame, FRAME_HEADER_SIZE + size);
+
+    if (buffer == NULL)
+        return;
+
+    match->watched = match->state;
+
+    // a resync of the old base would not match the next delta
+    if (match->resync != NULL)
+    {
+        match->resync->release();
+        match->resync = NULL;
+    }
+
+    // a spectator too slow to keep up is closed and only leaves
+    // through closedClients, so the list holds still while we walk it
+    for (size_t i = 0; i < match->spectators.size(); i++)
+    {
+        if (network->sendShared(match->spectators[i], buffer))
+            spectatorSends++;
+    }
+
+    buffer->release();
+}
+
+int MatchShard::answerPing(const char * payload, int length, char * reply)
+{
+    uint64_t now = clockMicros();
+
+    ClockPacket clock;
+
+    if (!clock.deserialize(payload, length))
+        return 0;
+
+    clock.packet_type = PONG;
+    clock.received = now;
+    clock.transmit = clockMicros();
+
+    int size = clock.serialize(reply + FRAME_HEADER_SIZE);
+    writeFrameHeader(reply, size);
+
+    return FRAME_HEADER_SIZE + size;
+}
+
+void MatchShard::leave(unsigned int session)
+{
+    std::map<unsigned int, Match *>::iterator watcher = watching.find(session);
+
+    if (watcher != watching.end())
+    {
+        // order doesn't matter, so swap the last one into its place
+        std::vector<unsigned int> & list = watcher->second->spectators;
+        *std::find(list.begin(), list.end(), session) = list.back();
+        list.pop_back();
+
+        watching.erase(watcher);
+        spectators--;
+        return;
+    }
+
+    std::map<unsigned int, Match *>::iterator iter = matchOf.find(session);
+
+    if (iter == matchOf.end())
+        return;
+
+    Match * match = iter->second;
+    matchOf.erase(iter);
+    players--;
+
+    if (match == waiting)
+    {
+        // nobody else was seated yet
+        delete match;
+        waiting = NULL;
+        return;
+    }
+
+    int seat = match->seatOf(session);
+    match->seats[seat] = INVALID_SESSION;
+
+    // held even if the other seat is empty too: both players may be
+    // on their way back
+    match->graceTimer[seat] = network->timers.schedule(clockMicros() + RECONNECT_GRACE_MS * 1000ull, TIMER_GRACE,
+        (uint64_t)match->id * MATCH_SEATS + seat);
+}
+
+void MatchShard::endMatch(Match * match)
+{
+    for (int seat = 0; seat < MATCH_SEATS; seat++)
+    {
+        matchOfToken.erase(match->tokens[seat]);
+
+        // the player comes back through closedClients and finds its
+        // match gone
+        unsigned int session = match->seats[seat];
+        if (session != INVALID_SESSION && matchOf.erase(session))
+        {
+            players--;
+            network->closeClient(session);
+        }
+    }
+
+    // spectators go the same way
+    for (size_t i = 0; i < match->spectators.size(); i++)
+    {
+        watching.erase(match->spectators[i]);
+        spectators--;
+        network->closeClient(match->spectators[i]);
+    }
+
+    for (int seat = 0; seat < MATCH_SEATS; seat++)
+        network->timers.cancel(match->graceTimer[seat]);
+
+    network->timers.cancel(match->turnTimer);
+
+    matchById.erase(match->id);
+    matches--;
+    delete match;
+}
+
+void MatchShard::startTurn(Match * match)
+{
+    match->turnStarted = clockMicros();
+
+    network->timers.cancel(match->turnTimer);
+    match->turnTimer = network->timers.schedule(match->turnStarted + TURN_TIMEOUT_MS * 1000ull, TIMER_TURN, match->id);
+}
+
+void MatchShard::checkTimers()
+{
+    // anything answers a PING, which is all a heartbeat needs. a
+    // session closed since is skipped by sendTo
+    for (size_t i = 0; i < network->quietClients.size(); i++)
+    {
+        ClockPacket clock;
+        clock.packet_type = PING;
+        clock.origin = clockMicros();
+
+        char frame[FRAME_HEADER_SIZE + CLOCK_PACKET_MAX_SIZE];
+        int size = clock.serialize(frame + FRAME_HEADER_SIZE);
+        writeFrameHeader(frame, size);
+
+        network->sendTo(network->quietClients[i], frame, FRAME_HEADER_SIZE + size);
+    }
+
+    for (size_t i = 0; i < network->expiredTimers.size(); i++)
+    {
+        TimerEvent & event = network->expiredTimers[i];
+
+        if (event.kind == TIMER_TURN)
+        {
+            std::map<unsigned int, Match *>::iterator iter = matchById.find((unsigned int)event.key);
+            if (iter == matchById.end())
+                continue;
+
+            // a shot in this pump came after the timer fired, and
+            // started a new turn
+            Match * match = iter->second;
+            if (clockMicros() - match->turnStarted < TURN_TIMEOUT_MS * 1000ull)
+                continue;
+
+            // the seat's turn is lost, not its match: the other fires
+            // next, on a fresh clock
+            match->state.turn = 1 - match->state.turn;
+            startTurn(match);
+
+            if (!match->dirty)
+            {
+                match->dirty = true;
+                dirtyMatches.push_back(match);
+            }
+            continue;
+        }
+
+        if (event.kind != TIMER_GRACE)
+            continue;
+
+        // both seats' grace may run out in one pump, ending the match
+        // at the first
+        std::map<unsigned int, Match *>::iterator iter = matchById.find((unsigned int)(event.key / MATCH_SEATS));
+        if (iter == matchById.end())
+            continue;
+
+        Match * match = iter->second;
+        match->graceTimer[event.key % MATCH_SEATS] = 0;
+
+        printf("shard %d match %d: player did not come back\n", index, match->id);
+        endMatch(match);
+    }
+
+    network->expiredTimers.clear();
+}
+
+uint64_t MatchShard::newToken()
+{
+    uint64_t token;
+
+    // the acceptor finds the shard from the token alone
+    do
+        token = random() / shardCount * shardCount + index;
+    while (token == 0 || matchOfToken.count(token));
+
+    return token;
+}
+
+
+MatchServer::MatchServer(unsigned int shardCount, const char * port, int engine)
+    : accepted(0), running(false)
+{
+    if (shardCount == 0)
+    {
+        unsigned int cores = std::thread::hardware_concurrency();
+        shardCount = cores > 1 ? cores - 1 : 1;
+    }
+
+    network = new ServerNetwork(port, false);
+    network->idle_timeout_ms = GREET_TIMEOUT_MS;
+    reactor = new SocketReactor(*network);
+
+    for (unsigned int i = 0; i < shardCount; i++)
+    {
+        shards.push_back(new MatchShard(i, shardCount, engine));
+        shards.back()->start();
+    }
+}
+
+MatchServer::~MatchServer(void)
+{
+    for (size_t i = 0; i < shards.size(); i++)
+        delete shards[i];
+
+    delete reactor;
+    delete network;
+}
+
+void MatchServer::run()
+{
+    running = true;
+
+    while (running)
+        pump(SHARD_WAIT_MS);
+}
+
+void MatchServer::stop()
+{
+    running = false;
+}
+
+void MatchServer::pump(int timeout_ms)
+{
+    network->waitForEvents(timeout_ms);
+
+    unsigned int session;
+    while (network->acceptNewClient(session))
+        greet(session);
+
+    reactor->dispatch();
+}
+
+Task MatchServer::greet(unsigned int session)
+{
+    AsyncSocket socket(*reactor, session);
+
+    char data[GREETING_MAX_SIZE];
+    int received = 0;
+    int kind = ARRIVAL_PLAYER;
+    uint64_t key = 0;
+
+    // read no more than it takes to tell where the connection goes:
+    // the header and the packet type, then the rest of a token. what
+    // was read goes to the shard with it, and a connection that sent
+    // part of it waits for the rest without the socket polling ready
+    while (received < FRAME_HEADER_SIZE + 1)
+    {
+        int count = co_await socket.read(data + received, FRAME_HEADER_SIZE + 1 - received);
+
+        if (count <= 0)
+            co_return;
+
+        received += count;
+    }
+
+    int length = readFrameHeader(data);
+
+    // an empty frame says nothing; a player's shard sorts it out
+    if (length > 0)
+    {
+        unsigned int type = peekPacketType(data + FRAME_HEADER_SIZE, 1);
+        kind = type == RESUME ? ARRIVAL_RESUME : type == SPECTATE ? ARRIVAL_SPECTATOR : ARRIVAL_PLAYER;
+    }
+
+    if (kind != ARRIVAL_PLAYER)
+    {
+        if (length > TOKEN_PACKET_MAX_SIZE)
+        {
+            printf("malformed first message, disconnecting\n");
+            network->closeClient(session);
+            co_return;
+        }
+
+        while (received < FRAME_HEADER_SIZE + length)
+        {
+            int count = co_await socket.read(data + received, FRAME_HEADER_SIZE + length - received);
+
+            if (count <= 0)
+                co_return;
+
+            received += count;
+        }
+
+        TokenPacket request;
+
+        // match ids start at 0, tokens never do
+        if (!request.deserialize(data + FRAME_HEADER_SIZE, length) ||
+            (kind == ARRIVAL_RESUME && request.token == 0))
+        {
+            printf("malformed first message, disconnecting\n");
+            network->closeClient(session);
+            co_return;
+        }
+
+        key = request.token;
+    }
+
+    LocalChannel * channel;
+    SOCKET handed = socket.release(&channel);
+
+    // tokens and match ids name their shard. pairs of new players go
+    // to the same shard, round robin
+    MatchShard * shard = kind != ARRIVAL_PLAYER ? shards[key % shards.size()]
+                                                : shards[(accepted / MATCH_SEATS) % shards.size()];
+
+    if (!shard->hand(handed, kind, key, channel, data, received))
+    {
+        printf("shard %d is backed up, refusing connection\n", shard->index);
+        if (channel != NULL)
+            delete channel;
+        else
+            closesocket(handed);
+        co_return;
+    }
+
+    if (kind == ARRIVAL_PLAYER)
+        accepted++;
+}
+
+uint32_t MatchServer::activeMatches() const
+{
+    uint32_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+        total += shards[i]->matches;
+    return total;
+}
+
+uint32_t MatchServer::activePlayers() const
+{
+    uint32_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+        total += shards[i]->players;
+    return total;
+}
+
+uint64_t MatchServer::messagesRelayed() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+        total += shards[i]->messagesRelayed;
+    return total;
+}
+
+uint32_t MatchServer::activeSpectators() const
+{
+    uint32_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+        total += shards[i]->spectators;
+    return total;
+}
+
+uint64_t MatchServer::spectatorSends() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+        total += shards[i]->spectatorSends;
+    return total;
+}
+
+uint64_t MatchServer::messagesReceived() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+        total += shards[i]->messagesReceived;
+    return total;
+}
+
+uint64_t MatchServer::syscalls() const
+{
+    uint64_t total = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+        total += shards[i]->syscalls;
+    return total;
+}
@@ -0,0 +1,317 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <map>
+#include <random>
+#include "ServerNetwork.h"
+#include "AsyncSocket.h"
+#include "NetworkData.h"
+#include "SpscQueue.h"
+#include "MatchState.h"
+#include "ClockSync.h"
+
+// accepted sockets waiting for a shard to pick them up
+#define SHARD_INCOMING_QUEUE 4096
+
+// how long a shard sleeps in waitForEvents, which is also the most a
+// handed over socket waits before its shard notices it
+#define SHARD_WAIT_MS 5
+
+// how long a seat is held for a player who lost the connection
+#define RECONNECT_GRACE_MS 30000
+
+// how long a seat has to fire before its turn passes to the other
+#define TURN_TIMEOUT_MS 30000
+
+// how long the acceptor waits for a connection's first message
+#define GREET_TIMEOUT_MS 5000
+
+// the most of a first message the acceptor reads: a token's frame
+#define GREETING_MAX_SIZE (FRAME_HEADER_SIZE + TOKEN_PACKET_MAX_SIZE)
+
+// a shard's timers, on its network's wheel
+enum ShardTimers {
+
+    TIMER_GRACE = TIMER_OWNER,      // a held seat's grace ran out. key is match id * MATCH_SEATS + seat
+
+    TIMER_TURN = TIMER_OWNER + 1,   // the seat to fire took too long. key is match id
+
+};
+
+// One game. What the players send is applied to the match state, with
+// shots resolved against the fleets they sent, and the shard sends
+// each seat snapshots of it as deltas against the last one that seat
+// acked. Spectators all get the same stream, each snapshot a delta
+// against the one before.
+struct Match
+{
+    unsigned int id;
+    unsigned int seats[MATCH_SEATS];
+    int filled = 0;
+
+    MatchState state;
+    SnapshotHistory history;
+
+    // newest snapshot seq each seat has acked, 0 = none yet
+    uint32_t acked[MATCH_SEATS] = { 0, 0 };
+
+    // newest snapshot seq sent to each seat
+    uint32_t sent[MATCH_SEATS] = { 0, 0 };
+
+    // state changed since the last snapshot went out
+    bool dirty = false;
+
+    // what each seat resumes with, handed out when the match fills
+    uint64_t tokens[MATCH_SEATS] = { 0, 0 };
+
+    // the timer ending each held seat's grace, 0 while it is filled
+    uint64_t graceTimer[MATCH_SEATS] = { 0, 0 };
+
+    // the timer passing the turn on, 0 until both fleets are placed,
+    // and when the turn it is for started
+    uint64_t turnTimer = 0;
+    uint64_t turnStarted = 0;
+
+    // each seat's ships once it sent them, for resolving shots at it.
+    // never sent to anyone
+    Board fleets[MATCH_SEATS];
+    bool fleetKnown[MATCH_SEATS] = { false, false };
+
+    // sessions watching, sent one shared copy of each snapshot
+    std::vector<unsigned int> spectators;
+
+    // the last state spectators were sent, the base of the next delta
+    MatchState watched;
+
+    // RESYNC of watched for spectators joining, made on the first
+    // join after a change
+    SharedBuffer * resync = NULL;
+
+    ~Match() { if (resync != NULL) resync->release(); }
+
+    int seatOf(unsigned int session) const { return seats[0] == session ? 0 : 1; }
+};
+
+// what a connection asked for in its first message
+enum ArrivalKinds {
+
+    ARRIVAL_PLAYER = 0,     // a new player
+
+    ARRIVAL_RESUME = 1,     // key is the token of the seat to resume
+
+    ARRIVAL_SPECTATOR = 2,  // key is the id of the match to watch
+
+};
+
+// A connection on its way to a shard
+struct Arrival
+{
+    SOCKET socket;
+
+    // a client on this host, for which socket is only the doorbell.
+    // NULL for tcp
+    LocalChannel * channel;
+
+    int kind;
+    uint64_t key;
+
+    // what the acceptor read of the connection, the first message or
+    // its start, for the shard to read first
+    char greeting[GREETING_MAX_SIZE];
+    int greetingLength;
+};
+
+// A worker thread with its own ServerNetwork that runs a share of the
+// matches. Sessions never move between shards, so a shard touches its
+// matches, buffers and sockets without locking.
+//
+// Each session is served by a coroutine (serve) that reads its frames
+// in a loop and applies them, suspended in between; the shard's pump
+// waits for socket events and resumes the ones that can go on.
+//
+// A player whose connection drops keeps its seat for
+// RECONNECT_GRACE_MS. Its opponent plays on against the state, and a
+// new connection that opens with the seat's token gets a compressed
+// RESYNC of the whole match and carries on from there.
+//
+// A connection can also die without a word. A session the shard hasn't
+// heard from for HEARTBEAT_INTERVAL_MS is sent a PING, which clients
+// answer, and one silent for IDLE_TIMEOUT_MS is closed and leaves like
+// any other. These, the held seats' grace and the turn clock are
+// timers on the network's wheel: a pump touches only the ones that
+// came due. A seat that doesn't fire within TURN_TIMEOUT_MS of its
+// turn starting loses it to the other, so a player who walked away,
+// held or not, doesn't stall the match.
+//
+// Spectators are read only. Each change a match publishes is encoded
+// once for all of them into a SharedBuffer, and every spectator's
+// session queues a reference to it, so the cost per spectator is a
+// queue slot and its share of a gather send rather than an encode and
+// a copy. A spectator that falls SHARED_QUEUE_LENGTH snapshots behind
+// is dropped; it can join again and start from a fresh RESYNC.
+class MatchShard
+{
+public:
+    // engine: NetworkEngines for the shard's sessions
+    MatchShard(unsigned int index, unsigned int shardCount, int engine = ENGINE_POLL);
+    ~MatchShard(void);
+
+    void start();
+    void stop();
+
+    // acceptor thread: give this shard a new player, one resuming
+    // with a token this shard issued, or a spectator for one of its
+    // matches (ArrivalKinds). false if the shard is backed up, and the
+    // caller still owns the socket. channel for a local connection,
+    // greeting what was read off it already
+    bool hand(SOCKET socket, int kind = ARRIVAL_PLAYER, uint64_t key = 0, LocalChannel * channel = NULL,
+        const char * greeting = NULL, int greetingLength = 0);
+
+    // worker thread: adopt handed sockets, wait up to timeout_ms,
+    // apply what players sent, send snapshots of what changed
+    void pump(int timeout_ms);
+
+    const unsigned int index;
+
+    // safe to read from any thread
+    std::atomic<uint32_t> matches;
+    std::atomic<uint32_t> players;
+    std::atomic<uint32_t> spectators;
+    // snapshots sent to players, and shared ones queued for spectators
+    std::atomic<uint64_t> messagesRelayed;
+    std::atomic<uint64_t> spectatorSends;
+    // frames read from sessions, and the socket syscalls it all took
+    std::atomic<uint64_t> messagesReceived;
+    std::atomic<uint64_t> syscalls;
+
+private:
+    MatchShard(const MatchShard &);
+    MatchShard & operator=(const MatchShard &);
+
+    // seat a new session, opening a match if none is waiting
+    void seat(unsigned int session);
+
+    // put a session back in the seat its token names
+    void resume(unsigned int session, uint64_t token);
+
+    // start sending a session the match with this id
+    void spectate(unsigned int session, uint64_t matchId);
+
+    // a session from its arrival until its connection ends
+    Task serve(unsigned int session, Arrival arrival);
+
+    void apply(unsigned int from, const char * payload, int length);
+
+    // hold a seat's FLEET and settle shots already fired at it
+    void takeFleet(Match * match, int seat, const char * payload, int length);
+
+    // send a snapshot to both seats and the spectators of every match
+    // that changed
+    void publish();
+
+    // encode once what changed since spectators were last sent, and
+    // queue it for all of them
+    void publishToSpectators(Match * match);
+
+    // frame the PONG for a PING into reply, returning its size or 0
+    // for a malformed probe
+    int answerPing(const char * payload, int length, char * reply);
+
+    // a session is gone: its seat is held for a while
+    void leave(unsigned int session);
+
+    // close the match and let any remaining player go
+    void endMatch(Match * match);
+
+    // give the seat whose turn it is TURN_TIMEOUT_MS to fire
+    void startTurn(Match * match);
+
+    // ping the sessions that went quiet, end the matches whose held
+    // seat's grace ran out, pass on the turns that did
+    void checkTimers();
+
+    // token for a new seat; shard = token % shard count
+    uint64_t newToken();
+
+    ServerNetwork * network;
+    SocketReactor * reactor;
+
+    std::map<unsigned int, Match *> matchOf;
+    Match * waiting;
+
+    // matches changed in this pump, each listed once
+    std::vector<Match *> dirtyMatches;
+
+    std::map<uint64_t, Match *> matchOfToken;
+
+    // full matches by id, for spectators to find
+    std::map<unsigned int, Match *> matchById;
+
+    // spectator sessions and the match each watches
+    std::map<unsigned int, Match *> watching;
+
+    std::mt19937_64 random;
+    unsigned int shardCount;
+
+    unsigned int nextMatch;
+
+    SpscQueue<Arrival, SHARD_INCOMING_QUEUE> incoming;
+
+    std::thread thread;
+    std::atomic<bool> running;
+};
+
+// Dedicated server for many concurrent matches. The calling thread
+// accepts connections and holds each until its first message shows
+// whether it is a new player, one resuming a seat or a spectator
+// (greet). New players are dealt out to the shards two at a time, so
+// consecutive players usually meet in the same match; a resuming
+// player goes back to the shard its token came from. Each shard pairs its own players and
+// keeps the state of its matches. Match ids and tokens both name their
+// shard modulo the shard count, which is how the acceptor finds where
+// a resuming player or a spectator goes. A connection that says nothing
+// for GREET_TIMEOUT_MS is closed.
+//
+// Bots, spectators and players on the same host can connect through
+// shared memory instead (LocalChannel). The acceptor greets and hands
+// them on the same way, and a shard serves them like the rest.
+class MatchServer
+{
+public:
+    // shardCount 0 = one per core, less the acceptor's. engine is the
+    // shards' NetworkEngines; the acceptor always polls
+    MatchServer(unsigned int shardCount = 0, const char * port = DEFAULT_PORT, int engine = ENGINE_POLL);
+    ~MatchServer(void);
+
+    // accept until stop() is called from another thread
+    void run();
+    void stop();
+
+    // accept whatever is waiting, sleeping up to timeout_ms
+    void pump(int timeout_ms);
+
+    uint32_t activeMatches() const;
+    uint32_t activePlayers() const;
+    uint64_t messagesRelayed() const;
+    uint32_t activeSpectators() const;
+    uint64_t spectatorSends() const;
+    uint64_t messagesReceived() const;
+
+    // the shards' socket syscalls, waits included
+    uint64_t syscalls() const;
+
+    std::vector<MatchShard *> shards;
+
+private:
+    // wait for a connection's first message, then hand it to its shard
+    Task greet(unsigned int session);
+
+    ServerNetwork * network;
+    SocketReactor * reactor;
+
+    // new players handed out so far, used to pick the next shard
+    unsigned int accepted;
+
+    std::atomic<bool> running;
+};
@@ -0,0 +1,298 @@
+#include "MatchState.h"
+#include <string.h>
+#include "NetworkData.h"
+
+MatchState::MatchState(void)
+{
+    for (int seat = 0; seat < MATCH_SEATS; seat++)
+    {
+        position[seat] = glm::vec3(0.0f);
+        orientation[seat] = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        poseTime[seat] = 0;
+        done[seat] = false;
+    }
+
+    memset(shots, CELL_EMPTY, sizeof(shots));
+}
+
+int MatchState::shoot(int seat, int row, int column)
+{
+    // no firing before both fleets are placed, or out of turn
+    if (!done[0] || !done[1] || seat != turn)
+        return SHOT_INVALID;
+
+    if (!Board::inside(row, column))
+        return SHOT_INVALID;
+
+    int8_t & cell = shots[seat][row * BOARD_SIZE + column];
+
+    if (cell != CELL_EMPTY)
+        return SHOT_INVALID;
+
+    cell = CELL_MISSED;
+    turn = 1 - seat;
+
+    return SHOT_MISS;
+}
+
+bool MatchState::reportHit(int seat, int row, int column)
+{
+    if (!Board::inside(row, column))
+        return false;
+
+    int8_t & cell = shots[1 - seat][row * BOARD_SIZE + column];
+
+    if (cell != CELL_MISSED)
+        return false;
+
+    cell = CELL_SHOOTED;
+    return true;
+}
+
+static uint8_t flagBits(const MatchState & state)
+{
+    return (state.done[0] ? 1 : 0) | (state.done[1] ? 2 : 0) | (state.turn << 2);
+}
+
+// who a snapshot or resync is for, in the bits above the fields
+static uint8_t seatBits(int seat)
+{
+    return seat == SPECTATOR_SEAT ? SNAPSHOT_SPECTATOR : seat == 1 ? SNAPSHOT_SEAT_1 : 0;
+}
+
+static int seatOfBits(uint8_t bits)
+{
+    return (bits & SNAPSHOT_SPECTATOR) ? SPECTATOR_SEAT : (bits & SNAPSHOT_SEAT_1) ? 1 : 0;
+}
+
+int MatchState::writeSnapshot(const MatchState * base, int seat, char * data, int size) const
+{
+    // decide what goes in before writing anything
+    uint8_t fields = 0;
+
+    // a player gets the other's pose, a spectator both
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        if (s == seat)
+            continue;
+
+        if (base == NULL || position[s] != base->position[s] ||
+            orientation[s] != base->orientation[s] || poseTime[s] != base->poseTime[s])
+            fields |= s == 0 ? SNAPSHOT_POSE_0 : SNAPSHOT_POSE_1;
+    }
+
+    if (base == NULL || flagBits(*this) != flagBits(*base))
+        fields |= SNAPSHOT_FLAGS;
+
+    int changed[MATCH_SEATS] = { 0, 0 };
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+        {
+            if (base == NULL ? shots[s][i] != CELL_EMPTY : shots[s][i] != base->shots[s][i])
+                changed[s]++;
+        }
+
+        if (changed[s] > 0)
+            fields |= s == 0 ? SNAPSHOT_SHOTS_0 : SNAPSHOT_SHOTS_1;
+    }
+
+    if (base != NULL && fields == 0)
+        return 0;
+
+    WireWriter out(data, size);
+
+    // the base goes as its distance back from seq, 0 for none
+    out.writeVarint(SNAPSHOT);
+    out.writeVarint(seq);
+    out.writeVarint(base != NULL ? seq - base->seq : 0);
+    out.writeByte(fields | seatBits(seat));
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        if (!(fields & (s == 0 ? SNAPSHOT_POSE_0 : SNAPSHOT_POSE_1)))
+            continue;
+
+        out.writePosition(position[s], base != NULL ? base->position[s] : glm::vec3(0.0f));
+        out.writeOrientation(orientation[s]);
+        out.writeVarint64(poseTime[s]);
+    }
+
+    if (fields & SNAPSHOT_FLAGS)
+        out.writeByte(flagBits(*this));
+
+    // cell index and new value for each cell that changed
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        if (changed[s] == 0)
+            continue;
+
+        out.writeVarint(changed[s]);
+
+        for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+        {
+            if (base == NULL ? shots[s][i] != CELL_EMPTY : shots[s][i] != base->shots[s][i])
+            {
+                out.writeByte((uint8_t)i);
+                out.writeSignedVarint(shots[s][i]);
+            }
+        }
+    }
+
+    return out.ok() ? out.size() : -1;
+}
+
+bool MatchState::readSnapshot(const char * data, int length, const SnapshotHistory & history, int & seat)
+{
+    WireReader in(data, length);
+
+    if (in.readVarint() != SNAPSHOT)
+        return false;
+
+    uint32_t newSeq = in.readVarint();
+    uint32_t back = in.readVarint();
+
+    MatchState next;
+
+    if (back != 0)
+    {
+        const MatchState * base = history.find(newSeq - back);
+
+        if (base == NULL)
+            return false;
+
+        next = *base;
+    }
+
+    next.seq = newSeq;
+
+    uint8_t fields = in.readByte();
+    seat = seatOfBits(fields);
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        if (!(fields & (s == 0 ? SNAPSHOT_POSE_0 : SNAPSHOT_POSE_1)))
+            continue;
+
+        next.position[s] = in.readPosition(next.position[s]);
+        next.orientation[s] = in.readOrientation();
+        next.poseTime[s] = in.readVarint64();
+    }
+
+    if (fields & SNAPSHOT_FLAGS)
+    {
+        uint8_t bits = in.readByte();
+        next.done[0] = (bits & 1) != 0;
+        next.done[1] = (bits & 2) != 0;
+        next.turn = (bits >> 2) & 1;
+    }
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        if (!(fields & (s == 0 ? SNAPSHOT_SHOTS_0 : SNAPSHOT_SHOTS_1)))
+            continue;
+
+        uint32_t count = in.readVarint();
+
+        for (uint32_t k = 0; k < count && in.ok(); k++)
+        {
+            uint8_t cell = in.readByte();
+            int32_t value = in.readSignedVarint();
+
+            if (cell >= BOARD_SIZE * BOARD_SIZE)
+                return false;
+
+            next.shots[s][cell] = (int8_t)value;
+        }
+    }
+
+    if (!in.ok())
+        return false;
+
+    *this = next;
+    return true;
+}
+
+int MatchState::writeResync(int seat, char * data, int size) const
+{
+    // flat image: raw cells repeat a lot, which is what the
+    // compressor feeds on
+    char image[RESYNC_IMAGE_SIZE];
+    WireWriter flat(image, sizeof(image));
+
+    flat.writeVarint(seq);
+    flat.writeByte(flagBits(*this) | seatBits(seat));
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        flat.writePosition(position[s]);
+        flat.writeOrientation(orientation[s]);
+        flat.writeVarint64(poseTime[s]);
+    }
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+        for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+            flat.writeByte((uint8_t)shots[s][i]);
+
+    if (!flat.ok())
+        return -1;
+
+    WireWriter out(data, size);
+    out.writeVarint(RESYNC);
+    out.writeVarint(flat.size());
+
+    if (!out.ok())
+        return -1;
+
+    int compressed = lzCompress(image, flat.size(), data + out.size(), size - out.size());
+
+    return compressed < 0 ? -1 : out.size() + compressed;
+}
+
+bool MatchState::readResync(const char * data, int length, int & seat)
+{
+    WireReader in(data, length);
+
+    if (in.readVarint() != RESYNC)
+        return false;
+
+    uint32_t imageSize = in.readVarint();
+
+    if (!in.ok() || imageSize > RESYNC_IMAGE_SIZE)
+        return false;
+
+    char image[RESYNC_IMAGE_SIZE];
+    int header = length - in.remaining();
+
+    if (!lzDecompress(data + header, in.remaining(), image, imageSize))
+        return false;
+
+    WireReader flat(image, imageSize);
+    MatchState next;
+
+    next.seq = flat.readVarint();
+
+    uint8_t bits = flat.readByte();
+    next.done[0] = (bits & 1) != 0;
+    next.done[1] = (bits & 2) != 0;
+    next.turn = (bits >> 2) & 1;
+    seat = seatOfBits(bits);
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+    {
+        next.position[s] = flat.readPosition();
+        next.orientation[s] = flat.readOrientation();
+        next.poseTime[s] = flat.readVarint64();
+    }
+
+    for (int s = 0; s < MATCH_SEATS; s++)
+        for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+            next.shots[s][i] = (int8_t)flat.readByte();
+
+    if (!flat.ok())
+        return false;
+
+    *this = next;
+    return true;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "Board.h"
+#include "Compression.h"
+
+// players in one battleship game
+#define MATCH_SEATS 2
+
+// snapshots kept on each side for deltas to be taken against. a
+// player whose last ack is older than this gets a full snapshot
+#define SNAPSHOT_HISTORY 32
+
+// worst case encoded size of a snapshot: both poses and every cell
+#define SNAPSHOT_MAX_SIZE 512
+
+// snapshot fields on the wire, set when they changed since the base
+#define SNAPSHOT_POSE_0 0x01
+#define SNAPSHOT_POSE_1 0x02
+#define SNAPSHOT_FLAGS 0x04
+#define SNAPSHOT_SHOTS_0 0x08
+#define SNAPSHOT_SHOTS_1 0x10
+
+// set when the snapshot is for the player in seat 1
+#define SNAPSHOT_SEAT_1 0x20
+
+// set when the snapshot is for spectators, who get both poses
+#define SNAPSHOT_SPECTATOR 0x40
+
+// seat argument for a snapshot or resync meant for spectators
+#define SPECTATOR_SEAT -1
+
+// the whole state laid out flat for a resync, before compression
+#define RESYNC_IMAGE_SIZE 320
+
+// worst case encoded size of a RESYNC
+#define RESYNC_MAX_SIZE (8 + LZ_BOUND(RESYNC_IMAGE_SIZE))
+
+class SnapshotHistory;
+
+// Everything about one match that the players see, as the server
+// holds it. The server bumps seq whenever something changes and sends
+// each player only what differs from the newest snapshot that player
+// has acked, so a pose update costs a pose and a shot costs one cell
+// instead of the whole struct. A player never gets its own pose back;
+// spectators get both.
+struct MatchState
+{
+    uint32_t seq = 0;
+
+    glm::vec3 position[MATCH_SEATS];
+    glm::quat orientation[MATCH_SEATS];
+
+    // when each pose was sampled, on the server's clock. 0 = unknown
+    uint64_t poseTime[MATCH_SEATS];
+
+    bool done[MATCH_SEATS];
+
+    // seat expected to fire next
+    int turn = 0;
+
+    // cells each seat has fired at on the other's board, row major:
+    // CELL_EMPTY, then CELL_MISSED or CELL_SHOOTED. CELL_SHOOTED comes
+    // straight away when the server holds the owner's fleet, otherwise
+    // once the owner reports the hit
+    int8_t shots[MATCH_SEATS][BOARD_SIZE * BOARD_SIZE];
+
+    MatchState(void);
+
+    // fire from seat, passing the turn; SHOT_INVALID if it isn't the
+    // seat's turn, either player isn't done placing, or the cell is off
+    // the board or fired at before
+    int shoot(int seat, int row, int column);
+
+    // seat says the opponent's shot at this cell of its board hit.
+    // false unless the opponent had fired there
+    bool reportHit(int seat, int row, int column);
+
+    // encode a SNAPSHOT for the player in seat (or SPECTATOR_SEAT) with
+    // only what changed since base, or everything when base is NULL.
+    // returns the size, 0 if there is nothing new for this player, -1
+    // if it didn't fit
+    int writeSnapshot(const MatchState * base, int seat, char * data, int size = SNAPSHOT_MAX_SIZE) const;
+
+    // decode a SNAPSHOT into this state, starting from the base it was
+    // taken against. false if malformed or the base is not in history
+    bool readSnapshot(const char * data, int length, const SnapshotHistory & history, int & seat);
+
+    // encode a compressed RESYNC of everything, for the player in seat
+    // coming back on a new connection. returns the size, -1 if it
+    // didn't fit
+    int writeResync(int seat, char * data, int size = RESYNC_MAX_SIZE) const;
+
+    // replace this state with a RESYNC. false if malformed
+    bool readResync(const char * data, int length, int & seat);
+};
+
+// the last SNAPSHOT_HISTORY states by seq
+class SnapshotHistory
+{
+public:
+    void store(const MatchState & state) { states[state.seq % SNAPSHOT_HISTORY] = state; }
+
+    // NULL once seq has been overwritten, and for 0 (no snapshot)
+    const MatchState * find(uint32_t seq) const
+    {
+        const MatchState & state = states[seq % SNAPSHOT_HISTORY];
+        return seq != 0 && state.seq == seq ? &state : NULL;
+    }
+
+private:
+    MatchState states[SNAPSHOT_HISTORY];
+};
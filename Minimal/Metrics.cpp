@@ -0,0 +1,206 @@
+#include "Metrics.h"
+#include <stdio.h>
+#include <stdarg.h>
+#include <mutex>
+#include <vector>
+#include "NetworkData.h"
+
+thread_local MetricsBlock * Metrics::local = NULL;
+
+// every thread's block, ever
+static std::mutex registryLock;
+static std::vector<MetricsBlock *> registry;
+
+// how each metric is exposed, in the order of its enum
+struct MetricInfo
+{
+    const char * name;
+    const char * help;
+};
+
+static const MetricInfo counterInfo[METRIC_COUNTERS] = {
+    { "vr_connections_accepted_total", "Connections accepted, tcp and local." },
+    { "vr_connections_closed_total", "Sessions closed, by either side." },
+    { "vr_idle_timeouts_total", "Sessions closed for saying nothing for too long." },
+    { "vr_slow_clients_total", "Sessions closed because their send queue was full." },
+    { "vr_received_bytes_total", "Bytes taken from sockets, local rings and datagrams." },
+    { "vr_sent_bytes_total", "Bytes taken by sockets, local rings and datagrams." },
+};
+
+static const MetricInfo gaugeInfo[METRIC_GAUGES] = {
+    { "vr_sessions", "Sessions open." },
+    { "vr_send_queue_bytes", "Memory held by the sessions' send queues." },
+    { "vr_handoff_queue", "Accepted connections waiting for a shard to adopt them." },
+    { "vr_timers", "Timers scheduled on the networks' wheels." },
+};
+
+static const MetricInfo histogramInfo[METRIC_HISTOGRAMS] = {
+    { "vr_tick_duration_seconds", "Work done by a pump after its wait." },
+    { "vr_rtt_seconds", "Round trips of clock probes." },
+};
+
+static const char * packetName(unsigned int type)
+{
+    switch (type) {
+        case INIT_CONNECTION: return "init_connection";
+        case ACTION_EVENT: return "action_event";
+        case PING: return "ping";
+        case PONG: return "pong";
+        case SNAPSHOT: return "snapshot";
+        case SESSION_TOKEN: return "session_token";
+        case RESUME: return "resume";
+        case RESYNC: return "resync";
+        case SPECTATE: return "spectate";
+        case FLEET: return "fleet";
+        default: return NULL;
+    }
+}
+
+MetricsBlock * Metrics::enroll()
+{
+    MetricsBlock * block = new MetricsBlock();
+
+    std::lock_guard<std::mutex> hold(registryLock);
+    registry.push_back(block);
+
+    return block;
+}
+
+void Metrics::packetIn(unsigned int type)
+{
+    if (type >= METRIC_PACKET_TYPES)
+        type = METRIC_PACKET_TYPES - 1;
+
+    std::atomic<uint64_t> & value = block()->packetsIn[type];
+    value.store(value.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void Metrics::packetOut(unsigned int type, uint64_t copies)
+{
+    if (type >= METRIC_PACKET_TYPES)
+        type = METRIC_PACKET_TYPES - 1;
+
+    std::atomic<uint64_t> & value = block()->packetsOut[type];
+    value.store(value.load(std::memory_order_relaxed) + copies, std::memory_order_relaxed);
+}
+
+void Metrics::record(int histogram, uint64_t value)
+{
+    // the first power of two at or above the value
+    int bucket = 0;
+    while (bucket < METRIC_BUCKETS - 1 && value > (1ull << bucket))
+        bucket++;
+
+    std::atomic<uint64_t> & count = block()->histograms[histogram].buckets[bucket];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    std::atomic<uint64_t> & sum = block()->histograms[histogram].sum;
+    sum.store(sum.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static void append(std::string & out, const char * format, ...)
+{
+    char line[256];
+
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (length > 0)
+        out.append(line, length < (int)sizeof(line) ? length : (int)sizeof(line) - 1);
+}
+
+static void appendPackets(std::string & out, const char * name, const char * help, const uint64_t * counts)
+{
+    append(out, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+
+    for (unsigned int type = 0; type < METRIC_PACKET_TYPES; type++)
+    {
+        if (counts[type] == 0)
+            continue;
+
+        const char * label = packetName(type);
+
+        if (label != NULL)
+            append(out, "%s{type=\"%s\"} %llu\n", name, label, (unsigned long long)counts[type]);
+        else
+            append(out, "%s{type=\"%u\"} %llu\n", name, type, (unsigned long long)counts[type]);
+    }
+}
+
+std::string Metrics::scrape()
+{
+    uint64_t counters[METRIC_COUNTERS] = {};
+    int64_t gauges[METRIC_GAUGES] = {};
+    uint64_t packetsIn[METRIC_PACKET_TYPES] = {};
+    uint64_t packetsOut[METRIC_PACKET_TYPES] = {};
+    uint64_t buckets[METRIC_HISTOGRAMS][METRIC_BUCKETS] = {};
+    uint64_t sums[METRIC_HISTOGRAMS] = {};
+
+    {
+        std::lock_guard<std::mutex> hold(registryLock);
+
+        for (size_t b = 0; b < registry.size(); b++)
+        {
+            const MetricsBlock & block = *registry[b];
+
+            for (int i = 0; i < METRIC_COUNTERS; i++)
+                counters[i] += block.counters[i].load(std::memory_order_relaxed);
+            for (int i = 0; i < METRIC_GAUGES; i++)
+                gauges[i] += block.gauges[i].load(std::memory_order_relaxed);
+
+            for (int i = 0; i < METRIC_PACKET_TYPES; i++)
+            {
+                packetsIn[i] += block.packetsIn[i].load(std::memory_order_relaxed);
+                packetsOut[i] += block.packetsOut[i].load(std::memory_order_relaxed);
+            }
+
+            for (int h = 0; h < METRIC_HISTOGRAMS; h++)
+            {
+                for (int i = 0; i < METRIC_BUCKETS; i++)
+                    buckets[h][i] += block.histograms[h].buckets[i].load(std::memory_order_relaxed);
+                sums[h] += block.histograms[h].sum.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::string out;
+
+    for (int i = 0; i < METRIC_COUNTERS; i++)
+    {
+        append(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", counterInfo[i].name, counterInfo[i].help,
+            counterInfo[i].name, counterInfo[i].name, (unsigned long long)counters[i]);
+    }
+
+    for (int i = 0; i < METRIC_GAUGES; i++)
+    {
+        append(out, "# HELP %s %s\n# TYPE %s gauge\n%s %lld\n", gaugeInfo[i].name, gaugeInfo[i].help,
+            gaugeInfo[i].name, gaugeInfo[i].name, (long long)gauges[i]);
+    }
+
+    appendPackets(out, "vr_packets_received_total", "Frames read, by packet type.", packetsIn);
+    appendPackets(out, "vr_packets_sent_total", "Frames queued to send, by packet type.", packetsOut);
+
+    // recorded in microseconds, exposed in seconds with cumulative
+    // buckets as Prometheus wants them
+    for (int h = 0; h < METRIC_HISTOGRAMS; h++)
+    {
+        const char * name = histogramInfo[h].name;
+        uint64_t cumulative = 0;
+
+        append(out, "# HELP %s %s\n# TYPE %s histogram\n", name, histogramInfo[h].help, name);
+
+        for (int i = 0; i < METRIC_BUCKETS - 1; i++)
+        {
+            cumulative += buckets[h][i];
+            append(out, "%s_bucket{le=\"%g\"} %llu\n", name, (double)(1ull << i) / 1e6, (unsigned long long)cumulative);
+        }
+
+        cumulative += buckets[h][METRIC_BUCKETS - 1];
+        append(out, "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long)cumulative);
+        append(out, "%s_sum %.6f\n%s_count %llu\n", name, sums[h] / 1e6, name, (unsigned long long)cumulative);
+    }
+
+    return out;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// packet types counted one by one, see PacketTypes. higher ones are
+// counted with the last
+#define METRIC_PACKET_TYPES 16
+
+// histogram buckets: bucket i holds samples up to 2^i, the last one
+// everything above
+#define METRIC_BUCKETS 33
+
+// counters, only ever growing
+enum MetricCounters {
+
+    METRIC_CONNECTIONS_ACCEPTED = 0,    // tcp and local connections accepted
+
+    METRIC_CONNECTIONS_CLOSED = 1,      // sessions closed, by either side
+
+    METRIC_IDLE_TIMEOUTS = 2,           // of those, closed for saying nothing
+
+    METRIC_SLOW_CLIENTS = 3,            // of those, closed for a full send queue
+
+    METRIC_BYTES_IN = 4,                // taken from sockets, rings and datagrams
+
+    METRIC_BYTES_OUT = 5,               // taken by sockets, rings and datagrams
+
+    METRIC_COUNTERS = 6,
+
+};
+
+// values that go up and down. each thread keeps its share, by adding
+// or setting it, and a scrape sums the shares
+enum MetricGauges {
+
+    METRIC_SESSIONS = 0,                // sessions open
+
+    METRIC_SEND_QUEUE_BYTES = 1,        // memory the send queues hold
+
+    METRIC_HANDOFF_QUEUE = 2,           // accepted connections waiting for a shard
+
+    METRIC_TIMERS = 3,                  // timers on the networks' wheels
+
+    METRIC_GAUGES = 4,
+
+};
+
+// distributions, in microseconds
+enum MetricHistograms {
+
+    METRIC_TICK_US = 0,                 // a pump's work, from the end of its wait
+
+    METRIC_RTT_US = 1,                  // round trips of clock probes
+
+    METRIC_HISTOGRAMS = 2,
+
+};
+
+// One thread's metrics. Only that thread writes them, so an update is
+// a relaxed load and store of its own cache lines, no locked
+// instruction; a scrape reads them from another thread as they are.
+struct alignas(64) MetricsBlock
+{
+    std::atomic<uint64_t> counters[METRIC_COUNTERS];
+    std::atomic<int64_t> gauges[METRIC_GAUGES];
+
+    // frames by PacketTypes, as owners read them and as networks
+    // queue them
+    std::atomic<uint64_t> packetsIn[METRIC_PACKET_TYPES];
+    std::atomic<uint64_t> packetsOut[METRIC_PACKET_TYPES];
+
+    struct
+    {
+        std::atomic<uint64_t> buckets[METRIC_BUCKETS];
+        std::atomic<uint64_t> sum;
+    } histograms[METRIC_HISTOGRAMS];
+};
+
+// Counters and histograms cheap enough for the hot path, merged only
+// when scraped.
+//
+// Each thread gets its own MetricsBlock on its first update, which
+// stays registered after the thread ends so counters never go back.
+// Threads register under a lock, once; after that nothing they do is
+// shared with anyone but a scrape.
+class Metrics
+{
+public:
+    static void count(int counter, uint64_t amount = 1)
+    {
+        std::atomic<uint64_t> & value = block()->counters[counter];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static void add(int gauge, int64_t amount)
+    {
+        std::atomic<int64_t> & value = block()->gauges[gauge];
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    static void set(int gauge, int64_t value)
+    {
+        block()->gauges[gauge].store(value, std::memory_order_relaxed);
+    }
+
+    // a frame of this type read by an owner, or copies of one queued
+    static void packetIn(unsigned int type);
+    static void packetOut(unsigned int type, uint64_t copies = 1);
+
+    static void record(int histogram, uint64_t value);
+
+    // every thread's metrics summed, in Prometheus text format
+    static std::string scrape();
+
+private:
+    static MetricsBlock * block()
+    {
+        if (local == NULL)
+            local = enroll();
+        return local;
+    }
+
+    // make and register the calling thread's block
+    static MetricsBlock * enroll();
+
+    static thread_local MetricsBlock * local;
+};
@@ -0,0 +1,174 @@
+#include "MetricsServer.h"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "Metrics.h"
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <poll.h>
+#endif
+
+MetricsServer::MetricsServer(const char * port, const char * address)
+    : listener(INVALID_SOCKET), running(false)
+{
+    struct addrinfo hints;
+    struct addrinfo * result = NULL;
+
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(address, port, &hints, &result) != 0)
+    {
+        printf("metrics address %s:%s not understood\n", address, port);
+        return;
+    }
+
+    listener = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+    if (listener != INVALID_SOCKET)
+    {
+#ifndef _WIN32
+        int reuse = 1;
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+
+        if (bind(listener, result->ai_addr, (int)result->ai_addrlen) == SOCKET_ERROR ||
+            listen(listener, SOMAXCONN) == SOCKET_ERROR)
+        {
+            closesocket(listener);
+            listener = INVALID_SOCKET;
+        }
+    }
+
+    freeaddrinfo(result);
+
+    if (listener == INVALID_SOCKET)
+    {
+        printf("metrics listen on %s:%s failed with error: %d\n", address, port, NetworkServices::lastError());
+        return;
+    }
+
+    running = true;
+    thread = std::thread([this]() { run(); });
+}
+
+MetricsServer::~MetricsServer(void)
+{
+    if (running)
+    {
+        running = false;
+        thread.join();
+    }
+
+    if (listener != INVALID_SOCKET)
+        closesocket(listener);
+}
+
+void MetricsServer::run()
+{
+    while (running)
+    {
+#ifdef _WIN32
+        WSAPOLLFD pfd;
+        pfd.fd = listener;
+        pfd.events = POLLRDNORM;
+        pfd.revents = 0;
+
+        if (WSAPoll(&pfd, 1, METRICS_POLL_MS) <= 0)
+            continue;
+#else
+        struct pollfd pfd;
+        pfd.fd = listener;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0)
+            continue;
+#endif
+
+        SOCKET client = accept(listener, NULL, NULL);
+
+        if (client == INVALID_SOCKET)
+            continue;
+
+        answer(client);
+        closesocket(client);
+    }
+}
+
+void MetricsServer::answer(SOCKET client)
+{
+    // a scraper that connects and says nothing doesn't hold us up
+#ifdef _WIN32
+    DWORD timeout = METRICS_REQUEST_TIMEOUT_MS;
+#else
+    struct timeval timeout;
+    timeout.tv_sec = METRICS_REQUEST_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (METRICS_REQUEST_TIMEOUT_MS % 1000) * 1000;
+#endif
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, (const char *)&timeout, sizeof(timeout));
+
+    char request[METRICS_REQUEST_MAX + 1];
+    int length = 0;
+
+    // the request line is all we look at, but the headers are read too
+    // so closing doesn't reset the connection under the reply
+    while (length < METRICS_REQUEST_MAX)
+    {
+        int received = NetworkServices::receiveMessage(client, request + length, METRICS_REQUEST_MAX - length);
+
+        if (received <= 0)
+            return;
+
+        length += received;
+        request[length] = 0;
+
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL)
+            break;
+    }
+
+    request[length] = 0;
+
+    std::string body;
+    const char * status;
+
+    if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET /metrics?", 13) == 0)
+    {
+        status = "200 OK";
+        body = Metrics::scrape();
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "try /metrics\n";
+    }
+
+    char header[256];
+    int headerLength = snprintf(header, sizeof(header),
+        "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+        "Content-Length: %d\r\nConnection: close\r\n\r\n", status, (int)body.size());
+
+    std::string reply(header, headerLength);
+    reply += body;
+
+    int sent = 0;
+
+    while (sent < (int)reply.size())
+    {
+        // not through NetworkServices, which counts what the game sends
+#ifdef _WIN32
+        int result = send(client, &reply[sent], (int)reply.size() - sent, 0);
+#else
+        int result = (int)send(client, &reply[sent], reply.size() - sent, MSG_NOSIGNAL);
+#endif
+
+        if (result <= 0)
+            return;
+
+        sent += result;
+    }
+}
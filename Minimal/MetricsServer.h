@@ -0,0 +1,47 @@
+#pragma once
+#include <thread>
+#include <atomic>
+#include "NetworkServices.h"
+
+// how often the listener looks up from its socket to see if it should
+// stop, and the most a scraper may take to send its request
+#define METRICS_POLL_MS 200
+#define METRICS_REQUEST_TIMEOUT_MS 1000
+
+// most of a request read, headers included
+#define METRICS_REQUEST_MAX 4096
+
+// Serves Metrics::scrape over http, for Prometheus or
+//
+//     curl http://localhost:port/metrics
+//
+// A thread of its own answers one request per connection, one
+// connection at a time: scrapes are rare and small, and nothing else
+// waits on them. GET /metrics gets the metrics, anything else a 404.
+// Winsock must be started already, as a ServerNetwork does.
+class MetricsServer
+{
+public:
+    // listen on address (loopback by default) and port. failing that,
+    // says so and serves nothing
+    MetricsServer(const char * port, const char * address = "127.0.0.1");
+
+    // stops the thread
+    ~MetricsServer(void);
+
+    bool listening() const { return listener != INVALID_SOCKET; }
+
+private:
+    MetricsServer(const MetricsServer &);
+    MetricsServer & operator=(const MetricsServer &);
+
+    void run();
+
+    // read one request off client and answer it
+    void answer(SOCKET client);
+
+    SOCKET listener;
+
+    std::thread thread;
+    std::atomic<bool> running;
+};
@@ -1,8 +1,29 @@
 #pragma once
 #include <string.h>
+#include <utility>
 #include <glm/glm.hpp>
+#include "WireFormat.h"
+#include "Board.h"
 
-#define MAX_PACKET_SIZE 1000000
+// every message on the stream is a little-endian uint16 payload length
+// followed by the payload
+#define FRAME_HEADER_SIZE 2
+#define MAX_FRAME_SIZE 4096
+
+// per-session receive ring: starting size and the most it may grow to
+#define RECV_BUFFER_INITIAL 256
+#define RECV_BUFFER_HIGH_WATER 16384
+
+inline void writeFrameHeader(char * data, int length)
+{
+    data[0] = (char)(length & 0xFF);
+    data[1] = (char)((length >> 8) & 0xFF);
+}
+
+inline int readFrameHeader(const char * data)
+{
+    return (unsigned char)data[0] | ((unsigned char)data[1] << 8);
+}
 
 enum PacketTypes {
 
@@ -10,21 +31,266 @@ enum PacketTypes {
 
     ACTION_EVENT = 1,
 
+    PING = 2,           // clock probe, answered at once with a PONG
+
+    PONG = 3,
+
+    SNAPSHOT = 4,       // match state from a dedicated server, see MatchState
+
+    SESSION_TOKEN = 5,  // server to player: the token to resume this seat with
+
+    RESUME = 6,         // first message on a new connection to take a seat back
+
+    RESYNC = 7,         // compressed full match state for a resumed player
+
+    SPECTATE = 8,       // first message on a new connection to watch a match
+
+    FLEET = 9,          // a player's ships, once, for the server to resolve shots
+
 };
 
+// Packet field flags on the wire
+#define PACKET_HAS_ATTACK 0x01
+#define PACKET_HAS_DAMAGE 0x02
+#define PACKET_DONE 0x04
+#define PACKET_HAS_TIME 0x08
+#define PACKET_HAS_ACK 0x10
+
+// worst case encoded size of a Packet
+#define PACKET_MAX_SIZE 63
+
+// worst case encoded size of a ClockPacket
+#define CLOCK_PACKET_MAX_SIZE 32
+
+// worst case encoded size of a TokenPacket
+#define TOKEN_PACKET_MAX_SIZE 16
+
+// one bit per cell of a fleet, row major
+#define FLEET_BITMAP_SIZE ((BOARD_SIZE * BOARD_SIZE + 7) / 8)
+
+// worst case encoded size of a FleetPacket
+#define FLEET_PACKET_MAX_SIZE (1 + FLEET_BITMAP_SIZE)
+
+// type of an encoded message, to pick the struct that decodes it
+inline unsigned int peekPacketType(const char * data, int length)
+{
+    WireReader in(data, length);
+    return in.readVarint();
+}
+
 struct Packet {
 
-    unsigned int packet_type;
-	std::pair<int, int> attack;
-	std::pair<int, int> damage;
-	bool done;
-	glm::mat4 headPose;
+    unsigned int packet_type = INIT_CONNECTION;
+	std::pair<int, int> attack = std::make_pair(-1, -1);
+	std::pair<int, int> damage = std::make_pair(-1, -1);
+	bool done = false;
+	glm::mat4 headPose = glm::mat4(1.0f);
+
+	// when headPose was sampled, in microseconds on the shared (server)
+	// clock. 0 = unknown
+	uint64_t timestamp = 0;
+
+	// newest SNAPSHOT seq decoded, for a dedicated server to take
+	// deltas against. 0 = none
+	uint32_t ack = 0;
+
+    // type and flags, then only the coordinates that are set (-1 means
+    // none), then the head pose as fixed-point position plus a
+    // smallest-three quaternion. returns the encoded size
+    int serialize(char * data, int size = PACKET_MAX_SIZE) const {
+        WireWriter out(data, size);
 
-    void serialize(char * data) {
-        memcpy(data, this, sizeof(Packet));
+        uint8_t flags = 0;
+        if (attack.first != -1) flags |= PACKET_HAS_ATTACK;
+        if (damage.first != -1) flags |= PACKET_HAS_DAMAGE;
+        if (done) flags |= PACKET_DONE;
+        if (timestamp != 0) flags |= PACKET_HAS_TIME;
+        if (ack != 0) flags |= PACKET_HAS_ACK;
+
+        out.writeVarint(packet_type);
+        out.writeByte(flags);
+
+        if (flags & PACKET_HAS_ATTACK) {
+            out.writeSignedVarint(attack.first);
+            out.writeSignedVarint(attack.second);
+        }
+
+        if (flags & PACKET_HAS_DAMAGE) {
+            out.writeSignedVarint(damage.first);
+            out.writeSignedVarint(damage.second);
+        }
+
+        if (flags & PACKET_HAS_TIME)
+            out.writeVarint64(timestamp);
+
+        if (flags & PACKET_HAS_ACK)
+            out.writeVarint(ack);
+
+        out.writePosition(posePosition(headPose));
+        out.writeOrientation(poseOrientation(headPose));
+
+        return out.ok() ? out.size() : -1;
     }
 
-    void deserialize(char * data) {
-        memcpy(this, data, sizeof(Packet));
+    bool deserialize(const char * data, int length) {
+        WireReader in(data, length);
+
+        packet_type = in.readVarint();
+        uint8_t flags = in.readByte();
+
+        attack = std::make_pair(-1, -1);
+        damage = std::make_pair(-1, -1);
+
+        if (flags & PACKET_HAS_ATTACK) {
+            attack.first = in.readSignedVarint();
+            attack.second = in.readSignedVarint();
+        }
+
+        if (flags & PACKET_HAS_DAMAGE) {
+            damage.first = in.readSignedVarint();
+            damage.second = in.readSignedVarint();
+        }
+
+        done = (flags & PACKET_DONE) != 0;
+
+        timestamp = (flags & PACKET_HAS_TIME) ? in.readVarint64() : 0;
+        ack = (flags & PACKET_HAS_ACK) ? in.readVarint() : 0;
+
+        glm::vec3 position = in.readPosition();
+        glm::quat orientation = in.readOrientation();
+        headPose = makePose(position, orientation);
+
+        return in.ok();
     }
-};
\ No newline at end of file
+};
+
+// NTP-style clock probe. The PING carries the sender's clock when it
+// left; the PONG echoes that and adds the answering side's clock on
+// receipt and on sending the answer. All in microseconds.
+struct ClockPacket {
+
+    unsigned int packet_type = PING;
+    uint64_t origin = 0;
+    uint64_t received = 0;
+    uint64_t transmit = 0;
+
+    int serialize(char * data, int size = CLOCK_PACKET_MAX_SIZE) const {
+        WireWriter out(data, size);
+
+        out.writeVarint(packet_type);
+        out.writeVarint64(origin);
+
+        if (packet_type == PONG) {
+            out.writeVarint64(received);
+            out.writeVarint64(transmit);
+        }
+
+        return out.ok() ? out.size() : -1;
+    }
+
+    bool deserialize(const char * data, int length) {
+        WireReader in(data, length);
+
+        packet_type = in.readVarint();
+        origin = in.readVarint64();
+
+        if (packet_type == PONG) {
+            received = in.readVarint64();
+            transmit = in.readVarint64();
+        }
+
+        return in.ok();
+    }
+};
+
+// SESSION_TOKEN, RESUME or SPECTATE. The token names a seat in a
+// match on a dedicated server, and lets a player who lost the
+// connection take the seat back from a new one. SESSION_TOKEN also
+// carries the match id, which is public: SPECTATE sends it as the
+// token to watch that match.
+struct TokenPacket {
+
+    unsigned int packet_type = SESSION_TOKEN;
+    uint64_t token = 0;
+    unsigned int match = 0;
+
+    int serialize(char * data, int size = TOKEN_PACKET_MAX_SIZE) const {
+        WireWriter out(data, size);
+
+        out.writeVarint(packet_type);
+        out.writeVarint64(token);
+
+        if (packet_type == SESSION_TOKEN)
+            out.writeVarint(match);
+
+        return out.ok() ? out.size() : -1;
+    }
+
+    bool deserialize(const char * data, int length) {
+        WireReader in(data, length);
+
+        packet_type = in.readVarint();
+        token = in.readVarint64();
+
+        if (packet_type == SESSION_TOKEN)
+            match = in.readVarint();
+
+        return in.ok();
+    }
+};
+
+// FLEET, sent once with the done step. With both fleets the server
+// resolves a shot as it arrives and sends the result with the shot
+// itself, so the attacker learns it one round trip after firing and
+// the defender no longer reports hits back.
+struct FleetPacket {
+
+    unsigned int packet_type = FLEET;
+    uint8_t cells[FLEET_BITMAP_SIZE] = {};
+
+    void fromBoard(const Board & board) {
+        memset(cells, 0, sizeof(cells));
+
+        for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+            if (board[i / BOARD_SIZE][i % BOARD_SIZE] == CELL_MARKED)
+                cells[i / 8] |= (uint8_t)(1 << (i % 8));
+    }
+
+    // the ships on an empty board. false unless they cover exactly
+    // FLEET_CELLS cells
+    bool toBoard(Board & board) const {
+        int count = 0;
+        board.clear();
+
+        for (int i = 0; i < BOARD_SIZE * BOARD_SIZE; i++)
+        {
+            if (cells[i / 8] & (1 << (i % 8)))
+            {
+                board[i / BOARD_SIZE][i % BOARD_SIZE] = CELL_MARKED;
+                count++;
+            }
+        }
+
+        return count == FLEET_CELLS;
+    }
+
+    int serialize(char * data, int size = FLEET_PACKET_MAX_SIZE) const {
+        WireWriter out(data, size);
+
+        out.writeVarint(packet_type);
+        for (int i = 0; i < FLEET_BITMAP_SIZE; i++)
+            out.writeByte(cells[i]);
+
+        return out.ok() ? out.size() : -1;
+    }
+
+    bool deserialize(const char * data, int length) {
+        WireReader in(data, length);
+
+        packet_type = in.readVarint();
+        for (int i = 0; i < FLEET_BITMAP_SIZE; i++)
+            cells[i] = in.readByte();
+
+        return in.ok();
+    }
+};
@@ -1,12 +1,112 @@
-
 #include "NetworkServices.h"
+#include "Metrics.h"
+
+thread_local uint64_t NetworkServices::syscalls = 0;
 
 int NetworkServices::sendMessage(SOCKET curSocket, char * message, int messageSize)
 {
-    return send(curSocket, message, messageSize, 0);
+    syscalls++;
+
+#ifdef _WIN32
+    int sent = send(curSocket, message, messageSize, 0);
+#else
+    // a dead peer must surface as an error, not SIGPIPE
+    int sent = (int)send(curSocket, message, messageSize, MSG_NOSIGNAL);
+#endif
+
+    if (sent > 0)
+        Metrics::count(METRIC_BYTES_OUT, sent);
+
+    return sent;
+}
+
+int NetworkServices::sendGather(SOCKET curSocket, const char * const * buffers, const int * lengths, int count)
+{
+    if (count > SEND_GATHER_MAX)
+        count = SEND_GATHER_MAX;
+
+    syscalls++;
+
+#ifdef _WIN32
+    WSABUF parts[SEND_GATHER_MAX];
+
+    for (int i = 0; i < count; i++)
+    {
+        parts[i].buf = (CHAR *)buffers[i];
+        parts[i].len = (ULONG)lengths[i];
+    }
+
+    DWORD sent = 0;
+
+    if (WSASend(curSocket, parts, (DWORD)count, &sent, 0, NULL, NULL) == SOCKET_ERROR)
+        return SOCKET_ERROR;
+
+    Metrics::count(METRIC_BYTES_OUT, sent);
+
+    return (int)sent;
+#else
+    struct iovec parts[SEND_GATHER_MAX];
+
+    for (int i = 0; i < count; i++)
+    {
+        parts[i].iov_base = (void *)buffers[i];
+        parts[i].iov_len = (size_t)lengths[i];
+    }
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = parts;
+    message.msg_iovlen = count;
+
+    // sendmsg rather than writev, for MSG_NOSIGNAL
+    int sent = (int)sendmsg(curSocket, &message, MSG_NOSIGNAL);
+
+    if (sent > 0)
+        Metrics::count(METRIC_BYTES_OUT, sent);
+
+    return sent;
+#endif
 }
 
 int NetworkServices::receiveMessage(SOCKET curSocket, char * buffer, int bufSize)
 {
+    syscalls++;
     return recv(curSocket, buffer, bufSize, 0);
-}
\ No newline at end of file
+}
+
+int NetworkServices::peekMessage(SOCKET curSocket, char * buffer, int bufSize)
+{
+    syscalls++;
+    return recv(curSocket, buffer, bufSize, MSG_PEEK);
+}
+
+int NetworkServices::setNonBlocking(SOCKET curSocket)
+{
+#ifdef _WIN32
+    u_long iMode = 1;
+    return ioctlsocket(curSocket, FIONBIO, &iMode);
+#else
+    int flags = fcntl(curSocket, F_GETFL, 0);
+    if (flags == -1)
+        return SOCKET_ERROR;
+    return fcntl(curSocket, F_SETFL, flags | O_NONBLOCK);
+#endif
+}
+
+int NetworkServices::lastError()
+{
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+bool NetworkServices::wouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
@@ -1,11 +1,55 @@
 #pragma once
+#include <stdint.h>
+#ifdef _WIN32
 #include <winsock2.h>
 #include <Windows.h>
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// map the winsock names onto plain POSIX sockets
+typedef int SOCKET;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#define ZeroMemory(p, n) memset((p), 0, (n))
+#endif
+
+// most buffers one sendGather call takes (IOV_MAX is far higher)
+#define SEND_GATHER_MAX 64
 
 class NetworkServices
 {
 public:
 	static int sendMessage(SOCKET curSocket, char * message, int messageSize);
 	static int receiveMessage(SOCKET curSocket, char * buffer, int bufSize);
-};
 
+	// send count buffers in one call (writev / WSASend), without
+	// copying them together first. returns bytes sent like send
+	static int sendGather(SOCKET curSocket, const char * const * buffers, const int * lengths, int count);
+
+	// like receiveMessage, but the data stays queued for the next recv
+	static int peekMessage(SOCKET curSocket, char * buffer, int bufSize);
+
+	// put a socket into nonblocking mode
+	static int setNonBlocking(SOCKET curSocket);
+
+	// last socket error (WSAGetLastError / errno)
+	static int lastError();
+
+	// true if the last call failed only because it would have blocked
+	static bool wouldBlock();
+
+	// socket syscalls the calling thread has made, through this class
+	// and the networks' waits, for measuring what a message costs
+	static thread_local uint64_t syscalls;
+};
@@ -0,0 +1,233 @@
+#include "OutboundQueue.h"
+#include <string.h>
+
+OutboundQueue::OutboundQueue(BufferPool & bufferPool, unsigned int highWater)
+    : pool(bufferPool)
+{
+    maxCapacity = SEND_BUFFER_INITIAL;
+    while (maxCapacity < highWater && maxCapacity < POOL_MAX_BLOCK)
+        maxCapacity <<= 1;
+
+    data = NULL;
+    blockSize = 0;
+    capacity = 0;
+    mask = 0;
+    readPos = 0;
+    writePos = 0;
+    poseLength = 0;
+}
+
+OutboundQueue::~OutboundQueue(void)
+{
+    pool.release(data, blockSize);
+}
+
+// make room for bytes more, doubling the ring as needed
+bool OutboundQueue::reserve(uint32_t bytes)
+{
+    uint32_t used = writePos - readPos;
+    uint32_t needed = used + bytes;
+
+    if (needed <= capacity)
+        return true;
+
+    if (needed > maxCapacity)
+        return false;
+
+    uint32_t newCapacity = capacity ? capacity : SEND_BUFFER_INITIAL;
+    while (newCapacity < needed)
+        newCapacity <<= 1;
+
+    size_t newBlockSize = newCapacity;
+    char * newData = pool.acquire(newBlockSize);
+
+    if (newData == NULL)
+        return false;
+
+    for (uint32_t i = 0; i < used; i++)
+        newData[i] = data[(readPos + i) & mask];
+
+    pool.release(data, blockSize);
+
+    data = newData;
+    blockSize = newBlockSize;
+    capacity = newCapacity;
+    mask = newCapacity - 1;
+    readPos = 0;
+    writePos = used;
+
+    return true;
+}
+
+void OutboundQueue::append(const char * bytes, int length)
+{
+    uint32_t start = writePos & mask;
+    uint32_t toEnd = capacity - start;
+    uint32_t first = (uint32_t)length < toEnd ? (uint32_t)length : toEnd;
+
+    memcpy(data + start, bytes, first);
+    memcpy(data, bytes + first, length - first);
+    writePos += length;
+}
+
+// packet type of the first frame in data, -1 for none
+static int frameType(const char * data, int length)
+{
+    if (length <= FRAME_HEADER_SIZE)
+        return -1;
+
+    return (int)peekPacketType(data + FRAME_HEADER_SIZE, length - FRAME_HEADER_SIZE);
+}
+
+bool OutboundQueue::push(const char * bytes, int length)
+{
+    if (!reserve(length))
+        return false;
+
+    append(bytes, length);
+
+    // a held message still goes, behind this one, unless this is of its
+    // kind: every Packet carries the pose and every snapshot all since
+    // the ack, so the held one is stale and must not arrive after this.
+    // anything else (a PONG, a token) says nothing it would replace
+    if (poseLength > 0 && frameType(bytes, length) == frameType(pose, poseLength))
+    {
+        coalesced++;
+        poseLength = 0;
+    }
+
+    return true;
+}
+
+bool OutboundQueue::pushPose(const char * bytes, int length)
+{
+    if (length > (int)sizeof(pose))
+        return push(bytes, length);
+
+    if (poseLength > 0)
+        coalesced++;
+
+    memcpy(pose, bytes, length);
+    poseLength = length;
+
+    return true;
+}
+
+int OutboundQueue::flush(SOCKET socket)
+{
+    for (;;)
+    {
+        // the ring is drained: the waiting pose goes next, behind
+        // everything that was queued before it
+        if (readPos == writePos)
+        {
+            if (poseLength == 0)
+            {
+                shrink();
+                return FLUSH_DONE;
+            }
+
+            if (!reserve(poseLength))
+                return FLUSH_ERROR;
+
+            append(pose, poseLength);
+            poseLength = 0;
+        }
+
+        uint32_t start = readPos & mask;
+        uint32_t toEnd = capacity - start;
+        uint32_t count = writePos - readPos;
+        if (count > toEnd)
+            count = toEnd;
+
+        int sent = NetworkServices::sendMessage(socket, data + start, (int)count);
+
+        if (sent == SOCKET_ERROR)
+            return NetworkServices::wouldBlock() ? FLUSH_BLOCKED : FLUSH_ERROR;
+
+        readPos += sent;
+
+        // a short write means the socket buffer is full
+        if ((uint32_t)sent < count)
+            return FLUSH_BLOCKED;
+    }
+}
+
+int OutboundQueue::gather(const char ** buffers, int * lengths, int max) const
+{
+    int parts = 0;
+    uint32_t position = readPos;
+
+    while (position != writePos && parts < max)
+    {
+        uint32_t start = position & mask;
+        uint32_t toEnd = capacity - start;
+        uint32_t count = writePos - position;
+        if (count > toEnd)
+            count = toEnd;
+
+        buffers[parts] = data + start;
+        lengths[parts] = (int)count;
+        parts++;
+        position += count;
+    }
+
+    // the pose only ever goes behind everything in the ring
+    if (position == writePos && poseLength > 0 && parts < max)
+    {
+        buffers[parts] = pose;
+        lengths[parts] = poseLength;
+        parts++;
+    }
+
+    return parts;
+}
+
+bool OutboundQueue::consume(int sent)
+{
+    uint32_t queued = writePos - readPos;
+
+    if ((uint32_t)sent < queued)
+    {
+        readPos += sent;
+        return true;
+    }
+
+    readPos = writePos;
+    sent -= (int)queued;
+
+    if (sent > 0)
+    {
+        // a pose started can't be replaced any more: the rest of it
+        // goes next, from the ring
+        int rest = poseLength - sent;
+        poseLength = 0;
+
+        if (rest > 0)
+        {
+            if (!reserve(rest))
+                return false;
+
+            append(pose + sent, rest);
+            return true;
+        }
+    }
+
+    if (poseLength == 0)
+        shrink();
+
+    return true;
+}
+
+void OutboundQueue::shrink()
+{
+    if (capacity <= SEND_BUFFER_INITIAL)
+        return;
+
+    pool.release(data, blockSize);
+    data = NULL;
+    blockSize = 0;
+    capacity = 0;
+    mask = 0;
+    readPos = writePos = 0;
+}
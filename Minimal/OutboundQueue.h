@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include "NetworkServices.h"
+#include "NetworkData.h"
+#include "BufferPool.h"
+
+// per-session send ring: starting size and the most a slow reader may
+// make it grow to before it is disconnected
+#define SEND_BUFFER_INITIAL 256
+#define SEND_BUFFER_HIGH_WATER (64 * 1024)
+
+// largest message the latest-wins pose slot holds
+#define POSE_SLOT_SIZE 64
+
+// result of a flush
+enum FlushResults {
+
+    FLUSH_DONE = 0,         // everything is on the wire
+
+    FLUSH_BLOCKED = 1,      // socket buffer full, wait until writable
+
+    FLUSH_ERROR = 2,        // socket is dead
+
+};
+
+// Bytes waiting to go out on one client's stream.
+//
+// Messages that must arrive (game events) are appended to a ring and
+// sent in order, resuming after partial writes. A pose-only update, or
+// a snapshot, is held in a single latest-wins slot instead, so while
+// the client is slow each new one replaces the stale one and only the
+// freshest is sent once the ring has drained.
+class OutboundQueue
+{
+public:
+    OutboundQueue(BufferPool & pool, unsigned int highWater = SEND_BUFFER_HIGH_WATER);
+    ~OutboundQueue(void);
+
+    // false if the ring would pass its high-water mark. a held pose
+    // goes out after this, unless this message is of the same packet
+    // type, which supersedes it
+    bool push(const char * data, int length);
+
+    // replace any pose not yet started. anything too big for the slot
+    // is queued like an event instead
+    bool pushPose(const char * data, int length);
+
+    // write as much as the socket takes
+    int flush(SOCKET socket);
+
+    // point at what is queued, in order, for a caller sending it some
+    // other way: the ring's one or two runs, then the pose. up to max
+    // parts; returns the number filled
+    int gather(const char ** buffers, int * lengths, int max) const;
+
+    // sent bytes of what gather pointed at went out. false if a pose
+    // sent part way had no room to finish from
+    bool consume(int sent);
+
+    bool empty() const { return readPos == writePos && poseLength == 0; }
+
+    // bytes waiting in the ring
+    int pending() const { return (int)(writePos - readPos); }
+
+    // poses replaced before they were sent
+    uint64_t coalesced = 0;
+
+private:
+    OutboundQueue(const OutboundQueue &);
+    OutboundQueue & operator=(const OutboundQueue &);
+
+    bool reserve(uint32_t bytes);
+    void append(const char * data, int length);
+
+    // idle sessions shouldn't sit on a grown ring
+    void shrink();
+
+    BufferPool & pool;
+
+    char * data;
+    size_t blockSize;
+    uint32_t capacity;
+    uint32_t mask;
+    uint32_t maxCapacity;
+
+    uint32_t readPos;
+    uint32_t writePos;
+
+    // latest pose waiting for the ring to drain
+    char pose[POSE_SLOT_SIZE];
+    int poseLength;
+};
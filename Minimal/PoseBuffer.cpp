@@ -0,0 +1,100 @@
+#include "PoseBuffer.h"
+#include <math.h>
+#include "WireFormat.h"
+
+PoseBuffer::PoseBuffer(uint64_t delay_us, uint64_t maxExtrapolation_us)
+    : delay(delay_us), maxExtrapolation(maxExtrapolation_us)
+{
+}
+
+void PoseBuffer::push(const glm::mat4 & pose, uint64_t time)
+{
+    if (count > 0 && time <= at(count - 1).time)
+    {
+        dropped++;
+        return;
+    }
+
+    Entry entry;
+    entry.position = posePosition(pose);
+    entry.orientation = poseOrientation(pose);
+    entry.time = time;
+
+    // keep consecutive quaternions in the same hemisphere so blends
+    // take the short way round
+    if (count > 0 && glm::dot(at(count - 1).orientation, entry.orientation) < 0.0f)
+        entry.orientation = -entry.orientation;
+
+    if (count == POSE_BUFFER_SIZE)
+    {
+        head = (head + 1) % POSE_BUFFER_SIZE;
+        count--;
+    }
+
+    entries[(head + count) % POSE_BUFFER_SIZE] = entry;
+    count++;
+}
+
+bool PoseBuffer::sample(uint64_t now, glm::mat4 & pose) const
+{
+    if (count == 0)
+        return false;
+
+    uint64_t target = now > delay ? now - delay : 0;
+
+    const Entry & oldest = at(0);
+    const Entry & newest = at(count - 1);
+
+    if (count == 1 || target <= oldest.time)
+    {
+        const Entry & only = count == 1 ? newest : oldest;
+        pose = makePose(only.position, only.orientation);
+        return true;
+    }
+
+    if (target >= newest.time)
+    {
+        // run on from the last two poses for a bounded time
+        const Entry & previous = at(count - 2);
+
+        uint64_t ahead = target - newest.time;
+        if (ahead > maxExtrapolation)
+            ahead = maxExtrapolation;
+
+        float f = (float)ahead / (float)(newest.time - previous.time);
+
+        glm::vec3 position = newest.position + (newest.position - previous.position) * f;
+
+        // the rotation from previous to newest, scaled by f
+        glm::quat step = newest.orientation * glm::inverse(previous.orientation);
+        if (step.w < 0.0f)
+            step = -step;
+
+        float w = step.w > 1.0f ? 1.0f : step.w;
+        float half = acosf(w);
+        float s = sinf(half);
+
+        glm::quat orientation = newest.orientation;
+        if (s > 1e-6f)
+        {
+            glm::vec3 axis(step.x / s, step.y / s, step.z / s);
+            orientation = glm::normalize(glm::angleAxis(2.0f * half * f, axis) * newest.orientation);
+        }
+
+        pose = makePose(position, orientation);
+        return true;
+    }
+
+    // newest first: the sample time is usually just behind it
+    int i = count - 2;
+    while (i > 0 && at(i).time > target)
+        i--;
+
+    const Entry & a = at(i);
+    const Entry & b = at(i + 1);
+
+    float t = (float)(target - a.time) / (float)(b.time - a.time);
+
+    pose = makePose(glm::mix(a.position, b.position, t), glm::slerp(a.orientation, b.orientation, t));
+    return true;
+}
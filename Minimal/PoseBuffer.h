@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// poses kept, at 90 Hz about a third of a second
+#define POSE_BUFFER_SIZE 32
+
+// default playout delay behind the newest pose, enough to ride out
+// one late or lost pose at the lower send rates
+#define POSE_BUFFER_DELAY_US 50000
+
+// how far past the newest pose the head keeps moving before it stops
+#define POSE_MAX_EXTRAPOLATION_US 100000
+
+// Jitter buffer for a remote head pose.
+//
+// Timestamped poses go in as they arrive. A pose is sampled a fixed
+// delay behind the given time, so there is normally a pose on each
+// side of it. The two are blended: lerp for position and slerp for
+// orientation. When packets are late and the sample time runs past
+// the newest pose, the last two poses are continued at their linear
+// and angular velocity for at most maxExtrapolation, then the head
+// holds still until new poses arrive.
+class PoseBuffer
+{
+public:
+    PoseBuffer(uint64_t delay_us = POSE_BUFFER_DELAY_US,
+               uint64_t maxExtrapolation_us = POSE_MAX_EXTRAPOLATION_US);
+
+    // older or duplicate timestamps than the newest are dropped
+    void push(const glm::mat4 & pose, uint64_t time);
+
+    // the pose to show at time now (same clock as the timestamps).
+    // false until something has been pushed
+    bool sample(uint64_t now, glm::mat4 & pose) const;
+
+    void clear() { count = 0; }
+
+    uint64_t delay;
+    uint64_t maxExtrapolation;
+
+    // poses that came in behind a newer one
+    uint64_t dropped = 0;
+
+private:
+    struct Entry
+    {
+        glm::vec3 position;
+        glm::quat orientation;
+        uint64_t time;
+    };
+
+    // i-th oldest entry
+    const Entry & at(int i) const { return entries[(head + i) % POSE_BUFFER_SIZE]; }
+
+    Entry entries[POSE_BUFFER_SIZE];
+    int head = 0;
+    int count = 0;
+};
@@ -0,0 +1,234 @@
+#include "ReplayLog.h"
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static void put16(uint8_t * p, uint32_t value)
+{
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void put32(uint8_t * p, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void put64(uint8_t * p, uint64_t value)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t get32(const uint8_t * p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const uint8_t * p)
+{
+    return (uint64_t)get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+ReplayWriter::ReplayWriter(void) : file(NULL), buffer(NULL)
+{
+}
+
+ReplayWriter::~ReplayWriter(void)
+{
+    close();
+}
+
+bool ReplayWriter::open(const char * path)
+{
+    close();
+
+    file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        printf("can't open replay log %s\n", path);
+        return false;
+    }
+
+    buffer = new char[REPLAY_WRITE_BUFFER];
+    setvbuf(file, buffer, _IOFBF, REPLAY_WRITE_BUFFER);
+
+    uint8_t header[REPLAY_FILE_HEADER_SIZE];
+    memcpy(header, REPLAY_MAGIC, 8);
+    put32(header + 8, REPLAY_VERSION);
+    fwrite(header, 1, sizeof(header), file);
+
+    records = 0;
+
+    return true;
+}
+
+void ReplayWriter::close()
+{
+    if (file != NULL)
+    {
+        fclose(file);
+        file = NULL;
+    }
+
+    delete[] buffer;
+    buffer = NULL;
+}
+
+void ReplayWriter::record(uint64_t time, int direction, unsigned int session, const char * payload, int length)
+{
+    if (file == NULL || length < 0 || length > 0xFFFF)
+        return;
+
+    uint8_t header[REPLAY_RECORD_HEADER_SIZE];
+    put16(header, (uint32_t)length);
+    header[2] = (uint8_t)direction;
+    put32(header + 3, session);
+    put64(header + 7, time);
+
+    fwrite(header, 1, sizeof(header), file);
+    fwrite(payload, 1, length, file);
+
+    records++;
+}
+
+ReplayReader::ReplayReader(void) : data(NULL), length(0), pos(0)
+{
+#ifdef _WIN32
+    fileHandle = INVALID_HANDLE_VALUE;
+    mapping = NULL;
+#endif
+}
+
+ReplayReader::~ReplayReader(void)
+{
+    close();
+}
+
+bool ReplayReader::open(const char * path)
+{
+    close();
+
+#ifdef _WIN32
+    fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (fileHandle == INVALID_HANDLE_VALUE)
+    {
+        printf("can't open replay log %s\n", path);
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(fileHandle, &fileSize);
+    length = (size_t)fileSize.QuadPart;
+
+    if (length > 0)
+    {
+        mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL)
+            data = (const uint8_t *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+#else
+    int fd = ::open(path, O_RDONLY);
+
+    if (fd == -1)
+    {
+        printf("can't open replay log %s\n", path);
+        return false;
+    }
+
+    struct stat st;
+    fstat(fd, &st);
+    length = (size_t)st.st_size;
+
+    if (length > 0)
+    {
+        void * mapped = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapped != MAP_FAILED)
+        {
+            data = (const uint8_t *)mapped;
+
+            // records are read front to back once
+            madvise(mapped, length, MADV_SEQUENTIAL);
+        }
+    }
+
+    // the mapping keeps the file alive
+    ::close(fd);
+#endif
+
+    if (data == NULL || length < REPLAY_FILE_HEADER_SIZE ||
+        memcmp(data, REPLAY_MAGIC, 8) != 0 || get32(data + 8) != REPLAY_VERSION)
+    {
+        printf("%s is not a replay log\n", path);
+        close();
+        return false;
+    }
+
+    truncated = false;
+    rewind();
+
+    return true;
+}
+
+void ReplayReader::close()
+{
+#ifdef _WIN32
+    if (data != NULL)
+        UnmapViewOfFile(data);
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(fileHandle);
+
+    mapping = NULL;
+    fileHandle = INVALID_HANDLE_VALUE;
+#else
+    if (data != NULL)
+        munmap((void *)data, length);
+#endif
+
+    data = NULL;
+    length = 0;
+    pos = 0;
+}
+
+bool ReplayReader::next(ReplayRecord & record)
+{
+    if (data == NULL || pos >= length)
+        return false;
+
+    if (length - pos < REPLAY_RECORD_HEADER_SIZE)
+    {
+        truncated = true;
+        return false;
+    }
+
+    const uint8_t * p = data + pos;
+    int size = p[0] | (p[1] << 8);
+
+    if (length - pos - REPLAY_RECORD_HEADER_SIZE < (size_t)size)
+    {
+        truncated = true;
+        return false;
+    }
+
+    record.direction = p[2];
+    record.session = get32(p + 3);
+    record.time = get64(p + 7);
+    record.payload = (const char *)(p + REPLAY_RECORD_HEADER_SIZE);
+    record.length = size;
+
+    pos += REPLAY_RECORD_HEADER_SIZE + size;
+
+    return true;
+}
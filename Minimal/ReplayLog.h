@@ -0,0 +1,104 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// A replay log is an 8 byte magic and a uint32 version, then one
+// record per message, all little-endian:
+//
+//     uint16 length, uint8 direction, uint32 session, uint64 time,
+//     then length bytes of payload (the message without its frame
+//     header)
+//
+// time is clockMicros when the message was handled or sent. session
+// is the sender for inbound messages and the destination for outbound
+// ones, REPLAY_ALL_SESSIONS for a broadcast.
+
+#define REPLAY_MAGIC "VRREPLAY"
+#define REPLAY_VERSION 1
+#define REPLAY_FILE_HEADER_SIZE 12
+#define REPLAY_RECORD_HEADER_SIZE 15
+
+#define REPLAY_ALL_SESSIONS 0xFFFFFFFFu
+
+// stdio buffer for the writer, so logging costs a memcpy per message
+#define REPLAY_WRITE_BUFFER (64 * 1024)
+
+enum ReplayDirections {
+
+    REPLAY_INBOUND = 0,
+
+    REPLAY_OUTBOUND = 1,
+
+};
+
+// Appends records to a log. Not thread safe: one thread records.
+class ReplayWriter
+{
+public:
+    ReplayWriter(void);
+    ~ReplayWriter(void);
+
+    // create or truncate path. false if it can't be opened
+    bool open(const char * path);
+    void close();
+
+    bool isOpen() const { return file != NULL; }
+
+    void record(uint64_t time, int direction, unsigned int session, const char * payload, int length);
+
+    uint64_t records = 0;
+
+private:
+    ReplayWriter(const ReplayWriter &);
+    ReplayWriter & operator=(const ReplayWriter &);
+
+    FILE * file;
+    char * buffer;
+};
+
+struct ReplayRecord {
+
+    uint64_t time;
+    int direction;
+    unsigned int session;
+
+    // points into the mapped log
+    const char * payload;
+    int length;
+};
+
+// Reads a log by mapping it whole, so records come straight out of
+// the page cache without a copy or a read call per message.
+class ReplayReader
+{
+public:
+    ReplayReader(void);
+    ~ReplayReader(void);
+
+    // false if path can't be mapped or isn't a replay log
+    bool open(const char * path);
+    void close();
+
+    // the next record, false at the end. a record cut short by a crash
+    // ends the log and sets truncated
+    bool next(ReplayRecord & record);
+
+    void rewind() { pos = REPLAY_FILE_HEADER_SIZE; }
+
+    size_t size() const { return length; }
+    bool truncated = false;
+
+private:
+    ReplayReader(const ReplayReader &);
+    ReplayReader & operator=(const ReplayReader &);
+
+    const uint8_t * data;
+    size_t length;
+    size_t pos;
+
+#ifdef _WIN32
+    void * fileHandle;
+    void * mapping;
+#endif
+};
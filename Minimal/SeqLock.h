@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+// Single-writer slot holding the latest value of a small trivially
+// copyable T. The writer never waits; a reader retries if it raced a
+// write. The value is stored as relaxed atomic words so a torn read is
+// detected by the sequence number instead of being undefined behaviour.
+template <typename T>
+class SeqLock
+{
+public:
+    SeqLock(void) : sequence(0)
+    {
+        for (size_t i = 0; i < WORDS; i++)
+            words[i].store(0, std::memory_order_relaxed);
+    }
+
+    void store(const T & value)
+    {
+        uint64_t buffer[WORDS] = {};
+        memcpy(buffer, &value, sizeof(T));
+
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; i++)
+            words[i].store(buffer[i], std::memory_order_relaxed);
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    // returns false if nothing has been stored yet
+    bool load(T & value) const
+    {
+        uint64_t buffer[WORDS];
+        uint32_t before, after;
+
+        do
+        {
+            before = sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++)
+                buffer[i] = words[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        if (before == 0)
+            return false;
+
+        memcpy(&value, buffer, sizeof(T));
+        return true;
+    }
+
+    // bumps by two on every store
+    uint32_t version() const { return sequence.load(std::memory_order_acquire); }
+
+private:
+    enum { WORDS = (sizeof(T) + 7) / 8 };
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint64_t> words[WORDS];
+};
@@ -1,45 +1,216 @@
 
 #include "ServerGame.h"
+#include "Metrics.h"
 
 unsigned int ServerGame::client_id; 
 
-ServerGame::ServerGame(void)
+ServerGame::ServerGame(const char * port)
 {
-    // id's to assign clients for our table
-    client_id = 0;
+    // ids for datagram peers, kept clear of tcp session handles
+    client_id = UDP_PEER_ID_BASE;
 
     // set up the server network to listen 
-    network = new ServerNetwork(); 
+    network = new ServerNetwork(port, port != NULL);
+
+    running = false;
 }
 
 ServerGame::~ServerGame(void)
 {
+    stop();
+
+    while (!frameBuffers.empty())
+        dropFrameBuffer(frameBuffers.begin()->first);
+}
+
+bool ServerGame::logTraffic(const char * path)
+{
+    return replayLog.open(path);
+}
+
+void ServerGame::replay(uint64_t time, unsigned int id, const char * payload, int length)
+{
+    replayTime = time;
+    handlePacket(id, payload, length);
+    replayTime = 0;
+}
+
+void ServerGame::logSent(unsigned int id, const char * frame, int length)
+{
+    if (replayLog.isOpen())
+        replayLog.record(clockMicros(), REPLAY_OUTBOUND, id, frame + FRAME_HEADER_SIZE, length - FRAME_HEADER_SIZE);
+}
+
+void ServerGame::start()
+{
+    if (running)
+        return;
+
+    running = true;
+    networkThread = std::thread([this]() {
+        while (running)
+            pump(NETWORK_WAIT_MS);
+    });
+}
+
+void ServerGame::stop()
+{
+    running = false;
+
+    if (networkThread.joinable())
+        networkThread.join();
 }
 
 void ServerGame::update()
 {
-    // get new clients
-   if(network->acceptNewClient(client_id))
-   {
-        printf("client %d has been connected to the server\n",client_id);
+    // publish what the render loop decided this frame, stamped with
+    // when the pose was sampled
+    TimedPose pose;
+    pose.pose = my_headPose;
+    pose.time = clockMicros();
+    localPose.store(pose);
+
+    GameEvent event;
+
+    if (my_attack.first != -1) {
+        event.type = EVENT_ATTACK;
+        event.cell = my_attack;
+        outbound.push(event);
+        my_attack = std::make_pair(-1, -1);
+    }
+
+    if (my_damage.first != -1) {
+        event.type = EVENT_DAMAGE;
+        event.cell = my_damage;
+        outbound.push(event);
+        my_damage = std::make_pair(-1, -1);
+    }
+
+    if (my_done != doneSent) {
+        if (my_done)
+            doneFleet = my_fleet;
+
+        event.type = EVENT_DONE;
+        event.cell = std::make_pair(my_done ? 1 : 0, 0);
+        if (outbound.push(event))
+            doneSent = my_done;
+    }
+
+    // and take in what the other player did
+    while (inbound.pop(event))
+    {
+        switch (event.type) {
+
+            case EVENT_ATTACK:
+                other_attack = event.cell;
+                game_mode = true;
+                break;
+
+            case EVENT_DAMAGE:
+                other_damage = event.cell;
+                break;
 
-        client_id++;
-   }
+            case EVENT_DONE:
+                other_done = event.cell.first != 0;
+                break;
+        }
+    }
 
-   receiveFromClients();
+    while (remotePoses.pop(pose)) {
+        other_headPose = pose.pose;
+        other_headPoseTime = pose.time;
+        remoteHead.push(pose.pose, pose.time);
+    }
 }
 
-void ServerGame::receiveFromClients()
+glm::mat4 ServerGame::otherHeadPoseAt(uint64_t now) const
 {
+    glm::mat4 pose;
 
-    Packet packet;
+    if (remoteHead.sample(now, pose))
+        return pose;
+
+    return other_headPose;
+}
 
-    // go through all clients
-    std::map<unsigned int, SOCKET>::iterator iter;
+void ServerGame::pump(int timeout_ms)
+{
+    // sleep until a socket has something for us
+    int events = network->waitForEvents(timeout_ms);
+    uint64_t woke = clockMicros();
 
-    for(iter = network->sessions.begin(); iter != network->sessions.end(); iter++)
+    if (events > 0)
     {
-        int data_length = network->receiveData(iter->first, network_data);
+        // get new clients
+       unsigned int id;
+
+       while(network->acceptNewClient(id))
+            printf("client %d has been connected to the server\n",id);
+
+       receiveFromClients();
+
+       // finish sends that were waiting on full socket buffers
+       network->flushWritable();
+
+       // datagram peers get ids from their own counter
+       if (network->udpReady)
+           network->udp->receive(client_id, [this](unsigned int id, const char * payload, int length) {
+               handlePacket(id, payload, length);
+           });
+    }
+
+    // so is a keepalive pose, or one the other side can't guess
+    sendIfDue();
+
+    // resends and acks are due whether or not anything arrived
+    if (network->udp != NULL)
+    {
+        network->udp->update();
+
+        // quiet datagram peers are forgotten like closed sessions
+        std::vector<unsigned int> & removed = network->udp->removedPeers;
+        network->closedClients.insert(network->closedClients.end(), removed.begin(), removed.end());
+        removed.clear();
+    }
+
+    pingClients();
+
+    // failed sends drop clients too, not just recvs
+    std::vector<unsigned int>::iterator iter;
+
+    for (iter = network->closedClients.begin(); iter != network->closedClients.end(); iter++)
+    {
+        dropFrameBuffer(*iter);
+        clocks.erase(*iter);
+    }
+
+    network->closedClients.clear();
+
+    Metrics::record(METRIC_TICK_US, clockMicros() - woke);
+}
+
+void ServerGame::receiveFromClients()
+{
+    // go through the clients that have data
+    std::vector<unsigned int>::iterator iter;
+
+    for(iter = network->readyClients.begin(); iter != network->readyClients.end(); iter++)
+    {
+        unsigned int id = *iter;
+
+        // reassemble this client's stream in its own buffer
+        FrameBuffer *& frames = frameBuffers[id];
+        if (frames == NULL)
+            frames = new FrameBuffer(bufferPool, RECV_BUFFER_INITIAL, recv_high_water);
+
+        int data_length = network->receiveData(id, frames->writePtr(), frames->writable());
+
+        if (!network->sessions.contains(id))
+        {
+            // connection went away
+            dropFrameBuffer(id);
+            continue;
+        }
 
         if (data_length <= 0) 
         {
@@ -47,70 +218,322 @@ void ServerGame::receiveFromClients()
             continue;
         }
 
-        int i = 0;
-        while (i < (unsigned int)data_length) 
+        frames->commit(data_length);
+
+        const char * payload;
+        int length;
+
+        while (frames->nextFrame(payload, length))
         {
-            packet.deserialize(&(network_data[i]));
-            i += sizeof(Packet);
+            handlePacket(id, payload, length);
+        }
 
-            switch (packet.packet_type) {
+        if (frames->corrupt())
+        {
+            printf("bad frame from client %d, disconnecting\n", id);
+            network->closeClient(id);
+            dropFrameBuffer(id);
+        }
+    }
+}
 
-                case INIT_CONNECTION:
+// one complete message from a client, over either transport
+void ServerGame::handlePacket(unsigned int id, const char * payload, int length)
+{
+    if (replayLog.isOpen())
+        replayLog.record(clockMicros(), REPLAY_INBOUND, id, payload, length);
 
-                    printf("server received init packet from client\n");
+    unsigned int type = peekPacketType(payload, length);
+    Metrics::packetIn(type);
 
-                    sendActionPackets();
+    if (type == PING || type == PONG)
+    {
+        handleClockPacket(id, payload, length);
+        return;
+    }
 
-                    break;
+    if (type == FLEET)
+    {
+        handleFleet(id, payload, length);
+        return;
+    }
 
-                case ACTION_EVENT:
+    Packet packet;
 
-                    //printf("server received action event packet from client\n");
-					if (packet.attack.first != -1) {
-						other_attack = packet.attack;
-						game_mode = true;
-					}
+    if (!packet.deserialize(payload, length))
+    {
+        printf("malformed packet from client %d\n", id);
+        return;
+    }
 
-					if (packet.damage.first != -1) {
-						other_damage = packet.damage;
-					}
+    switch (packet.packet_type) {
 
-					other_done = packet.done;
-					other_headPose = packet.headPose;
-                    sendActionPackets();
+        case INIT_CONNECTION:
 
-                    break;
+            printf("server received init packet from client\n");
 
-                default:
+            sendActionPackets();
 
-                    printf("error in packet types\n");
+            break;
 
-                    break;
-            }
+        case ACTION_EVENT:
+        {
+            //printf("server received action event packet from client\n");
+            GameEvent event;
+
+			if (packet.attack.first != -1) {
+				event.type = EVENT_ATTACK;
+				event.cell = packet.attack;
+				inbound.push(event);
+
+				// answer a hit in the reply below instead of waiting
+				// for the render loop to find it on the board
+				if (localFleetKnown &&
+					localFleet.shoot(packet.attack.first, packet.attack.second) == SHOT_HIT) {
+					if (pending_damage.first != -1)
+						sendActionPackets();
+					pending_damage = packet.attack;
+				}
+			}
+
+			// a player that sent its fleet doesn't report hits, we
+			// resolved them when we fired
+			if (packet.damage.first != -1 && !remoteFleetKnown) {
+				event.type = EVENT_DAMAGE;
+				event.cell = packet.damage;
+				inbound.push(event);
+			}
+
+			if (packet.done != remote_done) {
+				event.type = EVENT_DONE;
+				event.cell = std::make_pair(packet.done ? 1 : 0, 0);
+				if (inbound.push(event))
+					remote_done = packet.done;
+			}
+
+			// senders stamp poses on the shared clock, which is ours
+			TimedPose pose;
+			pose.pose = packet.headPose;
+			pose.time = packet.timestamp != 0 ? packet.timestamp : now();
+			remotePoses.push(pose);
+
+            sendIfDue();
         }
+
+            break;
+
+        default:
+
+            printf("error in packet types\n");
+
+            break;
+    }
+}
+
+void ServerGame::handleClockPacket(unsigned int id, const char * payload, int length)
+{
+    uint64_t arrived = now();
+
+    ClockPacket clock;
+
+    if (!clock.deserialize(payload, length))
+    {
+        printf("malformed clock packet from client %d\n", id);
+        return;
+    }
+
+    if (clock.packet_type == PING)
+    {
+        char reply[FRAME_HEADER_SIZE + CLOCK_PACKET_MAX_SIZE];
+
+        clock.packet_type = PONG;
+        clock.received = arrived;
+        clock.transmit = now();
+
+        int size = clock.serialize(reply + FRAME_HEADER_SIZE);
+        writeFrameHeader(reply, size);
+
+        logSent(id, reply, FRAME_HEADER_SIZE + size);
+
+        // answer on whichever transport the ping came in on
+        if (!network->sendTo(id, reply, FRAME_HEADER_SIZE + size) && network->udp != NULL)
+            network->udp->send(id, reply + FRAME_HEADER_SIZE, size, false);
+
+        return;
+    }
+
+    ClockSync & sync = clocks[id];
+    sync.addSample(clock.origin, clock.received, clock.transmit, arrived);
+
+    // our ping's round trip, less the time the client held it
+    int64_t rtt = (int64_t)(arrived - clock.origin) - (int64_t)(clock.transmit - clock.received);
+    if (rtt >= 0)
+        Metrics::record(METRIC_RTT_US, (uint64_t)rtt);
+
+    remoteClock.store(sync);
+}
+
+void ServerGame::handleFleet(unsigned int id, const char * payload, int length)
+{
+    // the ships can't move once the game is on
+    if (remoteFleetKnown)
+        return;
+
+    FleetPacket fleet;
+
+    if (!fleet.deserialize(payload, length) || !fleet.toBoard(remoteFleet))
+    {
+        printf("bad fleet from client %d\n", id);
+        remoteFleet.clear();
+        return;
+    }
+
+    remoteFleetKnown = true;
+}
+
+void ServerGame::pingClients()
+{
+    uint64_t now = clockMicros();
+
+    if (now - lastPingRound < PING_INTERVAL_MS * 1000ull)
+        return;
+
+    lastPingRound = now;
+
+    if (network->sessions.empty())
+        return;
+
+    ClockPacket ping;
+    ping.packet_type = PING;
+    ping.origin = now;
+
+    char data[FRAME_HEADER_SIZE + CLOCK_PACKET_MAX_SIZE];
+    int size = ping.serialize(data + FRAME_HEADER_SIZE);
+    writeFrameHeader(data, size);
+
+    logSent(REPLAY_ALL_SESSIONS, data, FRAME_HEADER_SIZE + size);
+
+    network->sendToAll(data, FRAME_HEADER_SIZE + size);
+
+    for (size_t i = 0; i < network->sessions.size(); i++)
+        clocks[network->sessions.handleAt(i)].lastPing = now;
+}
+
+const ClockSync * ServerGame::sessionClock(unsigned int id) const
+{
+    std::map<unsigned int, ClockSync>::const_iterator iter = clocks.find(id);
+
+    return iter != clocks.end() ? &iter->second : NULL;
+}
+
+void ServerGame::dropFrameBuffer(unsigned int id)
+{
+    std::map<unsigned int, FrameBuffer *>::iterator iter = frameBuffers.find(id);
+
+    if (iter != frameBuffers.end())
+    {
+        delete iter->second;
+        frameBuffers.erase(iter);
     }
 }
 
 
 void ServerGame::sendActionPackets()
 {
-    // send action packet
-    const unsigned int packet_size = sizeof(Packet);
-    char packet_data[packet_size];
+    // pick up what the render loop queued since the last packet,
+    // leaving a second attack or damage for the packet after
+    GameEvent event;
+
+    while (outbound.peek(event))
+    {
+        if ((event.type == EVENT_ATTACK && pending_attack.first != -1) ||
+            (event.type == EVENT_DAMAGE && pending_damage.first != -1))
+            break;
+
+        outbound.pop(event);
+
+        switch (event.type) {
+
+            case EVENT_ATTACK:
+                pending_attack = event.cell;
+
+                // with the other fleet known our shot is resolved now,
+                // without waiting for the other player to report it
+                if (remoteFleetKnown && remoteFleet.shoot(event.cell.first, event.cell.second) == SHOT_HIT) {
+                    event.type = EVENT_DAMAGE;
+                    inbound.push(event);
+                }
+                break;
+
+            case EVENT_DAMAGE:
+                pending_damage = event.cell;
+                break;
+
+            case EVENT_DONE:
+                pending_done = event.cell.first != 0;
+
+                if (pending_done && !localFleetKnown) {
+                    localFleet = doneFleet;
+                    localFleetKnown = true;
+                }
+                break;
+        }
+    }
+
+    // send action packet, framed with its length
+    char packet_data[FRAME_HEADER_SIZE + PACKET_MAX_SIZE];
 
     Packet packet;
     packet.packet_type = ACTION_EVENT;
-	packet.attack = my_attack;
-	packet.damage = my_damage;
-	packet.done = my_done;
-	packet.headPose = my_headPose;
+	packet.attack = pending_attack;
+	packet.damage = pending_damage;
+	packet.done = pending_done;
 
-	my_attack.first = -1;
-	my_attack.second = -1;
-	my_damage.first = -1;
-	my_damage.second = -1;
+	// our clock is the shared clock
+	TimedPose pose;
+	if (localPose.load(pose)) {
+		packet.headPose = pose.pose;
+		packet.timestamp = pose.time;
+		headReckoning.sent(pose.pose, pose.time);
+	}
 
-    packet.serialize(packet_data);
+	pending_attack.first = -1;
+	pending_attack.second = -1;
+	pending_damage.first = -1;
+	pending_damage.second = -1;
 
-    network->sendToAll(packet_data,packet_size);
-}
\ No newline at end of file
+    int packet_size = packet.serialize(packet_data + FRAME_HEADER_SIZE);
+    writeFrameHeader(packet_data, packet_size);
+
+    // game events must arrive but a pose only matters until the next
+    // one replaces it
+    bool reliable = packet.attack.first != -1 || packet.damage.first != -1 || packet.done != udp_done;
+    udp_done = packet.done;
+
+    logSent(REPLAY_ALL_SESSIONS, packet_data, FRAME_HEADER_SIZE + packet_size);
+
+    network->sendToAll(packet_data, FRAME_HEADER_SIZE + packet_size, !reliable);
+
+    if (network->udp != NULL)
+        network->udp->sendToAll(packet_data + FRAME_HEADER_SIZE, packet_size, reliable);
+}
+
+void ServerGame::sendIfDue()
+{
+    GameEvent event;
+
+    if (outbound.peek(event) || pending_attack.first != -1 || pending_damage.first != -1)
+    {
+        sendActionPackets();
+        return;
+    }
+
+    // nobody to keep alive
+    if (network->sessions.empty() && (network->udp == NULL || !network->udp->hasPeers()))
+        return;
+
+    TimedPose pose;
+
+    if (localPose.load(pose) && headReckoning.due(pose.pose, pose.time))
+        sendActionPackets();
+}
@@ -1,21 +1,104 @@
 #pragma once
+#include <thread>
+#include <atomic>
 #include "ServerNetwork.h"
 #include "NetworkData.h"
+#include "FrameBuffer.h"
+#include "SpscQueue.h"
+#include "SeqLock.h"
+#include "ClockSync.h"
+#include "PoseBuffer.h"
+#include "DeadReckoning.h"
+#include "ReplayLog.h"
+
+// how long the network thread sleeps in waitForEvents
+#define NETWORK_WAIT_MS 5
+
+// game events queued between the render loop and the network thread
+#define EVENT_QUEUE_SIZE 64
+
+// remote head poses on their way to the render thread
+#define REMOTE_POSE_QUEUE_SIZE 64
+
+// datagram peer ids count up from here, above any session handle
+#define UDP_PEER_ID_BASE 0x80000000u
+
+enum GameEventTypes {
+
+	EVENT_ATTACK = 0,
+
+	EVENT_DAMAGE = 1,
+
+	EVENT_DONE = 2,
+
+};
+
+struct GameEvent {
+
+	unsigned int type;
+	std::pair<int, int> cell;
+};
+
+// a head pose and when it was sampled, in microseconds on the shared
+// clock (this server's clockMicros)
+struct TimedPose {
+
+	glm::mat4 pose;
+	uint64_t time;
+};
 
 class ServerGame
 {
 
 public:
 
-    ServerGame(void);
+    // listen on port, or with NULL open no sockets at all, for
+    // feeding the game recorded traffic through replay()
+    ServerGame(const char * port = DEFAULT_PORT);
     ~ServerGame(void);
 
+	// before start(): append every message handled or sent to a
+	// replay log at path. false if it can't be created
+	bool logTraffic(const char * path);
+
+	// network thread, or instead of it: handle a recorded inbound
+	// message as if it arrived at time (clockMicros of the recording)
+	void replay(uint64_t time, unsigned int id, const char * payload, int length);
+
+	// run the network on its own thread
+	void start();
+	void stop();
+
+	// render thread: hand my_* to the network thread and pick up
+	// what arrived since the last call into other_*
     void update();
 
+	// network thread: accept and receive, waits up to timeout_ms
+	// when nothing is ready
+	void pump(int timeout_ms);
+
 	void receiveFromClients();
 
+	// one complete message from a client, over either transport
+	void handlePacket(unsigned int id, const char * payload, int length);
+
+	// answer a PING, or take a PONG into the session's clock estimate
+	void handleClockPacket(unsigned int id, const char * payload, int length);
+
+	// hold the other player's FLEET, to resolve our shots at it
+	void handleFleet(unsigned int id, const char * payload, int length);
+
+	// ping every session once per PING_INTERVAL_MS
+	void pingClients();
+
+	// send my_* now, whatever changed
 	void sendActionPackets();
 
+	// send my_* if an event is waiting or the other side's guess of
+	// my head has drifted too far (see headReckoning)
+	void sendIfDue();
+
+	// render thread state
 	std::pair<int, int> my_attack = std::make_pair(-1,-1);
 	std::pair<int, int> other_attack = std::make_pair(-1, -1);
 	std::pair<int, int> my_damage = std::make_pair(-1, -1);
@@ -23,18 +106,110 @@ public:
 	glm::mat4 my_headPose = glm::mat4(1.0f);
 	glm::mat4 other_headPose = glm::mat4(1.0f);
 
+	// when other_headPose was sampled by its sender, shared clock
+	uint64_t other_headPoseTime = 0;
+
+	// every remote pose received, for drawing the remote head smoothly
+	PoseBuffer remoteHead;
+
+	// when my head pose is worth sending. its thresholds may be set
+	// before start(); after that it belongs to the network thread
+	DeadReckoning headReckoning;
+
+	// render thread: the remote head as it should be drawn at time now
+	// (clockMicros), from the jitter buffer
+	glm::mat4 otherHeadPoseAt(uint64_t now) const;
+
 	bool game_mode = true;
 	bool my_done = false;
 	bool other_done = false;
 
+	// the local ships, set before my_done. the other player's shots
+	// are resolved against them as they arrive, so the render loop
+	// no longer answers with my_damage
+	Board my_fleet;
+
+	// largest a client's receive buffer may grow before it is dropped
+	unsigned int recv_high_water = RECV_BUFFER_HIGH_WATER;
+
+	// queue health, safe to read from either thread
+	uint32_t inboundDepth() const { return inbound.depth(); }
+	uint32_t outboundDepth() const { return outbound.depth(); }
+	uint32_t inboundDropped() const { return inbound.dropped(); }
+	uint32_t outboundDropped() const { return outbound.dropped(); }
+
+	// rtt, jitter and clock offset of the session last heard from,
+	// with their histograms. false until a PONG has come back
+	bool remoteLink(ClockSync & link) const { return remoteClock.load(link); }
+
+	// network thread only: the same for any session
+	const ClockSync * sessionClock(unsigned int id) const;
+
 private:
 
-   // IDs for the clients connecting for table in ServerNetwork 
+   // next id for a datagram peer. tcp clients are named by their
+   // ServerNetwork session handle instead
     static unsigned int client_id;
 
    // The ServerNetwork object 
     ServerNetwork* network;
 
-	// data buffer
-   char network_data[MAX_PACKET_SIZE];
-};
\ No newline at end of file
+	// receive buffers for every client come out of this pool
+	BufferPool bufferPool;
+
+	// stream reassembly per connected client
+	std::map<unsigned int, FrameBuffer *> frameBuffers;
+
+	void dropFrameBuffer(unsigned int id);
+
+	std::thread networkThread;
+	std::atomic<bool> running;
+
+	// network thread -> render thread
+	SpscQueue<GameEvent, EVENT_QUEUE_SIZE> inbound;
+	SpscQueue<TimedPose, REMOTE_POSE_QUEUE_SIZE> remotePoses;
+	SeqLock<ClockSync> remoteClock;
+
+	// render thread -> network thread
+	SpscQueue<GameEvent, EVENT_QUEUE_SIZE> outbound;
+	SeqLock<TimedPose> localPose;
+
+	// network thread: per session round trip and clock estimates
+	std::map<unsigned int, ClockSync> clocks;
+	uint64_t lastPingRound = 0;
+
+	// render thread: my_done already queued
+	bool doneSent = false;
+
+	// my_fleet as it was when done was queued. written before the
+	// EVENT_DONE push and read after its pop, which orders the two
+	Board doneFleet;
+
+	// network thread: both fleets once known. a shot at a known fleet
+	// is resolved here, and its result sent straight back
+	Board localFleet;
+	bool localFleetKnown = false;
+	Board remoteFleet;
+	bool remoteFleetKnown = false;
+
+	// network thread: local state waiting for the next action packet
+	std::pair<int, int> pending_attack = std::make_pair(-1, -1);
+	std::pair<int, int> pending_damage = std::make_pair(-1, -1);
+	bool pending_done = false;
+	bool remote_done = false;
+
+	// done flag as last sent on the reliable udp channel
+	bool udp_done = false;
+
+	// network thread: traffic log, closed unless logTraffic was called
+	ReplayWriter replayLog;
+
+	// the recorded time while replay() runs, 0 otherwise
+	uint64_t replayTime = 0;
+
+	// clockMicros, or the recorded time during a replay
+	uint64_t now() const { return replayTime != 0 ? replayTime : clockMicros(); }
+
+	// log an outbound frame, header and all
+	void logSent(unsigned int id, const char * frame, int length);
+};
@@ -1,28 +1,114 @@
 
 #include "ServerNetwork.h"
+#include "ClockSync.h"
+#include "Metrics.h"
+#include <algorithm>
 
 
-ServerNetwork::ServerNetwork(void)
+#ifndef _WIN32
+#define WSACleanup()
+#define WSAGetLastError() errno
+#endif
+
+// epoll keys of the listen and udp sockets, clients use their session id
+#define LISTEN_KEY 0xFFFFFFFFFFFFFFFFull
+#define UDP_KEY 0xFFFFFFFFFFFFFFFEull
+#define LOCAL_KEY 0xFFFFFFFFFFFFFFFDull
+
+// io_uring keys: what the operation was above the session id
+#define URING_RECEIVE 1ull
+#define URING_SEND 2ull
+#define URING_WRITABLE 3ull
+#define URING_DOORBELL 4ull
+
+static uint64_t uringKey(uint64_t operation, unsigned int client_id)
 {
-	// create WSADATA object
-    WSADATA wsaData;
+    return operation << 32 | client_id;
+}
+
+// count the frames in data by type, as queued for copies sessions
+static void countFrames(const char * data, int length, uint64_t copies)
+{
+    while (length > FRAME_HEADER_SIZE)
+    {
+        int size = readFrameHeader(data);
+
+        Metrics::packetOut(peekPacketType(data + FRAME_HEADER_SIZE, length - FRAME_HEADER_SIZE), copies);
+
+        data += FRAME_HEADER_SIZE + size;
+        length -= FRAME_HEADER_SIZE + size;
+    }
+}
 
+ServerNetwork::ServerNetwork(const char * port, bool datagrams, int requestedEngine)
+    : timers(clockMicros())
+{
     // our sockets for the server
     ListenSocket = INVALID_SOCKET;
     ClientSocket = INVALID_SOCKET;
 
-
+    udp = NULL;
+    listenReady = false;
+    udpReady = false;
+    send_high_water = SEND_BUFFER_HIGH_WATER;
+    heartbeat_ms = 0;
+    idle_timeout_ms = 0;
+    engine = ENGINE_POLL;
+    localListener = INVALID_SOCKET;
+    localReady = false;
 
     // address info for the server to listen to
     struct addrinfo *result = NULL;
     struct addrinfo hints;
 
+#ifdef _WIN32
+	// create WSADATA object
+    WSADATA wsaData;
+
     // Initialize Winsock
     iResult = WSAStartup(MAKEWORD(2,2), &wsaData);
     if (iResult != 0) {
         printf("WSAStartup failed with error: %d\n", iResult);
         exit(1);
     }
+#endif
+
+#ifndef _WIN32
+    epollFd = epoll_create1(0);
+
+    if (epollFd == -1) {
+        printf("epoll_create1 failed with error: %d\n", errno);
+        exit(1);
+    }
+
+    uring = NULL;
+    starvedAt = 0;
+
+    // the acceptor peeks and hands sockets on, which a receive the
+    // kernel keeps armed would get in the way of
+    if (requestedEngine == ENGINE_URING && port != NULL)
+        printf("io_uring only serves adopted sockets, using epoll to listen\n");
+    else if (requestedEngine == ENGINE_URING)
+    {
+        uring = UringEngine::create();
+
+        if (uring == NULL)
+            printf("io_uring not available, using epoll\n");
+        else
+        {
+            engine = ENGINE_URING;
+            chainNext.resize(URING_BUFFERS);
+            chainLength.resize(URING_BUFFERS);
+        }
+    }
+#else
+    if (requestedEngine == ENGINE_URING)
+        printf("io_uring not available, using WSAPoll\n");
+#endif
+
+    // a worker only serves sockets accepted elsewhere
+    if (port == NULL)
+        return;
 
     // set address information
     ZeroMemory(&hints, sizeof(hints));
@@ -32,7 +118,7 @@ ServerNetwork::ServerNetwork(void)
     hints.ai_flags = AI_PASSIVE;
 
 	    // Resolve the server address and port
-    iResult = getaddrinfo(NULL, DEFAULT_PORT, &hints, &result);
+    iResult = getaddrinfo(NULL, port, &hints, &result);
 
     if ( iResult != 0 ) {
         printf("getaddrinfo failed with error: %d\n", iResult);
@@ -44,15 +130,20 @@ ServerNetwork::ServerNetwork(void)
     ListenSocket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
 
     if (ListenSocket == INVALID_SOCKET) {
-        printf("socket failed with error: %ld\n", WSAGetLastError());
+        printf("socket failed with error: %d\n", WSAGetLastError());
         freeaddrinfo(result);
         WSACleanup();
         exit(1);
     }
 
+#ifndef _WIN32
+    // allow a restarted server to rebind while old connections linger
+    int reuse = 1;
+    setsockopt(ListenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#endif
+
     // Set the mode of the socket to be nonblocking
-    u_long iMode = 1;
-    iResult = ioctlsocket(ListenSocket, FIONBIO, &iMode);
+    iResult = NetworkServices::setNonBlocking(ListenSocket);
 
     if (iResult == SOCKET_ERROR) {
         printf("ioctlsocket failed with error: %d\n", WSAGetLastError());
@@ -84,70 +175,1320 @@ ServerNetwork::ServerNetwork(void)
         WSACleanup();
         exit(1);
     }
+
+#ifndef _WIN32
+    // watch the listen socket for incoming connections
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = LISTEN_KEY;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, ListenSocket, &ev);
+
+    // and the one clients on this host skip the tcp stack through
+    localListener = LocalChannel::listen(port);
+
+    if (localListener == INVALID_SOCKET)
+        printf("local connections not available on port %s\n", port);
+    else
+    {
+        ev.events = EPOLLIN;
+        ev.data.u64 = LOCAL_KEY;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, localListener, &ev);
+    }
+#endif
+
+    if (!datagrams)
+        return;
+
+    udp = new UdpTransport(port);
+
+#ifndef _WIN32
+    // and the udp socket for datagrams
+    ev.events = EPOLLIN;
+    ev.data.u64 = UDP_KEY;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, udp->socket(), &ev);
+#endif
 }
 
 
 ServerNetwork::~ServerNetwork(void)
 {
+    while (!sessions.empty())
+        closeClient(sessions.handleAt(0));
+
+    delete udp;
+
+    if (ListenSocket != INVALID_SOCKET)
+        closesocket(ListenSocket);
+
+    if (localListener != INVALID_SOCKET)
+        closesocket(localListener);
+
+#ifndef _WIN32
+    // closing the ring cancels what is armed, so the sockets can go
+    delete uring;
+
+    for (size_t i = 0; i < closing.size(); i++)
+        closesocket(closing[i]);
+
+    close(epollFd);
+#endif
+}
+
+int ServerNetwork::waitForEvents(int timeout_ms)
+{
+    quietClients.clear();
+
+    int n = waitSockets(timers.timeout(clockMicros(), timeout_ms));
+
+    timers.advance(clockMicros());
+    n += expireTimers();
+
+    Metrics::set(METRIC_SEND_QUEUE_BYTES, (int64_t)sendPool.bytesInUse());
+    Metrics::set(METRIC_TIMERS, (int64_t)timers.size());
+
+    return n;
+}
+
+// wait for readable sockets
+int ServerNetwork::waitSockets(int timeout_ms)
+{
+#ifndef _WIN32
+    if (uring != NULL)
+        return waitUring(timeout_ms);
+#endif
+
+    readyClients.clear();
+    writableClients.clear();
+    listenReady = false;
+    udpReady = false;
+    localReady = false;
+
+#ifdef _WIN32
+    std::vector<WSAPOLLFD> fds;
+    std::vector<unsigned int> ids;
+
+    WSAPOLLFD pfd;
+    pfd.events = POLLRDNORM;
+    pfd.revents = 0;
+
+    // listen and udp sockets come first when this server has them
+    int listenSlot = -1;
+    int udpSlot = -1;
+
+    if (ListenSocket != INVALID_SOCKET)
+    {
+        pfd.fd = ListenSocket;
+        listenSlot = (int)fds.size();
+        fds.push_back(pfd);
+    }
+
+    if (udp != NULL)
+    {
+        pfd.fd = udp->socket();
+        udpSlot = (int)fds.size();
+        fds.push_back(pfd);
+    }
+
+    size_t first = fds.size();
+
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        Session & session = sessions.valueAt(i);
+        pfd.fd = session.socket;
+        pfd.events = POLLRDNORM;
+        if (session.waitingForWritable)
+            pfd.events |= POLLWRNORM;
+        fds.push_back(pfd);
+        ids.push_back(sessions.handleAt(i));
+    }
+
+    if (fds.empty())
+    {
+        Sleep(timeout_ms);
+        return 0;
+    }
+
+    int n = WSAPoll(&fds[0], (ULONG)fds.size(), timeout_ms);
+
+    if (n == SOCKET_ERROR) {
+        printf("WSAPoll failed with error: %d\n", WSAGetLastError());
+        return 0;
+    }
+
+    listenReady = listenSlot >= 0 && (fds[listenSlot].revents & POLLRDNORM) != 0;
+    udpReady = udpSlot >= 0 && (fds[udpSlot].revents & POLLRDNORM) != 0;
+
+    for (size_t i = first; i < fds.size(); i++)
+    {
+        if (fds[i].revents & POLLERR)
+        {
+            // reset or failed, nothing left worth reading
+            closeClient(ids[i - first]);
+            continue;
+        }
+
+        // hangups are reported by the next recv, after any data
+        if (fds[i].revents & (POLLRDNORM | POLLHUP))
+            readyClients.push_back(ids[i - first]);
+        if (fds[i].revents & POLLWRNORM)
+            writableClients.push_back(ids[i - first]);
+    }
+#else
+    struct epoll_event events[MAX_EVENTS];
+
+    // a local session with something to do keeps the wait from sleeping
+    if (timeout_ms != 0 && !sleepLocal())
+        timeout_ms = 0;
+
+    NetworkServices::syscalls++;
+    int n = epoll_wait(epollFd, events, MAX_EVENTS, timeout_ms);
+
+    if (n == -1) {
+        if (errno != EINTR)
+            printf("epoll_wait failed with error: %d\n", errno);
+        return 0;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        if (events[i].data.u64 == LISTEN_KEY)
+            listenReady = true;
+        else if (events[i].data.u64 == UDP_KEY)
+            udpReady = true;
+        else if (events[i].data.u64 == LOCAL_KEY)
+            localReady = true;
+        else if (events[i].events & EPOLLERR)
+        {
+            // reset or failed, nothing left worth reading
+            closeClient((unsigned int)events[i].data.u64);
+        }
+        else
+        {
+            Session * session = sessions.find((unsigned int)events[i].data.u64);
+
+            // a local session's doorbell. its ring is looked at below
+            if (session != NULL && session->local != NULL)
+            {
+                session->local->drain();
+                continue;
+            }
+
+            // hangups are reported by the next recv, after any data
+            if (events[i].events & (EPOLLIN | EPOLLHUP))
+                readyClients.push_back((unsigned int)events[i].data.u64);
+            if (events[i].events & EPOLLOUT)
+                writableClients.push_back((unsigned int)events[i].data.u64);
+        }
+    }
+
+    wakeLocal();
+#endif
+
+    return (int)(readyClients.size() + writableClients.size()) + (listenReady ? 1 : 0) + (udpReady ? 1 : 0) +
+        (localReady ? 1 : 0);
 }
 
 // accept new connections
 bool ServerNetwork::acceptNewClient(unsigned int & id)
 {
-    // if client waiting, accept the connection and save the socket
-    ClientSocket = accept(ListenSocket,NULL,NULL);
+    // a full table closes the socket, so try the next one
+    do
+    {
+        ClientSocket = acceptSocket();
+
+        if (ClientSocket != INVALID_SOCKET)
+            id = adoptClient(ClientSocket);
+        else
+        {
+            // tcp is drained, then those on this host
+            LocalChannel * channel = acceptLocal();
+
+            if (channel == NULL)
+                return false;
+
+            id = adoptClient(channel->socket, channel);
+        }
+    }
+    while (id == INVALID_SESSION);
+
+    return true;
+}
+
+// accept one waiting connection without starting a session for it
+SOCKET ServerNetwork::acceptSocket()
+{
+    // nothing is waiting, don't bother the kernel
+    if (!listenReady)
+        return INVALID_SOCKET;
 
-    if (ClientSocket != INVALID_SOCKET) 
+    // if client waiting, accept the connection
+    SOCKET socket = accept(ListenSocket,NULL,NULL);
+
+    if (socket == INVALID_SOCKET)
     {
-        //disable nagle on the client's socket
-        char value = 1;
-        setsockopt( ClientSocket, IPPROTO_TCP, TCP_NODELAY, &value, sizeof( value ) );
+        // backlog drained until the next wakeup
+        listenReady = false;
+        return INVALID_SOCKET;
+    }
 
-        // insert new client into session id table
-        sessions.insert( pair<unsigned int, SOCKET>(id, ClientSocket) );
+    Metrics::count(METRIC_CONNECTIONS_ACCEPTED);
 
-        return true;
+    //disable nagle on the client's socket
+    int value = 1;
+    setsockopt( socket, IPPROTO_TCP, TCP_NODELAY, (const char *)&value, sizeof( value ) );
+
+    NetworkServices::setNonBlocking(socket);
+
+    return socket;
+}
+
+LocalChannel * ServerNetwork::acceptLocal()
+{
+    if (!localReady)
+        return NULL;
+
+    LocalChannel * channel = LocalChannel::accept(localListener);
+
+    // backlog drained until the next wakeup
+    if (channel == NULL)
+        localReady = false;
+    else
+        Metrics::count(METRIC_CONNECTIONS_ACCEPTED);
+
+    return channel;
+}
+
+// start a session for a connected socket
+unsigned int ServerNetwork::adoptClient(SOCKET socket, LocalChannel * channel)
+{
+    Session session;
+    session.socket = socket;
+    session.local = channel;
+
+    // insert new client into session table
+    unsigned int id = sessions.insert(session);
+
+    if (id == INVALID_SESSION)
+    {
+        printf("session table full, refusing client\n");
+        if (channel != NULL)
+            delete channel;
+        else
+            closesocket(socket);
+        return INVALID_SESSION;
+    }
+
+    Metrics::add(METRIC_SESSIONS, 1);
+
+    Session & adopted = *sessions.find(id);
+    adopted.out = new OutboundQueue(sendPool, send_high_water);
+
+    // silence counts from here
+    adopted.heardAt = timers.now();
+    checkSilence(id, adopted);
+
+    // its ring is looked at every wait, the socket only rings
+    if (channel != NULL)
+        localClients.push_back(id);
+
+#ifndef _WIN32
+    // the next wait arms a poll on the doorbell
+    if (uring != NULL && channel != NULL)
+        return id;
+
+    // its data comes in as it arrives from here on
+    if (uring != NULL)
+    {
+        adopted.receiveArmed = true;
+        uring->receive(socket, uringKey(URING_RECEIVE, id));
+        return id;
     }
 
-    return false;
+    // only wake up for this client when it has data
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = id;
+    NetworkServices::syscalls++;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, socket, &ev);
+#endif
+
+    return id;
 }
 
 // receive incoming data
-int ServerNetwork::receiveData(unsigned int client_id, char * recvbuf)
+int ServerNetwork::receiveData(unsigned int client_id, char * recvbuf, int bufSize)
 {
-    if( sessions.find(client_id) != sessions.end() )
+    Session * session = sessions.find(client_id);
+
+    if (session == NULL)
+        return 0;
+
+    int received;
+
+    if (session->local != NULL)
+        received = receiveLocal(client_id, *session, recvbuf, bufSize, true);
+#ifndef _WIN32
+    else if (uring != NULL)
+        received = receiveUring(client_id, recvbuf, bufSize, true);
+#endif
+    else
     {
-        SOCKET currentSocket = sessions[client_id];
-        iResult = NetworkServices::receiveMessage(currentSocket, recvbuf, MAX_PACKET_SIZE);
+        received = iResult = NetworkServices::receiveMessage(session->socket, recvbuf, bufSize);
 
-        if (iResult == 0)
+        if (iResult == 0 || (iResult == SOCKET_ERROR && !NetworkServices::wouldBlock()))
         {
             printf("Connection closed\n");
-            closesocket(currentSocket);
+            closeClient(client_id);
+        }
+    }
+
+    // still there: its timer sees this when it fires
+    if (received > 0)
+    {
+        session->heardAt = timers.now();
+        Metrics::count(METRIC_BYTES_IN, received);
+    }
+
+    return received;
+}
+
+int ServerNetwork::peekData(unsigned int client_id, char * recvbuf, int bufSize)
+{
+    Session * session = sessions.find(client_id);
+
+    if (session != NULL && session->local != NULL)
+        return receiveLocal(client_id, *session, recvbuf, bufSize, false);
+
+#ifndef _WIN32
+    if (uring != NULL)
+        return receiveUring(client_id, recvbuf, bufSize, false);
+#endif
+
+    if (session == NULL)
+        return 0;
+
+    iResult = NetworkServices::peekMessage(session->socket, recvbuf, bufSize);
+
+    if (iResult == 0 || (iResult == SOCKET_ERROR && !NetworkServices::wouldBlock()))
+    {
+        printf("Connection closed\n");
+        closeClient(client_id);
+    }
+
+    return iResult;
+}
+
+SOCKET ServerNetwork::releaseClient(unsigned int client_id, LocalChannel ** channel)
+{
+    Session * session = sessions.find(client_id);
+
+    if (channel != NULL)
+        *channel = NULL;
+
+    if (session == NULL)
+        return INVALID_SOCKET;
+
+    SOCKET socket = session->socket;
+    LocalChannel * local = session->local;
+
+    timers.cancel(session->timer);
+    Metrics::add(METRIC_SESSIONS, -1);
+
+    // what is in its ring goes along with it
+    if (local != NULL)
+        forgetLocal(client_id, *session);
+
+#ifndef _WIN32
+    // with io_uring, whatever was received and not read is lost
+    if (uring != NULL)
+    {
+        if (local == NULL)
+            forgetUring(client_id, *session);
+    }
+    else
+    {
+        NetworkServices::syscalls++;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, socket, NULL);
+    }
+#endif
+    delete session->out;
+    delete session->shared;
+    sessions.remove(client_id);
+
+    if (local != NULL && channel != NULL)
+        *channel = local;
+    else if (local != NULL)
+    {
+        delete local;
+        return INVALID_SOCKET;
+    }
+
+    return socket;
+}
+
+// close a client's socket and forget its session
+void ServerNetwork::closeClient(unsigned int client_id)
+{
+    Session * session = sessions.find(client_id);
+
+    if (session == NULL)
+        return;
+
+    LocalChannel * local = session->local;
+
+    timers.cancel(session->timer);
+    Metrics::add(METRIC_SESSIONS, -1);
+    Metrics::count(METRIC_CONNECTIONS_CLOSED);
+
+    if (local != NULL)
+    {
+        forgetLocal(client_id, *session);
+        local->hangUp();
+    }
+
+#ifndef _WIN32
+    if (uring != NULL)
+    {
+        if (local == NULL)
+            forgetUring(client_id, *session);
+        closing.push_back(session->socket);
+    }
+    else
+    {
+        NetworkServices::syscalls++;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, session->socket, NULL);
+        closesocket(session->socket);
+    }
+#else
+    closesocket(session->socket);
+#endif
+    // its socket is taken care of above
+    if (local != NULL)
+    {
+        local->socket = INVALID_SOCKET;
+        delete local;
+    }
+
+    delete session->out;
+    delete session->shared;
+
+    // the handle goes stale here, its slot can be reused right away
+    sessions.remove(client_id);
+    closedClients.push_back(client_id);
+}
+
+int ServerNetwork::expireTimers()
+{
+    size_t owned = expiredTimers.size();
+    TimerEvent event;
+
+    while (timers.expired(event))
+    {
+        if (event.kind != TIMER_SESSION)
+        {
+            expiredTimers.push_back(event);
+            continue;
         }
 
-        return iResult;
+        // cancelled when the session goes, so it is still there
+        Session * session = sessions.find((unsigned int)event.key);
+        session->timer = 0;
+        checkSilence((unsigned int)event.key, *session);
     }
 
-    return 0;
+    return (int)(expiredTimers.size() - owned + quietClients.size());
 }
 
-// send data to all clients
-void ServerNetwork::sendToAll(char * packets, int totalSize)
+void ServerNetwork::checkSilence(unsigned int client_id, Session & session)
 {
-    SOCKET currentSocket;
-    std::map<unsigned int, SOCKET>::iterator iter;
-    int iSendResult;
+    uint64_t now = timers.now();
+    uint64_t silent = now - session.heardAt;
+    uint64_t next = UINT64_MAX;
+
+    if (idle_timeout_ms > 0)
+    {
+        if (silent >= idle_timeout_ms * 1000ull)
+        {
+            printf("client %d went silent, disconnecting\n", client_id);
+            Metrics::count(METRIC_IDLE_TIMEOUTS);
+            closeClient(client_id);
+            return;
+        }
+
+        next = session.heardAt + idle_timeout_ms * 1000ull;
+    }
 
-    for (iter = sessions.begin(); iter != sessions.end(); iter++)
+    if (heartbeat_ms > 0)
     {
-        currentSocket = iter->second;
-        iSendResult = NetworkServices::sendMessage(currentSocket, packets, totalSize);
+        uint64_t due = session.heardAt + heartbeat_ms * 1000ull;
 
-        if (iSendResult == SOCKET_ERROR) 
+        // and again an interval later if it still says nothing
+        if (silent >= heartbeat_ms * 1000ull)
         {
+            quietClients.push_back(client_id);
+            due = now + heartbeat_ms * 1000ull;
+        }
+
+        next = std::min(next, due);
+    }
+
+    if (next != UINT64_MAX)
+        session.timer = timers.schedule(next, TIMER_SESSION, client_id);
+}
+
+void ServerNetwork::watchWritable(unsigned int client_id, bool enable)
+{
+    Session * session = sessions.find(client_id);
+
+    if (session->waitingForWritable == enable)
+        return;
+
+    session->waitingForWritable = enable;
+
+    // the peer's next read rings instead
+    if (session->local != NULL)
+    {
+        session->local->wantSpace(enable);
+        return;
+    }
+
+#ifndef _WIN32
+    struct epoll_event ev;
+    ev.events = enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.u64 = client_id;
+    NetworkServices::syscalls++;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, session->socket, &ev);
+#endif
+}
+
+int ServerNetwork::flushQueues(Session & session)
+{
+    if (session.local != NULL)
+        return flushLocal(session);
+
+    SharedQueue * shared = session.shared;
+    int result = FLUSH_DONE;
+
+    // the stream can only switch queues between messages: one part way
+    // out finishes before the other queue starts
+    if (shared != NULL && shared->partial())
+        result = shared->flush(session.socket);
+
+    if (result == FLUSH_DONE)
+        result = session.out->flush(session.socket);
+
+    if (result == FLUSH_DONE && shared != NULL)
+        result = shared->flush(session.socket);
+
+    return result;
+}
+
+bool ServerNetwork::flushClient(unsigned int client_id)
+{
+    Session * session = sessions.find(client_id);
+
+#ifndef _WIN32
+    // it goes with everyone else's in the next submit
+    if (uring != NULL && session->local == NULL)
+    {
+        listSend(client_id, *session);
+        return true;
+    }
+#endif
+
+    switch (flushQueues(*session)) {
+
+        case FLUSH_DONE:
+            watchWritable(client_id, false);
+            return true;
+
+        case FLUSH_BLOCKED:
+            watchWritable(client_id, true);
+            return true;
+
+        default:
             printf("send failed with error: %d\n", WSAGetLastError());
-            closesocket(currentSocket);
+            closeClient(client_id);
+            return false;
+    }
+}
+
+// queue data for one client and send what its socket takes now
+bool ServerNetwork::sendTo(unsigned int client_id, const char * data, int length, bool latestWins)
+{
+    Session * session = sessions.find(client_id);
+
+    if (session == NULL)
+        return false;
+
+    OutboundQueue * queue = session->out;
+
+    bool queued = latestWins ? queue->pushPose(data, length) : queue->push(data, length);
+
+    if (!queued)
+    {
+        printf("client %d is too slow, disconnecting\n", client_id);
+        Metrics::count(METRIC_SLOW_CLIENTS);
+        closeClient(client_id);
+        return false;
+    }
+
+    countFrames(data, length, 1);
+
+    if (session->waitingForWritable)
+        return true;
+
+    return flushClient(client_id);
+}
+
+// queue a shared buffer for one client and send what its socket takes
+bool ServerNetwork::sendShared(unsigned int client_id, SharedBuffer * buffer)
+{
+    Session * session = sessions.find(client_id);
+
+    if (session == NULL)
+        return false;
+
+    if (session->shared == NULL)
+        session->shared = new SharedQueue();
+
+    if (!session->shared->push(buffer))
+    {
+        printf("client %d is too slow, disconnecting\n", client_id);
+        Metrics::count(METRIC_SLOW_CLIENTS);
+        closeClient(client_id);
+        return false;
+    }
+
+    countFrames(buffer->data(), buffer->size(), 1);
+
+    if (session->waitingForWritable)
+        return true;
+
+    return flushClient(client_id);
+}
+
+void ServerNetwork::flushWritable()
+{
+#ifndef _WIN32
+    // the wait sent for them already
+    if (uring != NULL)
+        return;
+#endif
+
+    std::vector<unsigned int>::iterator iter;
+
+    for (iter = writableClients.begin(); iter != writableClients.end(); iter++)
+    {
+        if (sessions.contains(*iter))
+            flushClient(*iter);
+    }
+}
+
+// queue data for all clients and send what each socket takes now
+void ServerNetwork::sendToAll(const char * packets, int totalSize, bool latestWins)
+{
+    std::vector<unsigned int> dropped;
+    std::vector<unsigned int> blocked;
+
+    countFrames(packets, totalSize, sessions.size());
+
+    for (size_t i = 0; i < sessions.size(); i++)
+    {
+        unsigned int id = sessions.handleAt(i);
+        Session & session = sessions.valueAt(i);
+        OutboundQueue * queue = session.out;
+
+        bool queued = latestWins ? queue->pushPose(packets, totalSize) : queue->push(packets, totalSize);
+
+        if (!queued)
+        {
+            // it can't keep up with events it must not miss
+            printf("client %d is too slow, disconnecting\n", id);
+            Metrics::count(METRIC_SLOW_CLIENTS);
+            dropped.push_back(id);
+            continue;
+        }
+
+#ifndef _WIN32
+        if (uring != NULL && session.local == NULL)
+        {
+            listSend(id, session);
+            continue;
+        }
+#endif
+
+        // a client already waiting on its socket gets flushed when writable
+        if (!session.waitingForWritable)
+        {
+            int result = flushQueues(session);
+
+            if (result == FLUSH_ERROR)
+            {
+                printf("send failed with error: %d\n", WSAGetLastError());
+                dropped.push_back(id);
+            }
+            else if (result == FLUSH_BLOCKED)
+            {
+                blocked.push_back(id);
+            }
+        }
+    }
+
+    // sessions can only change once we are done walking them
+    for (size_t i = 0; i < blocked.size(); i++)
+        watchWritable(blocked[i], true);
+
+    for (size_t i = 0; i < dropped.size(); i++)
+        closeClient(dropped[i]);
+}
+
+int ServerNetwork::gatherQueues(Session & session, const char ** buffers, int * lengths)
+{
+    SharedQueue * shared = session.shared;
+    OutboundQueue * out = session.out;
+
+    // the stream can only switch queues between messages, like
+    // flushQueues
+    session.sharedFirst = shared != NULL && shared->partial();
+
+    int first;
+    int parts;
+
+    if (session.sharedFirst)
+    {
+        first = shared->gather(buffers, lengths, SEND_GATHER_MAX);
+        parts = first + out->gather(buffers + first, lengths + first, SEND_GATHER_MAX - first);
+    }
+    else
+    {
+        first = out->gather(buffers, lengths, SEND_GATHER_MAX);
+        parts = first;
+        if (shared != NULL)
+            parts += shared->gather(buffers + first, lengths + first, SEND_GATHER_MAX - first);
+    }
+
+    int total = 0;
+    int firstBytes = 0;
+
+    for (int p = 0; p < parts; p++)
+    {
+        total += lengths[p];
+        if (p < first)
+            firstBytes += lengths[p];
+    }
+
+    session.sending = total;
+    session.sendingFirst = firstBytes;
+
+    return parts;
+}
+
+bool ServerNetwork::consumeQueues(Session & session, int done)
+{
+    int fromFirst = done < session.sendingFirst ? done : session.sendingFirst;
+    int fromSecond = done - fromFirst;
+
+    if (session.sharedFirst)
+    {
+        session.shared->consume(fromFirst);
+        return session.out->consume(fromSecond);
+    }
+
+    bool kept = session.out->consume(fromFirst);
+    if (fromSecond > 0)
+        session.shared->consume(fromSecond);
+
+    return kept;
+}
+
+int ServerNetwork::receiveLocal(unsigned int client_id, Session & session, char * recvbuf, int bufSize, bool take)
+{
+    iResult = session.local->read(recvbuf, bufSize, take);
+
+    if (iResult == 0)
+    {
+        printf("Connection closed\n");
+        closeClient(client_id);
+    }
+
+    return iResult;
+}
+
+int ServerNetwork::flushLocal(Session & session)
+{
+    const char * buffers[SEND_GATHER_MAX];
+    int lengths[SEND_GATHER_MAX];
+
+    for (;;)
+    {
+        int parts = gatherQueues(session, buffers, lengths);
+        int total = session.sending;
+        session.sending = 0;
+
+        if (total == 0)
+            return FLUSH_DONE;
+
+        int done = session.local->write(buffers, lengths, parts);
+
+        if (done == SOCKET_ERROR)
+            return FLUSH_ERROR;
+
+        Metrics::count(METRIC_BYTES_OUT, done);
+
+        if (!consumeQueues(session, done))
+            return FLUSH_ERROR;
+
+        // the ring is full until the peer reads, which rings for us
+        if (done < total)
+        {
+            session.local->wantSpace(true);
+            return FLUSH_BLOCKED;
+        }
+    }
+}
+
+bool ServerNetwork::sleepLocal()
+{
+    for (size_t i = 0; i < localClients.size(); i++)
+    {
+        Session * session = sessions.find(localClients[i]);
+
+        if (session->waitingForWritable && session->local->writable())
+            return false;
+
+        if (!session->local->sleep())
+            return false;
+    }
+
+    return true;
+}
+
+void ServerNetwork::wakeLocal()
+{
+    std::vector<unsigned int> writable;
+    std::vector<unsigned int> dropped;
+
+    for (size_t i = 0; i < localClients.size(); i++)
+    {
+        unsigned int id = localClients[i];
+        Session * session = sessions.find(id);
+        LocalChannel * local = session->local;
+
+        local->quiet();
+
+        bool readable = local->readable();
+
+        // the peer is gone: what it sent is still read, but nothing
+        // will read what we would send
+        if (local->closed() && (!readable || session->waitingForWritable))
+        {
+            dropped.push_back(id);
+            continue;
         }
+
+        if (readable)
+            readyClients.push_back(id);
+
+        if (session->waitingForWritable && local->writable())
+            writable.push_back(id);
+    }
+
+    for (size_t i = 0; i < dropped.size(); i++)
+    {
+        printf("Connection closed\n");
+        closeClient(dropped[i]);
+    }
+
+    for (size_t i = 0; i < writable.size(); i++)
+    {
+#ifndef _WIN32
+        // io_uring sends as the wait ends: list those that got it all out
+        if (uring != NULL)
+        {
+            if (flushClient(writable[i]) && !sessions.find(writable[i])->waitingForWritable)
+                writableClients.push_back(writable[i]);
+            continue;
+        }
+#endif
+        writableClients.push_back(writable[i]);
+    }
+}
+
+void ServerNetwork::forgetLocal(unsigned int client_id, Session & session)
+{
+    localClients.erase(std::find(localClients.begin(), localClients.end(), client_id));
+
+#ifndef _WIN32
+    if (session.pollingDoorbell)
+        uring->cancel(uringKey(URING_DOORBELL, client_id));
+#endif
+}
+
+#ifndef _WIN32
+// wait on the ring: submit what the last pump queued, then reap
+int ServerNetwork::waitUring(int timeout_ms)
+{
+    for (size_t i = 0; i < readyClients.size(); i++)
+    {
+        Session * session = sessions.find(readyClients[i]);
+        if (session != NULL)
+            session->listedReady = false;
+    }
+
+    readyClients.clear();
+    writableClients.clear();
+    listenReady = false;
+    udpReady = false;
+
+    for (size_t i = 0; i < backlog.size(); i++)
+    {
+        Session * session = sessions.find(backlog[i]);
+        if (session != NULL && session->received != -1)
+            listReady(backlog[i], *session);
     }
+
+    backlog.clear();
+
+    // out of buffers: only worth another try once some came back,
+    // or every submit would fail it again
+    if (!starved.empty() && uring->recycled() != starvedAt)
+    {
+        for (size_t i = 0; i < starved.size(); i++)
+        {
+            Session * session = sessions.find(starved[i]);
+            if (session != NULL)
+                rearm(starved[i], *session);
+        }
+
+        starved.clear();
+    }
+
+    for (size_t i = 0; i < rearmList.size(); i++)
+    {
+        Session * session = sessions.find(rearmList[i]);
+        if (session != NULL && session->receiveArmed)
+            uring->receive(session->socket, uringKey(URING_RECEIVE, rearmList[i]));
+    }
+
+    rearmList.clear();
+
+    // local sessions' doorbells, for the wait to end on
+    for (size_t i = 0; i < localClients.size(); i++)
+    {
+        Session * session = sessions.find(localClients[i]);
+
+        if (!session->pollingDoorbell)
+        {
+            session->pollingDoorbell = true;
+            uring->pollReadable(session->socket, uringKey(URING_DOORBELL, localClients[i]));
+        }
+    }
+
+    int sends = submitSends();
+
+    // sends complete while they are submitted, so a wait with them in
+    // would end at once anyway: leave the waiting to the next pump
+    bool idle = sends == 0 && readyClients.empty() && sleepLocal();
+    uring->submit(idle ? 1 : 0, timeout_ms);
+
+    // nothing queued names them any more
+    for (size_t i = 0; i < closing.size(); i++)
+        closesocket(closing[i]);
+
+    closing.clear();
+
+    reapUring();
+    wakeLocal();
+
+    return (int)(readyClients.size() + writableClients.size());
+}
+
+void ServerNetwork::reapUring()
+{
+    UringCompletion done;
+
+    while (uring->complete(done))
+    {
+        if (done.key == URING_NO_KEY)
+            continue;
+
+        unsigned int id = (unsigned int)done.key;
+        uint64_t operation = done.key >> 32;
+        Session * session = sessions.find(id);
+
+        if (operation == URING_RECEIVE)
+        {
+            // bytes for a session closed since: nobody reads them
+            if (session == NULL || done.result <= 0)
+            {
+                if (done.buffer >= 0)
+                    uring->recycle(done.buffer);
+                if (session == NULL)
+                    continue;
+            }
+
+            // one buffer each: the next is armed here, or once read
+            session->receiveArmed = false;
+
+            if (done.result > 0)
+            {
+                chainNext[done.buffer] = -1;
+                chainLength[done.buffer] = done.result;
+
+                if (session->receivedLast == -1)
+                    session->received = done.buffer;
+                else
+                    chainNext[session->receivedLast] = done.buffer;
+
+                session->receivedLast = done.buffer;
+                session->receivedCount++;
+                listReady(id, *session);
+
+                // a session that doesn't read would take every buffer
+                // from the others: arm nothing more, and let its socket
+                // fill and tcp hold the peer back, as without io_uring
+                if (session->receivedCount >= URING_SESSION_BUFFERS)
+                    session->receivePaused = true;
+                else
+                    rearm(id, *session);
+            }
+            else if (done.result == -ENOBUFS)
+            {
+                // every buffer is in use, try again once some are back
+                starved.push_back(id);
+                starvedAt = uring->recycled();
+            }
+            else if (done.result == -ECANCELED)
+            {
+                rearm(id, *session);
+            }
+            else
+            {
+                // closed or failed, after whatever came before
+                session->receiveEnded = true;
+                listReady(id, *session);
+            }
+        }
+        else if (operation == URING_SEND)
+        {
+            if (session != NULL)
+                sent(id, *session, done.result);
+        }
+        else if (operation == URING_WRITABLE)
+        {
+            if (session != NULL)
+            {
+                session->pollingWritable = false;
+                listSend(id, *session);
+            }
+        }
+        else if (operation == URING_DOORBELL)
+        {
+            // rung, or hung up. the ring is looked at after the reap
+            if (session != NULL)
+            {
+                session->pollingDoorbell = false;
+                session->local->drain();
+            }
+        }
+    }
+}
+
+// one sendmsg per session with output, all in the coming submit
+int ServerNetwork::submitSends()
+{
+    const char * buffers[SEND_GATHER_MAX];
+    int lengths[SEND_GATHER_MAX];
+    int sends = 0;
+
+    for (size_t i = 0; i < sendList.size(); i++)
+    {
+        unsigned int id = sendList[i];
+        Session * session = sessions.find(id);
+
+        if (session == NULL)
+            continue;
+
+        session->listedSend = false;
+
+        // full: the poll lists it again
+        if (session->pollingWritable)
+            continue;
+
+        int parts = gatherQueues(*session, buffers, lengths);
+
+        if (session->sending == 0)
+            continue;
+
+        uring->send(session->socket, buffers, lengths, parts, uringKey(URING_SEND, id));
+        sends++;
+    }
+
+    sendList.clear();
+
+    return sends;
+}
+
+void ServerNetwork::sent(unsigned int client_id, Session & session, int result)
+{
+    int total = session.sending;
+    session.sending = 0;
+
+    if (result < 0 && result != -EAGAIN)
+    {
+        printf("send failed with error: %d\n", -result);
+        closeClient(client_id);
+        return;
+    }
+
+    int done = result > 0 ? result : 0;
+    Metrics::count(METRIC_BYTES_OUT, done);
+
+    if (!consumeQueues(session, done))
+    {
+        printf("client %d is too slow, disconnecting\n", client_id);
+        Metrics::count(METRIC_SLOW_CLIENTS);
+        closeClient(client_id);
+        return;
+    }
+
+    // a short write means the socket buffer is full
+    if (done < total)
+    {
+        session.waitingForWritable = true;
+        session.pollingWritable = true;
+        uring->pollWritable(session.socket, uringKey(URING_WRITABLE, client_id));
+        return;
+    }
+
+    // more than one send's worth was queued
+    if (!session.out->empty() || (session.shared != NULL && !session.shared->empty()))
+    {
+        listSend(client_id, session);
+        return;
+    }
+
+    if (session.waitingForWritable)
+    {
+        session.waitingForWritable = false;
+        writableClients.push_back(client_id);
+    }
+}
+
+void ServerNetwork::listReady(unsigned int client_id, Session & session)
+{
+    if (session.listedReady)
+        return;
+
+    session.listedReady = true;
+    readyClients.push_back(client_id);
+}
+
+void ServerNetwork::listSend(unsigned int client_id, Session & session)
+{
+    if (session.listedSend)
+        return;
+
+    session.listedSend = true;
+    sendList.push_back(client_id);
+}
+
+void ServerNetwork::rearm(unsigned int client_id, Session & session)
+{
+    if (session.receiveArmed || session.receivePaused || session.receiveEnded)
+        return;
+
+    session.receiveArmed = true;
+    rearmList.push_back(client_id);
+}
+
+int ServerNetwork::receiveUring(unsigned int client_id, char * recvbuf, int bufSize, bool take)
+{
+    Session * session = sessions.find(client_id);
+
+    if (session == NULL)
+        return 0;
+
+    int copied = 0;
+    int buffer = session->received;
+    int offset = session->receivedOffset;
+
+    while (buffer != -1 && copied < bufSize)
+    {
+        int count = chainLength[buffer] - offset;
+        if (count > bufSize - copied)
+            count = bufSize - copied;
+
+        memcpy(recvbuf + copied, uring->buffer(buffer) + offset, count);
+        copied += count;
+        offset += count;
+
+        if (offset == chainLength[buffer])
+        {
+            int next = chainNext[buffer];
+            if (take)
+            {
+                uring->recycle(buffer);
+                session->receivedCount--;
+            }
+            buffer = next;
+            offset = 0;
+        }
+    }
+
+    if (take)
+    {
+        session->received = buffer;
+        session->receivedOffset = offset;
+        if (buffer == -1)
+            session->receivedLast = -1;
+
+        // read down far enough to take more again
+        if (session->receivePaused && session->receivedCount <= URING_SESSION_BUFFERS / 2)
+        {
+            session->receivePaused = false;
+            rearm(client_id, *session);
+        }
+    }
+
+    if (copied > 0)
+    {
+        if (session->received != -1)
+            backlog.push_back(client_id);
+        return copied;
+    }
+
+    if (session->receiveEnded)
+    {
+        printf("Connection closed\n");
+        closeClient(client_id);
+        return 0;
+    }
+
+    // nothing yet, like a nonblocking recv
+    errno = EAGAIN;
+    return SOCKET_ERROR;
+}
+
+void ServerNetwork::forgetUring(unsigned int client_id, Session & session)
+{
+    uring->cancel(uringKey(URING_RECEIVE, client_id));
+
+    if (session.pollingWritable)
+        uring->cancel(uringKey(URING_WRITABLE, client_id));
+
+    int buffer = session.received;
+
+    while (buffer != -1)
+    {
+        int next = chainNext[buffer];
+        uring->recycle(buffer);
+        buffer = next;
+    }
+
+    session.received = -1;
+    session.receivedLast = -1;
+    session.receivedCount = 0;
 }
+#endif
@@ -1,31 +1,178 @@
 #pragma once
-#include <winsock2.h>
-#include <Windows.h>
 #include "NetworkServices.h"
+#ifdef _WIN32
 #include <ws2tcpip.h>
+#pragma comment (lib, "Ws2_32.lib")
+#else
+#include <sys/epoll.h>
+#include "UringEngine.h"
+#endif
 #include <map>
+#include <vector>
 #include "NetworkData.h"
-using namespace std; 
-#pragma comment (lib, "Ws2_32.lib")
+#include "UdpTransport.h"
+#include "OutboundQueue.h"
+#include "SharedBuffer.h"
+#include "SessionTable.h"
+#include "LocalChannel.h"
+#include "TimerWheel.h"
+using namespace std;
 
 #define DEFAULT_BUFLEN 512
-#define DEFAULT_PORT "6881" 
+#define DEFAULT_PORT "6881"
+
+// most readiness events handled per waitForEvents call
+#define MAX_EVENTS 256
+
+// a session not heard from in this long is closed, once the owner
+// turns idle timeouts on
+#define IDLE_TIMEOUT_MS 10000
+
+// a session quiet for this long is listed for the owner to ping, once
+// it turns heartbeats on
+#define HEARTBEAT_INTERVAL_MS 2000
+
+// how a ServerNetwork waits for its sockets and moves their bytes
+enum NetworkEngines {
+
+    ENGINE_POLL = 0,        // epoll (WSAPoll on Windows), a syscall per recv and send
+
+    ENGINE_URING = 1,       // io_uring, Linux only and for adopted sockets only
+
+};
+
+// kinds of timer on a ServerNetwork's wheel
+enum NetworkTimers {
+
+    TIMER_SESSION = 0,      // a session's heartbeat and idle check, the network's own
+
+    TIMER_OWNER = 1,        // the owner numbers its kinds from here
+
+};
+
+// one connected client
+struct Session
+{
+    SOCKET socket = INVALID_SOCKET;
+    OutboundQueue * out = NULL;
+
+    // shared buffers for this client, made on the first sendShared
+    SharedQueue * shared = NULL;
+
+    // the owner asked to hear when the socket is writable again
+    bool waitingForWritable = false;
+
+    // when data last came in, the wheel's time, and the timer that
+    // checks on it (0 = none)
+    uint64_t heardAt = 0;
+    uint64_t timer = 0;
+
+    // a client on this host, talking through shared memory. socket is
+    // then only its doorbell
+    LocalChannel * local = NULL;
+
+    // io_uring only. provided buffers received into and not read yet,
+    // oldest first, and how much of the oldest was read
+    int received = -1;
+    int receivedLast = -1;
+    int receivedOffset = 0;
+
+    // how many buffers that is
+    int receivedCount = 0;
+
+    // a receive is armed, or will be at the next submit
+    bool receiveArmed = false;
+
+    // it holds URING_SESSION_BUFFERS: no receive is armed until it is
+    // read down to half of them
+    bool receivePaused = false;
+
+    // the receive ended: the next read after the data reports it
+    bool receiveEnded = false;
+
+    // listed in readyClients for this wait, or to send at the next
+    bool listedReady = false;
+    bool listedSend = false;
+
+    // a poll for writable is armed, or one on a local session's
+    // doorbell
+    bool pollingWritable = false;
+    bool pollingDoorbell = false;
+
+    // bytes of the send in the current submit, and how many of them
+    // came from the queue that went first
+    int sending = 0;
+    int sendingFirst = 0;
+    bool sharedFirst = false;
+};
 
 class ServerNetwork
 {
 public:
-    ServerNetwork(void);
+    // listen on port for tcp, plus udp on the same port number when
+    // datagrams is set. a NULL port only serves adopted sockets.
+    //
+    // With a port, clients on the same host can connect through shared
+    // memory as well (LocalChannel, Linux only). Their sessions work
+    // like any other, on either engine.
+    //
+    // ENGINE_URING receives into buffers the kernel picks, a bounded
+    // number per session, and sends what every session queued in one
+    // submit per waitForEvents instead of as it is queued. It falls back to
+    // ENGINE_POLL where io_uring isn't available, and for a network
+    // that listens
+    ServerNetwork(const char * port = DEFAULT_PORT, bool datagrams = true, int engine = ENGINE_POLL);
     ~ServerNetwork(void);
 
-	// send data to all clients
-    void sendToAll(char * packets, int totalSize);
+	// wait up to timeout_ms for socket activity (0 = just check)
+	// and remember which sockets are ready. a timer coming due cuts
+	// the wait short
+	int waitForEvents(int timeout_ms);
+
+	// queue data for all clients and send what the sockets take now.
+	// latestWins data is a pose that a newer one may replace
+    void sendToAll(const char * packets, int totalSize, bool latestWins = false);
+
+	// queue data for one client and send what its socket takes now.
+	// false if the client was dropped
+	bool sendTo(unsigned int client_id, const char * data, int length, bool latestWins = false);
+
+	// queue a reference to a buffer many clients are sent, behind
+	// what sendTo queued, and send what the socket takes now. false if
+	// the client was dropped
+	bool sendShared(unsigned int client_id, SharedBuffer * buffer);
+
+	// send what is queued for clients whose sockets became writable
+	void flushWritable();
 
 	// receive incoming data
-    int receiveData(unsigned int client_id, char * recvbuf);
-	
-	// accept new connections
+    int receiveData(unsigned int client_id, char * recvbuf, int bufSize);
+
+	// look at incoming data without taking it, to decide where the
+	// connection goes before anything reads it
+	int peekData(unsigned int client_id, char * recvbuf, int bufSize);
+
+	// close a client's socket and forget its session
+	void closeClient(unsigned int client_id);
+
+	// forget a session without closing its socket, which the caller
+	// now owns. INVALID_SOCKET for an unknown session. a local
+	// session's socket comes with its channel, which channel is set to
+	// (NULL for others); without channel, a local session is closed
+	SOCKET releaseClient(unsigned int client_id, LocalChannel ** channel = NULL);
+
+	// accept new connections, setting id to the new session's handle
     bool acceptNewClient(unsigned int & id);
 
+	// accept a connection to hand to another ServerNetwork, or
+	// INVALID_SOCKET once none are waiting
+	SOCKET acceptSocket();
+
+	// start a session for a socket accepted elsewhere and return its
+	// handle, or close it and return INVALID_SESSION when full. with a
+	// channel, socket is the local session's doorbell
+	unsigned int adoptClient(SOCKET socket, LocalChannel * channel = NULL);
+
     // Socket to listen for new connections
     SOCKET ListenSocket;
 
@@ -35,7 +182,174 @@ public:
     // for error checking return values
     int iResult;
 
-    // table to keep track of each client's socket
-    std::map<unsigned int, SOCKET> sessions; 
-};
+    // every client's socket and output queue, by session handle. a
+    // handle is never reused while the owner may still hold it
+    SessionTable<Session> sessions;
+
+	// clients with data waiting after the last waitForEvents
+	std::vector<unsigned int> readyClients;
+
+	// clients with queued output whose sockets can take more. with
+	// io_uring: clients whose sockets took all that was queued
+	std::vector<unsigned int> writableClients;
 
+	// sessions closed since the owner last cleared this, whether it
+	// asked for it or a recv or send failed
+	std::vector<unsigned int> closedClients;
+
+	// bytes a slow client may have queued before it is dropped
+	unsigned int send_high_water;
+
+	// Timers, turned by every waitForEvents. The network keeps one per
+	// session on it (TIMER_SESSION); the owner can schedule its own
+	// kinds, which are listed in expiredTimers once due.
+	//
+	// A session's timer isn't moved for every message: it fires at the
+	// first check that could be due, looks at when data last came in,
+	// and is scheduled again from there. So a busy session costs a
+	// store per receive and a timer per heartbeat interval.
+	TimerWheel timers;
+
+	// sessions silent this long are listed in quietClients, again each
+	// interval they stay silent (0 = off). set before clients arrive
+	unsigned int heartbeat_ms;
+
+	// sessions silent this long are closed (0 = off). set before
+	// clients arrive
+	unsigned int idle_timeout_ms;
+
+	// sessions listed for a heartbeat in the last waitForEvents: the
+	// owner sends them something they answer
+	std::vector<unsigned int> quietClients;
+
+	// owner's timers that came due, in the order they did, until the
+	// owner clears this
+	std::vector<TimerEvent> expiredTimers;
+
+	// a connection is waiting to be accepted
+	bool listenReady;
+
+	// datagram side on the same port number: reliable events plus
+	// unreliable poses. NULL without datagrams
+	UdpTransport * udp;
+
+	// datagrams are waiting
+	bool udpReady;
+
+	// NetworkEngines in use
+	int engine;
+
+private:
+
+	// per client output, out of one pool
+	BufferPool sendPool;
+
+	// waitForEvents without the timers
+	int waitSockets(int timeout_ms);
+
+	// take what came due off the wheel. returns the owner's timers
+	// and sessions listed
+	int expireTimers();
+
+	// close a session silent too long, list one due a heartbeat, and
+	// schedule its next check
+	void checkSilence(unsigned int client_id, Session & session);
+
+	// push a client's queue out; false if the client had to be dropped
+	bool flushClient(unsigned int client_id);
+
+	// write both of a session's queues, FlushResults
+	int flushQueues(Session & session);
+
+	// ask to hear when a client's socket can take more output
+	void watchWritable(unsigned int client_id, bool enable);
+
+	// point at both of a session's queues in the order they go out,
+	// noting in it how many bytes that is and how many came from the
+	// queue that goes first. returns the parts filled
+	int gatherQueues(Session & session, const char ** buffers, int * lengths);
+
+	// done bytes of what gatherQueues pointed at went out. false if
+	// the session's queue has no room left for the rest of a pose
+	bool consumeQueues(Session & session, int done);
+
+	// socket local connections arrive on, INVALID_SOCKET without
+	SOCKET localListener;
+
+	// a local connection is waiting to be accepted
+	bool localReady;
+
+	// sessions with a LocalChannel, whose rings each wait looks at
+	std::vector<unsigned int> localClients;
+
+	LocalChannel * acceptLocal();
+
+	// copy what a local session's ring holds, like receiveData
+	int receiveLocal(unsigned int client_id, Session & session, char * recvbuf, int bufSize, bool take);
+
+	// write a local session's queues into its ring, FlushResults
+	int flushLocal(Session & session);
+
+	// before a wait that may sleep: false if a local session has
+	// something already, otherwise every doorbell is armed
+	bool sleepLocal();
+
+	// after the wait: disarm, and list local sessions with something
+	// to read or room they were waiting for
+	void wakeLocal();
+
+	// drop a closed or released session from localClients
+	void forgetLocal(unsigned int client_id, Session & session);
+
+#ifndef _WIN32
+	// epoll instance watching the listen socket and every session
+	int epollFd;
+
+	// ENGINE_URING: the ring and what it needs between waits. NULL for
+	// epoll
+	UringEngine * uring;
+
+	// per provided buffer: the next in its session's list, and the
+	// bytes it holds
+	std::vector<int> chainNext;
+	std::vector<int> chainLength;
+
+	// sessions to send for, and to arm a receive for again, at the
+	// next submit
+	std::vector<unsigned int> sendList;
+	std::vector<unsigned int> rearmList;
+
+	// sessions whose receive found no buffer left, armed again once
+	// some were given back after that (recycled past starvedAt)
+	std::vector<unsigned int> starved;
+	uint64_t starvedAt;
+
+	// sessions a read left bytes for, listed ready again on the next
+	// wait the way a level triggered poll would
+	std::vector<unsigned int> backlog;
+
+	// closed sockets, kept open until the next submit has gone: queued
+	// operations still name their descriptors
+	std::vector<SOCKET> closing;
+
+	int waitUring(int timeout_ms);
+	void reapUring();
+	int submitSends();
+
+	// a send's result came back
+	void sent(unsigned int client_id, Session & session, int result);
+
+	void listReady(unsigned int client_id, Session & session);
+	void listSend(unsigned int client_id, Session & session);
+
+	// arm a session's receive at the next submit, unless it is armed,
+	// paused or ended
+	void rearm(unsigned int client_id, Session & session);
+
+	// copy received bytes out, taking them unless peeking
+	int receiveUring(unsigned int client_id, char * recvbuf, int bufSize, bool take);
+
+	// cancel a session's operations and drop what it received
+	void forgetUring(unsigned int client_id, Session & session);
+#endif
+};
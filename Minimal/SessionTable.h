@@ -0,0 +1,128 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// low bits of a session handle pick the slot, the rest count how often
+// the slot has been reused. the top bit is never set, so handles stay
+// clear of the ids handed to datagram peers
+#define SESSION_SLOT_BITS 16
+#define SESSION_GENERATION_BITS 15
+#define MAX_SESSIONS (1u << SESSION_SLOT_BITS)
+
+#define INVALID_SESSION 0xFFFFFFFFu
+
+// Dense table of sessions addressed by generational handles.
+//
+// Slots are kept in an array and reused through a free list, so insert
+// and remove are O(1). A removed slot's generation is bumped, which
+// makes every old handle to it stale: find and contains reject them
+// rather than hitting whoever got the slot next. Active handles are
+// also packed into their own array so walking the sessions touches
+// only live ones; remove fills the hole with the last entry, so the
+// order changes and sessions must not be removed while iterating.
+template <typename T>
+class SessionTable
+{
+public:
+    SessionTable(void) : freeHead(NO_SLOT) {}
+
+    // INVALID_SESSION when every slot is taken
+    unsigned int insert(const T & value)
+    {
+        uint32_t index;
+
+        if (freeHead != NO_SLOT)
+        {
+            index = freeHead;
+            freeHead = slots[index].nextFree;
+        }
+        else if (slots.size() < MAX_SESSIONS)
+        {
+            index = (uint32_t)slots.size();
+            slots.push_back(Slot());
+        }
+        else
+        {
+            return INVALID_SESSION;
+        }
+
+        Slot & slot = slots[index];
+        slot.value = value;
+        slot.denseIndex = (uint32_t)dense.size();
+
+        unsigned int handle = (slot.generation << SESSION_SLOT_BITS) | index;
+        dense.push_back(handle);
+
+        return handle;
+    }
+
+    // false for a stale or unknown handle
+    bool remove(unsigned int handle)
+    {
+        Slot * slot = live(handle);
+
+        if (slot == NULL)
+            return false;
+
+        // move the last active handle into the hole
+        unsigned int last = dense.back();
+        dense[slot->denseIndex] = last;
+        slots[last & (MAX_SESSIONS - 1)].denseIndex = slot->denseIndex;
+        dense.pop_back();
+
+        uint32_t index = handle & (MAX_SESSIONS - 1);
+        slot->value = T();
+        slot->denseIndex = NO_SLOT;
+        slot->generation = (slot->generation + 1) & ((1u << SESSION_GENERATION_BITS) - 1);
+        slot->nextFree = freeHead;
+        freeHead = index;
+
+        return true;
+    }
+
+    // NULL for a stale or unknown handle
+    T * find(unsigned int handle)
+    {
+        Slot * slot = live(handle);
+        return slot != NULL ? &slot->value : NULL;
+    }
+
+    bool contains(unsigned int handle) const
+    {
+        uint32_t index = handle & (MAX_SESSIONS - 1);
+
+        return index < slots.size() && slots[index].denseIndex != NO_SLOT &&
+               (handle >> SESSION_SLOT_BITS) == slots[index].generation;
+    }
+
+    size_t size() const { return dense.size(); }
+    bool empty() const { return dense.empty(); }
+
+    // the i-th active session, 0 <= i < size()
+    unsigned int handleAt(size_t i) const { return dense[i]; }
+    T & valueAt(size_t i) { return slots[dense[i] & (MAX_SESSIONS - 1)].value; }
+
+private:
+    static const uint32_t NO_SLOT = 0xFFFFFFFFu;
+
+    struct Slot
+    {
+        T value = T();
+        uint32_t generation = 0;
+        uint32_t denseIndex = NO_SLOT;
+        uint32_t nextFree = NO_SLOT;
+    };
+
+    Slot * live(unsigned int handle)
+    {
+        if (!contains(handle))
+            return NULL;
+
+        return &slots[handle & (MAX_SESSIONS - 1)];
+    }
+
+    std::vector<Slot> slots;
+    std::vector<unsigned int> dense;
+    uint32_t freeHead;
+};
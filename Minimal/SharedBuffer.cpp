@@ -0,0 +1,115 @@
+#include "SharedBuffer.h"
+#include <new>
+#include <string.h>
+#include <stdlib.h>
+
+SharedBuffer * SharedBuffer::create(const char * data, int length)
+{
+    void * memory = malloc(sizeof(SharedBuffer) + length);
+
+    if (memory == NULL)
+        return NULL;
+
+    SharedBuffer * buffer = new (memory) SharedBuffer(length);
+    memcpy((char *)memory + sizeof(SharedBuffer), data, length);
+
+    return buffer;
+}
+
+void SharedBuffer::release()
+{
+    // the last owner must see every other owner's reads finished
+    if (references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    this->~SharedBuffer();
+    free(this);
+}
+
+SharedQueue::SharedQueue(void) : head(0), count(0), offset(0)
+{
+}
+
+SharedQueue::~SharedQueue(void)
+{
+    for (int i = 0; i < count; i++)
+        ring[(head + i) % SHARED_QUEUE_LENGTH]->release();
+}
+
+bool SharedQueue::push(SharedBuffer * buffer)
+{
+    if (count == SHARED_QUEUE_LENGTH)
+        return false;
+
+    buffer->retain();
+    ring[(head + count) % SHARED_QUEUE_LENGTH] = buffer;
+    count++;
+
+    return true;
+}
+
+int SharedQueue::flush(SOCKET socket)
+{
+    const char * buffers[SEND_GATHER_MAX];
+    int lengths[SEND_GATHER_MAX];
+
+    while (count > 0)
+    {
+        int parts = gather(buffers, lengths, SEND_GATHER_MAX);
+        int total = 0;
+
+        for (int i = 0; i < parts; i++)
+            total += lengths[i];
+
+        int sent = NetworkServices::sendGather(socket, buffers, lengths, parts);
+
+        if (sent == SOCKET_ERROR)
+            return NetworkServices::wouldBlock() ? FLUSH_BLOCKED : FLUSH_ERROR;
+
+        consume(sent);
+
+        // a short write means the socket buffer is full
+        if (sent < total)
+            return FLUSH_BLOCKED;
+    }
+
+    return FLUSH_DONE;
+}
+
+int SharedQueue::gather(const char ** buffers, int * lengths, int max) const
+{
+    int parts = count < max ? count : max;
+
+    for (int i = 0; i < parts; i++)
+    {
+        SharedBuffer * buffer = ring[(head + i) % SHARED_QUEUE_LENGTH];
+        int skip = i == 0 ? offset : 0;
+
+        buffers[i] = buffer->data() + skip;
+        lengths[i] = buffer->size() - skip;
+    }
+
+    return parts;
+}
+
+void SharedQueue::consume(int sent)
+{
+    // let go of everything that went out whole
+    while (count > 0)
+    {
+        SharedBuffer * buffer = ring[head];
+        int remaining = buffer->size() - offset;
+
+        if (sent < remaining)
+        {
+            offset += sent;
+            return;
+        }
+
+        sent -= remaining;
+        buffer->release();
+        head = (head + 1) % SHARED_QUEUE_LENGTH;
+        count--;
+        offset = 0;
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "NetworkServices.h"
+#include "OutboundQueue.h"
+
+// buffers a slow subscriber may have queued before it is dropped
+#define SHARED_QUEUE_LENGTH 256
+
+// An encoded message many connections send as is. It is written once
+// when created and never changed after, so every subscriber's queue
+// holds a reference to the same bytes instead of a copy; the last
+// release frees it.
+class SharedBuffer
+{
+public:
+    // one allocation holding the count and a copy of data. the caller
+    // holds the first reference
+    static SharedBuffer * create(const char * data, int length);
+
+    void retain() { references.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+
+    const char * data() const { return (const char *)(this + 1); }
+    int size() const { return length; }
+
+private:
+    SharedBuffer(int bytes) : references(1), length(bytes) {}
+    SharedBuffer(const SharedBuffer &);
+    SharedBuffer & operator=(const SharedBuffer &);
+
+    std::atomic<int> references;
+    int length;
+};
+
+// Shared buffers waiting to go out on one connection, in order. A
+// flush hands the socket every queued buffer in one gather call and
+// resumes after partial writes, so a burst costs one syscall and no
+// copies however many updates it holds.
+class SharedQueue
+{
+public:
+    SharedQueue(void);
+    ~SharedQueue(void);
+
+    // queue a reference to buffer. false if the queue is full
+    bool push(SharedBuffer * buffer);
+
+    // write as much as the socket takes, FlushResults
+    int flush(SOCKET socket);
+
+    // point at what is queued, oldest first, for a caller sending it
+    // some other way. up to max parts; returns the number filled
+    int gather(const char ** buffers, int * lengths, int max) const;
+
+    // sent bytes of what gather pointed at went out
+    void consume(int sent);
+
+    bool empty() const { return count == 0; }
+
+    // the oldest buffer is part way out
+    bool partial() const { return offset > 0; }
+
+private:
+    SharedQueue(const SharedQueue &);
+    SharedQueue & operator=(const SharedQueue &);
+
+    SharedBuffer * ring[SHARED_QUEUE_LENGTH];
+    int head;
+    int count;
+
+    // bytes of the head buffer already sent
+    int offset;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free queue for exactly one producer thread and one
+// consumer thread. Capacity must be a power of two. A push onto a full
+// queue fails and is counted instead of blocking the producer.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+public:
+    SpscQueue(void) : head(0), tail(0), droppedCount(0), highWater(0) {}
+
+    // producer side
+    bool push(const T & item)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        uint32_t h = head.load(std::memory_order_acquire);
+
+        if (t - h == Capacity)
+        {
+            droppedCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        items[t & (Capacity - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+
+        if (t + 1 - h > highWater.load(std::memory_order_relaxed))
+            highWater.store(t + 1 - h, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    // consumer side
+    bool pop(T & item)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t t = tail.load(std::memory_order_acquire);
+
+        if (h == t)
+            return false;
+
+        item = items[h & (Capacity - 1)];
+        head.store(h + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // consumer side: look at the next item without taking it
+    bool peek(T & item) const
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        uint32_t t = tail.load(std::memory_order_acquire);
+
+        if (h == t)
+            return false;
+
+        item = items[h & (Capacity - 1)];
+        return true;
+    }
+
+    // either side, approximate while the other side is running
+    uint32_t depth() const
+    {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    // pushes refused because the queue was full
+    uint32_t dropped() const { return droppedCount.load(std::memory_order_relaxed); }
+
+    // deepest the queue has been
+    uint32_t maxDepth() const { return highWater.load(std::memory_order_relaxed); }
+
+private:
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+    T items[Capacity];
+
+    // consumer and producer indices on separate cache lines
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+
+    // written by the producer only
+    alignas(64) std::atomic<uint32_t> droppedCount;
+    std::atomic<uint32_t> highWater;
+};
@@ -0,0 +1,263 @@
+#include "TimerWheel.h"
+
+#define SLOTS (1 << TIMER_WHEEL_BITS)
+#define MASK (SLOTS - 1)
+
+// lists past the slots: timers that came due, and free nodes
+#define DUE (TIMER_WHEEL_LEVELS * SLOTS)
+#define FREE -1
+
+TimerWheel::TimerWheel(uint64_t now_us)
+    : heads(DUE + 1, -1), dueTail(-1), freeList(-1), live(0), current(now_us / TIMER_TICK_US)
+{
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++)
+        counts[level] = 0;
+}
+
+uint64_t TimerWheel::schedule(uint64_t at_us, int kind, uint64_t key)
+{
+    int index = freeList;
+
+    if (index != -1)
+        freeList = nodes[index].next;
+    else
+    {
+        index = (int)nodes.size();
+        nodes.push_back(Node());
+        nodes[index].generation = 1;
+    }
+
+    Node & node = nodes[index];
+
+    // rounded up, so a timer never fires before its time
+    node.tick = (at_us + TIMER_TICK_US - 1) / TIMER_TICK_US;
+    node.kind = kind;
+    node.key = key;
+    live++;
+
+    place(index);
+
+    return (uint64_t)node.generation << 32 | (uint64_t)(index + 1);
+}
+
+void TimerWheel::cancel(uint64_t handle)
+{
+    if (handle == 0)
+        return;
+
+    size_t index = (size_t)(handle & 0xFFFFFFFF) - 1;
+
+    if (index >= nodes.size() || nodes[index].generation != (uint32_t)(handle >> 32) || nodes[index].list == FREE)
+        return;
+
+    unlink((int)index);
+
+    nodes[index].generation++;
+    nodes[index].list = FREE;
+    nodes[index].next = freeList;
+    freeList = (int)index;
+    live--;
+}
+
+void TimerWheel::advance(uint64_t now_us)
+{
+    uint64_t target = now_us / TIMER_TICK_US;
+
+    while (current < target)
+    {
+        if (counts[0] == 0)
+        {
+            // nothing in the wheel at all: no tick can fire anything
+            size_t waiting = 0;
+            for (int level = 1; level < TIMER_WHEEL_LEVELS; level++)
+                waiting += counts[level];
+
+            // nothing on the first level before it turns over: skip to
+            // where the levels above may cascade into it
+            uint64_t last = current | MASK;
+
+            if (waiting == 0 || last >= target)
+            {
+                current = target;
+                break;
+            }
+
+            current = last;
+        }
+
+        current++;
+
+        // a level turns into its next slot when every one below
+        // turned over. highest first: what comes down from there may
+        // belong in the slot the next one down is turning into
+        if ((current & MASK) == 0)
+        {
+            for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--)
+            {
+                if ((current & ((1ull << (TIMER_WHEEL_BITS * level)) - 1)) == 0)
+                    cascade(level);
+            }
+        }
+
+        // everything in the first level's slot is due this tick
+        cascade(0);
+    }
+}
+
+bool TimerWheel::expired(TimerEvent & event)
+{
+    int index = heads[DUE];
+
+    if (index == -1)
+        return false;
+
+    unlink(index);
+
+    Node & node = nodes[index];
+    event.kind = node.kind;
+    event.key = node.key;
+
+    node.generation++;
+    node.list = FREE;
+    node.next = freeList;
+    freeList = index;
+    live--;
+
+    return true;
+}
+
+int TimerWheel::timeout(uint64_t now_us, int timeout_ms) const
+{
+    if (heads[DUE] != -1)
+        return 0;
+
+    uint64_t digit = current & MASK;
+    uint64_t ticks = 0;
+
+    if (counts[0] > 0)
+    {
+        // the first level only holds ticks of this turn, after now
+        for (uint64_t slot = digit + 1; slot < SLOTS && ticks == 0; slot++)
+        {
+            if (heads[slot] != -1)
+                ticks = slot - digit;
+        }
+    }
+    else
+    {
+        for (int level = 1; level < TIMER_WHEEL_LEVELS && ticks == 0; level++)
+        {
+            // the next cascade, which may bring something due
+            if (counts[level] > 0)
+                ticks = SLOTS - digit;
+        }
+    }
+
+    if (ticks == 0)
+        return timeout_ms;
+
+    // counted from now_us, which may be past the last advance: time
+    // spent since then comes off the wait
+    uint64_t due_us = (current + ticks) * TIMER_TICK_US;
+
+    if (due_us <= now_us)
+        return 0;
+
+    uint64_t ms = (due_us - now_us + 999) / 1000;
+
+    if (timeout_ms >= 0 && (uint64_t)timeout_ms < ms)
+        return timeout_ms;
+
+    return (int)ms;
+}
+
+void TimerWheel::place(int index)
+{
+    uint64_t tick = nodes[index].tick;
+
+    if (tick <= current)
+    {
+        link(index, DUE);
+        return;
+    }
+
+    // the lowest level above which the tick and now agree. past the
+    // last level's reach the timer waits in its slot there, and is
+    // placed again each time the wheel comes round to it
+    int level = 0;
+
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+        (tick >> (TIMER_WHEEL_BITS * (level + 1))) != (current >> (TIMER_WHEEL_BITS * (level + 1))))
+        level++;
+
+    int slot = (int)((tick >> (TIMER_WHEEL_BITS * level)) & MASK);
+
+    link(index, level * SLOTS + slot);
+}
+
+void TimerWheel::cascade(int level)
+{
+    int list = level * SLOTS + (int)((current >> (TIMER_WHEEL_BITS * level)) & MASK);
+    int index = heads[list];
+
+    // taken off whole first: a timer still far off goes back in here
+    heads[list] = -1;
+
+    while (index != -1)
+    {
+        int next = nodes[index].next;
+
+        counts[level]--;
+        place(index);
+
+        index = next;
+    }
+}
+
+void TimerWheel::link(int index, int list)
+{
+    Node & node = nodes[index];
+    node.list = list;
+
+    if (list == DUE)
+    {
+        // fired in the order they came due
+        node.prev = dueTail;
+        node.next = -1;
+
+        if (dueTail != -1)
+            nodes[dueTail].next = index;
+        else
+            heads[DUE] = index;
+
+        dueTail = index;
+        return;
+    }
+
+    node.prev = -1;
+    node.next = heads[list];
+
+    if (node.next != -1)
+        nodes[node.next].prev = index;
+
+    heads[list] = index;
+    counts[list / SLOTS]++;
+}
+
+void TimerWheel::unlink(int index)
+{
+    Node & node = nodes[index];
+
+    if (node.prev != -1)
+        nodes[node.prev].next = node.next;
+    else
+        heads[node.list] = node.next;
+
+    if (node.next != -1)
+        nodes[node.next].prev = node.prev;
+    else if (node.list == DUE)
+        dueTail = node.prev;
+
+    if (node.list != DUE)
+        counts[node.list / SLOTS]--;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// resolution of a TimerWheel: timers fire on the first advance at or
+// after the tick they are due in
+#define TIMER_TICK_US 1000
+
+// levels, and slots per level as a power of two. four levels of 256
+// one millisecond ticks reach 49 days ahead
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_BITS 8
+
+// what a timer was scheduled with, once it is due
+struct TimerEvent
+{
+    // owner's numbering of what the timer is for
+    int kind;
+
+    // which one: a session, a match, ...
+    uint64_t key;
+};
+
+// Hashed hierarchical timer wheel.
+//
+// Each level is a ring of slots, each slot a list of timers; a slot of
+// level n spans 256^n ticks. A timer goes in the lowest level whose
+// span still reaches its tick, and as the wheel turns into a slot of a
+// higher level the timers there move down to where they are due, the
+// last level being the one that fires them. Scheduling, cancelling and
+// firing are O(1); a tick that fires nothing looks at one slot, and a
+// run of ticks with nothing on the first level is skipped whole.
+//
+// Timers are nodes in one array linked by index, reused through a free
+// list, so a busy wheel allocates nothing. Not thread safe: each
+// network thread owns its own.
+class TimerWheel
+{
+public:
+    // the wheel's time starts at now_us
+    TimerWheel(uint64_t now_us);
+
+    // fire at at_us, or the first advance after it if that is past.
+    // returns the timer's handle, never 0
+    uint64_t schedule(uint64_t at_us, int kind, uint64_t key);
+
+    // forget a timer that hasn't been taken by expired yet. a handle
+    // that already fired, was cancelled, or is 0 is ignored
+    void cancel(uint64_t handle);
+
+    // turn the wheel to now_us, queueing what came due for expired
+    void advance(uint64_t now_us);
+
+    // take the next timer that came due, oldest first. false once none
+    // are left
+    bool expired(TimerEvent & event);
+
+    // timeout_ms (-1 = forever) cut short so a wait starting at now_us
+    // ends by the time the next timer may be due. the wheel may not
+    // have been advanced to now_us yet: the wait is what is left from
+    // there, so it may wake early, never late
+    int timeout(uint64_t now_us, int timeout_ms) const;
+
+    // the time of the last advance, in microseconds
+    uint64_t now() const { return current * TIMER_TICK_US; }
+
+    // timers scheduled and not yet taken
+    size_t size() const { return live; }
+
+private:
+    TimerWheel(const TimerWheel &);
+    TimerWheel & operator=(const TimerWheel &);
+
+    struct Node
+    {
+        uint64_t tick;
+        uint64_t key;
+        int kind;
+
+        // bumped each time the node is freed, so old handles miss
+        uint32_t generation;
+
+        // neighbours in its list, and which list: a slot, DUE or FREE
+        int prev;
+        int next;
+        int list;
+    };
+
+    // put a node in the slot its tick belongs in, or on the due list
+    void place(int index);
+
+    // move a slot's timers down to where they belong now
+    void cascade(int level);
+
+    void link(int index, int list);
+    void unlink(int index);
+
+    // the slot lists of every level, then the due list
+    std::vector<int> heads;
+    int dueTail;
+
+    // timers on each level
+    size_t counts[TIMER_WHEEL_LEVELS];
+
+    std::vector<Node> nodes;
+    int freeList;
+    size_t live;
+
+    // ticks since the epoch, as of the last advance
+    uint64_t current;
+};
@@ -0,0 +1,480 @@
+#include "UdpTransport.h"
+#include "Metrics.h"
+#include <chrono>
+
+// most datagrams read per receive() call, so one busy peer can't starve the loop
+#define MAX_READS_PER_RECEIVE 1024
+
+static void put16(char * p, uint16_t v)
+{
+    p[0] = (char)(v & 0xFF);
+    p[1] = (char)(v >> 8);
+}
+
+static void put32(char * p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (char)((v >> (8 * i)) & 0xFF);
+}
+
+static uint16_t get16(const char * p)
+{
+    return (uint16_t)((unsigned char)p[0] | ((unsigned char)p[1] << 8));
+}
+
+static uint32_t get32(const char * p)
+{
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+        v |= (uint32_t)(unsigned char)p[i] << (8 * i);
+    return v;
+}
+
+UdpTransport::UdpTransport(const char * port)
+{
+    struct addrinfo *result = NULL;
+    struct addrinfo hints;
+
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_protocol = IPPROTO_UDP;
+    hints.ai_flags = AI_PASSIVE;
+
+    int iResult = getaddrinfo(NULL, port, &hints, &result);
+
+    if (iResult != 0) {
+        printf("udp getaddrinfo failed with error: %d\n", iResult);
+        exit(1);
+    }
+
+    udpSocket = ::socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+    if (udpSocket == INVALID_SOCKET) {
+        printf("udp socket failed with error: %d\n", NetworkServices::lastError());
+        freeaddrinfo(result);
+        exit(1);
+    }
+
+    if (bind(udpSocket, result->ai_addr, (int)result->ai_addrlen) == SOCKET_ERROR) {
+        printf("udp bind failed with error: %d\n", NetworkServices::lastError());
+        freeaddrinfo(result);
+        closesocket(udpSocket);
+        exit(1);
+    }
+
+    freeaddrinfo(result);
+
+    NetworkServices::setNonBlocking(udpSocket);
+}
+
+UdpTransport::~UdpTransport(void)
+{
+    closesocket(udpSocket);
+}
+
+uint64_t UdpTransport::nowMs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t UdpTransport::addressKey(const struct sockaddr_in & addr)
+{
+    return ((uint64_t)addr.sin_addr.s_addr << 16) | addr.sin_port;
+}
+
+unsigned short UdpTransport::localPort() const
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    if (getsockname(udpSocket, (struct sockaddr *)&addr, &len) == SOCKET_ERROR)
+        return 0;
+
+    return ntohs(addr.sin_port);
+}
+
+bool UdpTransport::addPeer(unsigned int id, const char * host, const char * port)
+{
+    struct addrinfo *result = NULL;
+    struct addrinfo hints;
+
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    if (getaddrinfo(host, port, &hints, &result) != 0)
+        return false;
+
+    Peer & peer = peers[id];
+    memcpy(&peer.addr, result->ai_addr, sizeof(peer.addr));
+    peer.lastHeard = nowMs();
+    peerByAddress[addressKey(peer.addr)] = id;
+
+    freeaddrinfo(result);
+    return true;
+}
+
+void UdpTransport::removePeer(unsigned int id)
+{
+    std::map<unsigned int, Peer>::iterator iter = peers.find(id);
+
+    if (iter == peers.end())
+        return;
+
+    peerByAddress.erase(addressKey(iter->second.addr));
+    peers.erase(iter);
+}
+
+std::vector<unsigned int> UdpTransport::peerIds() const
+{
+    std::vector<unsigned int> ids;
+    std::map<unsigned int, Peer>::const_iterator iter;
+
+    for (iter = peers.begin(); iter != peers.end(); iter++)
+        ids.push_back(iter->first);
+
+    return ids;
+}
+
+void UdpTransport::sendRaw(const struct sockaddr_in & addr, const char * data, int length)
+{
+    datagramsSent++;
+
+    if (conditioner.loss > 0.0f && rand() < conditioner.loss * RAND_MAX)
+        return;
+
+    if (conditioner.latency_ms > 0 || conditioner.jitter_ms > 0)
+    {
+        Delayed d;
+        d.due = nowMs() + conditioner.latency_ms;
+        if (conditioner.jitter_ms > 0)
+            d.due += rand() % (conditioner.jitter_ms + 1);
+        d.addr = addr;
+        d.bytes.assign(data, data + length);
+        delayed.push_back(d);
+        return;
+    }
+
+    sendto(udpSocket, data, length, 0, (const struct sockaddr *)&addr, sizeof(addr));
+    Metrics::count(METRIC_BYTES_OUT, length);
+}
+
+void UdpTransport::transmit(Peer & peer, uint8_t kind, uint16_t seq, const char * payload, int length)
+{
+    char datagram[MAX_DATAGRAM_SIZE];
+
+    if (length > MAX_DATAGRAM_SIZE - UDP_HEADER_SIZE)
+        return;
+
+    // every datagram acks what we have, so acks ride along for free
+    datagram[0] = (char)kind;
+    put16(datagram + 1, seq);
+    put16(datagram + 3, peer.haveRemote ? peer.remoteSeq : (uint16_t)(peer.nextDeliver - 1));
+    put32(datagram + 5, peer.haveRemote ? peer.remoteBits : 0);
+
+    if (length > 0)
+        memcpy(datagram + UDP_HEADER_SIZE, payload, length);
+
+    sendRaw(peer.addr, datagram, UDP_HEADER_SIZE + length);
+    peer.ackPending = false;
+}
+
+void UdpTransport::sendReliable(Peer & peer, SentMessage & message, uint64_t now)
+{
+    transmit(peer, UDP_RELIABLE, message.seq, message.payload.data(), (int)message.payload.size());
+    message.lastSent = now;
+}
+
+bool UdpTransport::send(unsigned int id, const char * payload, int length, bool reliable)
+{
+    std::map<unsigned int, Peer>::iterator iter = peers.find(id);
+
+    if (iter == peers.end() || length > MAX_DATAGRAM_SIZE - UDP_HEADER_SIZE)
+        return false;
+
+    Peer & peer = iter->second;
+
+    if (!reliable)
+    {
+        transmit(peer, UDP_UNRELIABLE, peer.nextPoseSeq++, payload, length);
+        return true;
+    }
+
+    // window full: wait for acks before putting more on the wire
+    if (peer.inFlight.size() >= RELIABLE_WINDOW)
+    {
+        if (peer.backlog.size() >= RELIABLE_BACKLOG)
+            return false;
+
+        peer.backlog.push_back(std::vector<char>(payload, payload + length));
+        return true;
+    }
+
+    uint64_t now = nowMs();
+
+    SentMessage message;
+    message.seq = peer.nextSeq++;
+    message.firstSent = now;
+    message.lastSent = now;
+    message.resent = false;
+    message.payload.assign(payload, payload + length);
+
+    peer.inFlight.push_back(message);
+    sendReliable(peer, peer.inFlight.back(), now);
+
+    return true;
+}
+
+void UdpTransport::sendToAll(const char * payload, int length, bool reliable)
+{
+    std::map<unsigned int, Peer>::iterator iter;
+
+    for (iter = peers.begin(); iter != peers.end(); iter++)
+        send(iter->first, payload, length, reliable);
+}
+
+void UdpTransport::handleAcks(Peer & peer, uint16_t ack, uint32_t bits)
+{
+    uint64_t now = nowMs();
+
+    std::deque<SentMessage>::iterator iter = peer.inFlight.begin();
+
+    while (iter != peer.inFlight.end())
+    {
+        uint16_t behind = (uint16_t)(ack - iter->seq);
+        bool acked = behind == 0 || (behind <= 32 && newer(ack, iter->seq) && (bits & (1u << (behind - 1))));
+
+        if (!acked)
+        {
+            iter++;
+            continue;
+        }
+
+        // Karn: only time messages that went out once
+        if (!iter->resent)
+            peer.srtt_ms = (7 * peer.srtt_ms + (int)(now - iter->firstSent)) / 8;
+
+        iter = peer.inFlight.erase(iter);
+    }
+
+    // the window opened up, move the backlog onto the wire
+    while (peer.inFlight.size() < RELIABLE_WINDOW && !peer.backlog.empty())
+    {
+        SentMessage message;
+        message.seq = peer.nextSeq++;
+        message.firstSent = now;
+        message.lastSent = now;
+        message.resent = false;
+        message.payload.swap(peer.backlog.front());
+        peer.backlog.pop_front();
+
+        peer.inFlight.push_back(message);
+        sendReliable(peer, peer.inFlight.back(), now);
+    }
+}
+
+// note the seq for our acks, then deliver in order. the handler may
+// send, but must not remove peers
+void UdpTransport::handleReliable(unsigned int id, Peer & peer, uint16_t seq, const char * payload, int length, const Handler & handler)
+{
+    // a sender never has more than a window in flight past what we
+    // delivered. further ahead is a broken or hostile peer: drop it
+    // unacked, rather than hold it
+    if (newer(seq, peer.nextDeliver) && (uint16_t)(seq - peer.nextDeliver) >= RELIABLE_WINDOW)
+        return;
+
+    if (!peer.haveRemote)
+    {
+        peer.haveRemote = true;
+        peer.remoteSeq = seq;
+        peer.remoteBits = 0;
+    }
+    else if (newer(seq, peer.remoteSeq))
+    {
+        uint16_t shift = (uint16_t)(seq - peer.remoteSeq);
+        peer.remoteBits = shift >= 32 ? 0 : (peer.remoteBits << shift);
+        if (shift <= 32)
+            peer.remoteBits |= 1u << (shift - 1);
+        peer.remoteSeq = seq;
+    }
+    else if (seq != peer.remoteSeq)
+    {
+        uint16_t behind = (uint16_t)(peer.remoteSeq - seq - 1);
+        if (behind < 32)
+            peer.remoteBits |= 1u << behind;
+    }
+
+    peer.ackPending = true;
+
+    if (seq == peer.nextDeliver)
+    {
+        peer.nextDeliver++;
+        handler(id, payload, length);
+
+        // anything that arrived early can go now
+        std::map<uint16_t, std::vector<char> >::iterator next;
+        while ((next = peer.outOfOrder.find(peer.nextDeliver)) != peer.outOfOrder.end())
+        {
+            std::vector<char> early;
+            early.swap(next->second);
+            peer.outOfOrder.erase(next);
+            peer.nextDeliver++;
+            handler(id, early.data(), (int)early.size());
+        }
+    }
+    else if (newer(seq, peer.nextDeliver))
+    {
+        if (peer.outOfOrder.find(seq) == peer.outOfOrder.end())
+            peer.outOfOrder[seq].assign(payload, payload + length);
+    }
+
+    // older than nextDeliver: a resend of something we already have,
+    // the ack above is all it needs
+}
+
+void UdpTransport::receive(unsigned int & next_id, const Handler & handler)
+{
+    char datagram[MAX_DATAGRAM_SIZE];
+    uint64_t now = nowMs();
+
+    for (int reads = 0; reads < MAX_READS_PER_RECEIVE; reads++)
+    {
+        struct sockaddr_in from;
+        socklen_t fromLen = sizeof(from);
+
+        int n = recvfrom(udpSocket, datagram, sizeof(datagram), 0, (struct sockaddr *)&from, &fromLen);
+
+        if (n == SOCKET_ERROR)
+        {
+            if (NetworkServices::wouldBlock())
+                break;
+
+            // e.g. ICMP port unreachable reported on Windows, keep reading
+            continue;
+        }
+
+        Metrics::count(METRIC_BYTES_IN, n);
+
+        if (n < UDP_HEADER_SIZE)
+            continue;
+
+        datagramsReceived++;
+
+        uint8_t kind = (uint8_t)datagram[0];
+        uint16_t seq = get16(datagram + 1);
+
+        // a new address is a new peer once it starts a reliable stream.
+        // acks, poses and the middle of a stream from an address we
+        // don't know are strays, scans, or a peer already forgotten
+        unsigned int id;
+        std::map<uint64_t, unsigned int>::iterator known = peerByAddress.find(addressKey(from));
+
+        if (known == peerByAddress.end())
+        {
+            if (kind != UDP_RELIABLE || seq != 0)
+            {
+                strangersIgnored++;
+                continue;
+            }
+
+            id = next_id++;
+            peers[id].addr = from;
+            peerByAddress[addressKey(from)] = id;
+        }
+        else
+        {
+            id = known->second;
+        }
+
+        Peer & peer = peers[id];
+        peer.lastHeard = now;
+
+        handleAcks(peer, get16(datagram + 3), get32(datagram + 5));
+
+        const char * payload = datagram + UDP_HEADER_SIZE;
+        int length = n - UDP_HEADER_SIZE;
+
+        switch (kind) {
+
+            case UDP_RELIABLE:
+                handleReliable(id, peer, seq, payload, length, handler);
+                break;
+
+            case UDP_UNRELIABLE:
+                if (peer.havePose && !newer(seq, peer.lastPoseSeq)) {
+                    stalePosesDropped++;
+                    break;
+                }
+                peer.havePose = true;
+                peer.lastPoseSeq = seq;
+                handler(id, payload, length);
+                break;
+
+            default:
+                break;
+        }
+    }
+}
+
+void UdpTransport::update()
+{
+    uint64_t now = nowMs();
+    size_t removedStart = removedPeers.size();
+
+    std::map<unsigned int, Peer>::iterator iter;
+
+    // gone quiet: nothing more is sent to it or held for it
+    for (iter = peers.begin(); iter != peers.end(); iter++)
+    {
+        if (now - iter->second.lastHeard >= (uint64_t)peerTimeout_ms)
+            removedPeers.push_back(iter->first);
+    }
+
+    for (size_t i = removedStart; i < removedPeers.size(); i++)
+        removePeer(removedPeers[i]);
+
+    for (iter = peers.begin(); iter != peers.end(); iter++)
+    {
+        Peer & peer = iter->second;
+
+        int rto = 2 * peer.srtt_ms;
+        if (rto < MIN_RTO_MS) rto = MIN_RTO_MS;
+        if (rto > MAX_RTO_MS) rto = MAX_RTO_MS;
+
+        std::deque<SentMessage>::iterator msg;
+
+        for (msg = peer.inFlight.begin(); msg != peer.inFlight.end(); msg++)
+        {
+            if (now - msg->lastSent >= (uint64_t)rto)
+            {
+                msg->resent = true;
+                resends++;
+                sendReliable(peer, *msg, now);
+            }
+        }
+
+        // nothing went out to carry the acks, send them on their own
+        if (peer.ackPending)
+            transmit(peer, UDP_ACK, 0, NULL, 0);
+    }
+
+    // release what the conditioner held back
+    size_t i = 0;
+    while (i < delayed.size())
+    {
+        if (delayed[i].due <= now)
+        {
+            sendto(udpSocket, delayed[i].bytes.data(), (int)delayed[i].bytes.size(), 0,
+                   (const struct sockaddr *)&delayed[i].addr, sizeof(delayed[i].addr));
+            Metrics::count(METRIC_BYTES_OUT, delayed[i].bytes.size());
+            delayed[i] = delayed.back();
+            delayed.pop_back();
+        }
+        else
+        {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include "NetworkServices.h"
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#endif
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <deque>
+#include <functional>
+
+// datagram kinds
+enum UdpKinds {
+
+    UDP_RELIABLE = 1,       // game events: resent until acked, delivered in order
+
+    UDP_UNRELIABLE = 2,     // head poses: latest wins, stale ones dropped
+
+    UDP_ACK = 3,            // nothing to say but acks
+
+};
+
+// kind, seq, ack, ack bits
+#define UDP_HEADER_SIZE 9
+#define MAX_DATAGRAM_SIZE 1200
+
+// reliable messages in flight per peer, bounded by the ack bitfield
+#define RELIABLE_WINDOW 32
+
+// messages queued behind a full window before sends start failing
+#define RELIABLE_BACKLOG 256
+
+// resend timeout bounds
+#define MIN_RTO_MS 50
+#define MAX_RTO_MS 1000
+
+// a peer heard nothing from for this long is forgotten
+#define UDP_PEER_TIMEOUT_MS 10000
+
+// Test hook that damages outgoing datagrams the way a bad link would.
+// All zero (the default) sends everything straight away.
+struct LinkConditioner
+{
+    float loss = 0.0f;      // fraction of datagrams dropped
+    int latency_ms = 0;     // added to every datagram
+    int jitter_ms = 0;      // plus up to this much, so datagrams reorder
+};
+
+// UDP transport with two channels per peer: a reliable channel with
+// sequence numbers and selective acks for game events, and an
+// unreliable latest-wins channel for head poses. Each datagram carries
+// the latest reliable seq received plus a 32 bit field acking the 32
+// before it, so one lost ack is repaired by the next datagram.
+//
+// An unknown address only becomes a peer by sending the first message
+// of a reliable stream, and a peer that goes quiet for peerTimeout is
+// forgotten, so strays and scans cost nothing lasting.
+class UdpTransport
+{
+public:
+    // bind to port ("0" picks any free port, for clients)
+    UdpTransport(const char * port);
+    ~UdpTransport(void);
+
+    typedef std::function<void(unsigned int peer, const char * payload, int length)> Handler;
+
+    // talk to host:port as peer id
+    bool addPeer(unsigned int id, const char * host, const char * port);
+    void removePeer(unsigned int id);
+
+    // queue payload for one peer, or for all of them
+    bool send(unsigned int id, const char * payload, int length, bool reliable);
+    void sendToAll(const char * payload, int length, bool reliable);
+
+    // read every waiting datagram. an unknown sender whose datagram is
+    // reliable seq 0 becomes a peer numbered from next_id, anything
+    // else from it is ignored. delivered payloads are only valid
+    // inside the handler
+    void receive(unsigned int & next_id, const Handler & handler);
+
+    // resends, standalone acks and delayed datagrams, and forgetting
+    // quiet peers; call often
+    void update();
+
+    SOCKET socket() const { return udpSocket; }
+    unsigned short localPort() const;
+
+    std::vector<unsigned int> peerIds() const;
+    bool hasPeers() const { return !peers.empty(); }
+
+    LinkConditioner conditioner;
+
+    // how long a peer may go unheard before update() forgets it
+    int peerTimeout_ms = UDP_PEER_TIMEOUT_MS;
+
+    // peers update() forgot, for the owner to forget too and clear
+    std::vector<unsigned int> removedPeers;
+
+    // totals, for tests and tuning
+    uint64_t datagramsSent = 0;
+    uint64_t datagramsReceived = 0;
+    uint64_t resends = 0;
+    uint64_t stalePosesDropped = 0;
+    uint64_t strangersIgnored = 0;
+
+private:
+    struct SentMessage
+    {
+        uint16_t seq;
+        uint64_t firstSent;
+        uint64_t lastSent;
+        bool resent;
+        std::vector<char> payload;
+    };
+
+    struct Peer
+    {
+        struct sockaddr_in addr;
+
+        // when a datagram last came from it, or it was added
+        uint64_t lastHeard = 0;
+
+        // reliable send side
+        uint16_t nextSeq = 0;
+        std::deque<SentMessage> inFlight;
+        std::deque<std::vector<char> > backlog;
+        int srtt_ms = 100;
+
+        // reliable receive side
+        bool haveRemote = false;
+        uint16_t remoteSeq = 0;
+        uint32_t remoteBits = 0;
+        uint16_t nextDeliver = 0;
+        std::map<uint16_t, std::vector<char> > outOfOrder;
+        bool ackPending = false;
+
+        // unreliable channel
+        uint16_t nextPoseSeq = 0;
+        bool havePose = false;
+        uint16_t lastPoseSeq = 0;
+    };
+
+    struct Delayed
+    {
+        uint64_t due;
+        struct sockaddr_in addr;
+        std::vector<char> bytes;
+    };
+
+    static uint64_t nowMs();
+
+    // a is later than b, allowing for wrap
+    static bool newer(uint16_t a, uint16_t b) { return (int16_t)(a - b) > 0; }
+
+    void transmit(Peer & peer, uint8_t kind, uint16_t seq, const char * payload, int length);
+    void sendRaw(const struct sockaddr_in & addr, const char * data, int length);
+    void sendReliable(Peer & peer, SentMessage & message, uint64_t now);
+
+    void handleAcks(Peer & peer, uint16_t ack, uint32_t bits);
+    void handleReliable(unsigned int id, Peer & peer, uint16_t seq, const char * payload, int length, const Handler & handler);
+
+    static uint64_t addressKey(const struct sockaddr_in & addr);
+
+    SOCKET udpSocket;
+
+    std::map<unsigned int, Peer> peers;
+    std::map<uint64_t, unsigned int> peerByAddress;
+
+    std::vector<Delayed> delayed;
+};
@@ -0,0 +1,290 @@
+#include "UringEngine.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <time.h>
+
+static int uringSetup(unsigned int entries, struct io_uring_params * params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned int submit, unsigned int waitFor, unsigned int flags, void * arg, size_t argSize)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, submit, waitFor, flags, arg, argSize);
+}
+
+static int uringRegister(int fd, unsigned int opcode, void * arg, unsigned int count)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+UringEngine::UringEngine(void)
+    : ringFd(-1), sqRing(MAP_FAILED), sqRingSize(0), sqEntries(0), sqes((struct io_uring_sqe *)MAP_FAILED), sqLocalTail(0),
+      bufferRing((struct io_uring_buf *)MAP_FAILED), bufferRingSize(0), buffers(NULL), bufferTail(0),
+      recycles(0)
+{
+}
+
+UringEngine * UringEngine::create()
+{
+    UringEngine * engine = new UringEngine();
+
+    if (!engine->setup())
+    {
+        delete engine;
+        return NULL;
+    }
+
+    return engine;
+}
+
+bool UringEngine::setup()
+{
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    // completions are only looked at when we enter the kernel anyway,
+    // so it needn't interrupt us to post them
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = URING_COMPLETIONS;
+
+    ringFd = uringSetup(URING_ENTRIES, &params);
+
+    if (ringFd < 0)
+    {
+        printf("io_uring_setup failed with error: %d\n", errno);
+        return false;
+    }
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG))
+    {
+        printf("io_uring is too old for this server\n");
+        return false;
+    }
+
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    sqRingSize = sqSize > cqSize ? sqSize : cqSize;
+
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    sqes = (struct io_uring_sqe *)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+
+    if (sqRing == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        printf("io_uring mmap failed with error: %d\n", errno);
+        return false;
+    }
+
+    char * ring = (char *)sqRing;
+
+    sqHead = (unsigned int *)(ring + params.sq_off.head);
+    sqTail = (unsigned int *)(ring + params.sq_off.tail);
+    sqMask = *(unsigned int *)(ring + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqLocalTail = *sqTail;
+
+    // slot i always submits entry i
+    unsigned int * array = (unsigned int *)(ring + params.sq_off.array);
+    for (unsigned int i = 0; i < sqEntries; i++)
+        array[i] = i;
+
+    cqHead = (unsigned int *)(ring + params.cq_off.head);
+    cqTail = (unsigned int *)(ring + params.cq_off.tail);
+    cqMask = *(unsigned int *)(ring + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+
+    sendParts.resize(sqEntries);
+
+    // the provided buffers: a ring of descriptors the kernel takes from,
+    // page aligned, and the memory they describe
+    bufferRingSize = URING_BUFFERS * sizeof(struct io_uring_buf);
+    bufferRing = (struct io_uring_buf *)mmap(NULL, bufferRingSize, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    buffers = (char *)malloc((size_t)URING_BUFFERS * URING_BUFFER_SIZE);
+
+    if (bufferRing == MAP_FAILED || buffers == NULL)
+    {
+        printf("out of memory for io_uring buffers\n");
+        return false;
+    }
+
+    struct io_uring_buf_reg registration;
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)bufferRing;
+    registration.ring_entries = URING_BUFFERS;
+    registration.bgid = URING_BUFFER_GROUP;
+
+    if (uringRegister(ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0)
+    {
+        printf("io_uring buffer ring registration failed with error: %d\n", errno);
+        return false;
+    }
+
+    for (int i = 0; i < URING_BUFFERS; i++)
+        recycle(i);
+
+    return true;
+}
+
+UringEngine::~UringEngine(void)
+{
+    // closing the ring cancels whatever is still armed
+    if (ringFd >= 0)
+        close(ringFd);
+
+    if (sqes != MAP_FAILED)
+        munmap(sqes, sqEntries * sizeof(struct io_uring_sqe));
+    if (sqRing != MAP_FAILED)
+        munmap(sqRing, sqRingSize);
+    if (bufferRing != MAP_FAILED)
+        munmap(bufferRing, bufferRingSize);
+
+    free(buffers);
+}
+
+struct io_uring_sqe * UringEngine::entry()
+{
+    // full: let the kernel take what is there
+    if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+        submit(0, 0);
+
+    struct io_uring_sqe * sqe = &sqes[sqLocalTail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqLocalTail++;
+
+    return sqe;
+}
+
+void UringEngine::receive(SOCKET socket, uint64_t key)
+{
+    struct io_uring_sqe * sqe = entry();
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = socket;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = key;
+}
+
+void UringEngine::send(SOCKET socket, const char * const * parts, const int * lengths, int count, uint64_t key)
+{
+    if (count > SEND_GATHER_MAX)
+        count = SEND_GATHER_MAX;
+
+    struct io_uring_sqe * sqe = entry();
+
+    // the slot's own message, which stays put until this entry is
+    // handed to the kernel
+    SendParts & send = sendParts[(sqLocalTail - 1) & sqMask];
+
+    for (int i = 0; i < count; i++)
+    {
+        send.parts[i].iov_base = (void *)parts[i];
+        send.parts[i].iov_len = (size_t)lengths[i];
+    }
+
+    memset(&send.message, 0, sizeof(send.message));
+    send.message.msg_iov = send.parts;
+    send.message.msg_iovlen = count;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = socket;
+    sqe->addr = (uint64_t)(uintptr_t)&send.message;
+    sqe->len = 1;
+
+    // MSG_DONTWAIT makes a full socket complete at once instead of
+    // leaving the send armed, pointing at our queues
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+    sqe->user_data = key;
+}
+
+void UringEngine::pollWritable(SOCKET socket, uint64_t key)
+{
+    struct io_uring_sqe * sqe = entry();
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = socket;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = key;
+}
+
+void UringEngine::pollReadable(SOCKET socket, uint64_t key)
+{
+    struct io_uring_sqe * sqe = entry();
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = socket;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = key;
+}
+
+void UringEngine::cancel(uint64_t key)
+{
+    struct io_uring_sqe * sqe = entry();
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = key;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = URING_NO_KEY;
+}
+
+void UringEngine::submit(unsigned int waitFor, int timeout_ms)
+{
+    unsigned int queued = sqLocalTail - *sqTail;
+
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000ll;
+
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+    if (timeout_ms >= 0)
+        arg.ts = (uint64_t)(uintptr_t)&timeout;
+
+    // GETEVENTS even when not waiting, so completions the kernel held
+    // back for lack of room get posted
+    NetworkServices::syscalls++;
+    int result = uringEnter(ringFd, queued, waitFor, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+        &arg, sizeof(arg));
+
+    if (result < 0 && errno != ETIME && errno != EINTR)
+        printf("io_uring_enter failed with error: %d\n", errno);
+}
+
+bool UringEngine::complete(UringCompletion & completion)
+{
+    unsigned int head = *cqHead;
+
+    if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        return false;
+
+    struct io_uring_cqe * cqe = &cqes[head & cqMask];
+
+    completion.key = cqe->user_data;
+    completion.result = cqe->res;
+    completion.buffer = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+    return true;
+}
+
+void UringEngine::recycle(int id)
+{
+    struct io_uring_buf * slot = &bufferRing[bufferTail & (URING_BUFFERS - 1)];
+
+    slot->addr = (uint64_t)(uintptr_t)buffer(id);
+    slot->len = URING_BUFFER_SIZE;
+    slot->bid = (unsigned short)id;
+
+    bufferTail++;
+    recycles++;
+    __atomic_store_n(&bufferRing[0].resv, bufferTail, __ATOMIC_RELEASE);
+}
+#endif
@@ -0,0 +1,152 @@
+#pragma once
+#ifndef _WIN32
+#include <stdint.h>
+#include <vector>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "NetworkServices.h"
+
+// submission slots. a full queue is submitted before another is taken
+#define URING_ENTRIES 256
+
+// completions the kernel can post between two reaps before it has to
+// hold them back
+#define URING_COMPLETIONS 4096
+
+// buffers receives land in, and the size of each. a session holds the
+// ones with bytes it hasn't read yet
+#define URING_BUFFERS 2048
+#define URING_BUFFER_SIZE 2048
+
+// most buffers one session may hold, as a socket's receive buffer
+// would fill: 64 KB. each receive takes one, and none is armed while
+// the session holds this many; it is armed again once it is read down
+// to half
+#define URING_SESSION_BUFFERS 32
+
+// buffer group the receives pick from
+#define URING_BUFFER_GROUP 0
+
+// completions carrying this key are the engine's own (cancels)
+#define URING_NO_KEY 0
+
+// one operation's result
+struct UringCompletion
+{
+    uint64_t key;
+
+    // bytes, or -errno
+    int result;
+
+    // provided buffer holding the data, -1 for none
+    int buffer;
+};
+
+// A bare io_uring driven through its syscalls, for ServerNetwork's
+// ENGINE_URING.
+//
+// Operations are queued into the submission ring by the calls below
+// and all go to the kernel in the next submit, which also reaps and
+// waits: a tick's sends, receive arms and cancels cost one syscall
+// together instead of one each. A receive takes one buffer from a ring
+// of URING_BUFFERS registered with the kernel and completes; the owner
+// arms the next one, so it decides how many buffers a socket may fill.
+// A buffer goes back to the kernel once recycled.
+//
+// Sends are nonblocking (MSG_DONTWAIT), so the kernel makes the call
+// while it handles the submission and what they pointed at is no
+// longer needed once submit returns. A socket that can't take it all
+// reports a short count or -EAGAIN, like send would.
+class UringEngine
+{
+public:
+    // NULL if the kernel can't do it: no io_uring, io_uring disabled,
+    // or no provided buffer rings (5.19)
+    static UringEngine * create();
+    ~UringEngine(void);
+
+    // arm a receive into one provided buffer. it completes once data
+    // came, the peer closed, on an error, with no buffer left
+    // (-ENOBUFS) or on a cancel
+    void receive(SOCKET socket, uint64_t key);
+
+    // queue one sendmsg of up to SEND_GATHER_MAX buffers
+    void send(SOCKET socket, const char * const * buffers, const int * lengths, int count, uint64_t key);
+
+    // one completion once the socket can take more output
+    void pollWritable(SOCKET socket, uint64_t key);
+
+    // one completion once the socket has something to read, or hung up
+    void pollReadable(SOCKET socket, uint64_t key);
+
+    // stop every operation queued with key. they complete with
+    // -ECANCELED, or whatever they got to first
+    void cancel(uint64_t key);
+
+    // hand the kernel what is queued, then wait up to timeout_ms
+    // (-1 = forever) until waitFor completions are in
+    void submit(unsigned int waitFor, int timeout_ms);
+
+    // take the next completion, false once none are left
+    bool complete(UringCompletion & completion);
+
+    // a provided buffer's data
+    const char * buffer(int id) const { return buffers + (size_t)id * URING_BUFFER_SIZE; }
+
+    // give a buffer back for receives to use
+    void recycle(int id);
+
+    // buffers given back so far, to tell whether any were since
+    uint64_t recycled() const { return recycles; }
+
+private:
+    UringEngine(void);
+    UringEngine(const UringEngine &);
+    UringEngine & operator=(const UringEngine &);
+
+    bool setup();
+
+    // next free submission entry, zeroed
+    struct io_uring_sqe * entry();
+
+    int ringFd;
+
+    // submission ring, shared with the kernel
+    void * sqRing;
+    size_t sqRingSize;
+    unsigned int * sqHead;
+    unsigned int * sqTail;
+    unsigned int sqMask;
+    unsigned int sqEntries;
+    struct io_uring_sqe * sqes;
+
+    // entries filled but not yet published to the kernel
+    unsigned int sqLocalTail;
+
+    // completion ring. one mapping with the submission ring on every
+    // kernel with provided buffer rings
+    unsigned int * cqHead;
+    unsigned int * cqTail;
+    unsigned int cqMask;
+    struct io_uring_cqe * cqes;
+
+    // the provided buffer ring and the memory its buffers point at.
+    // the kernel's tail is the first entry's resv field; the header's
+    // io_uring_buf_ring says so with a C-only trick that lays out
+    // differently in C++, so it isn't used
+    struct io_uring_buf * bufferRing;
+    size_t bufferRingSize;
+    char * buffers;
+    unsigned short bufferTail;
+    uint64_t recycles;
+
+    // what each queued sendmsg points at, one per submission slot,
+    // read by the kernel when it handles the submission
+    struct SendParts
+    {
+        struct msghdr message;
+        struct iovec parts[SEND_GATHER_MAX];
+    };
+    std::vector<SendParts> sendParts;
+};
+#endif
@@ -0,0 +1,131 @@
+#include "WireFormat.h"
+#include <math.h>
+
+// largest magnitude of the three smallest components of a unit quaternion
+static const float QUAT_RANGE = 0.70710678f;
+static const uint32_t QUAT_MAX = (1u << QUAT_COMPONENT_BITS) - 1;
+
+// positions are held to this many steps either way, about a thousand
+// km, so the difference of two still fits a signed varint
+static const int32_t POSITION_LIMIT = (1 << 30) - 1;
+
+// one coordinate in fixed point steps. a float past the int range has
+// no defined cast, so those are held at the limit, and NaN is 0
+static int32_t quantize(float value)
+{
+    if (value != value)
+        return 0;
+
+    double steps = floor((double)value * POSITION_SCALE + 0.5);
+
+    if (steps > POSITION_LIMIT)
+        return POSITION_LIMIT;
+    if (steps < -POSITION_LIMIT)
+        return -POSITION_LIMIT;
+
+    return (int32_t)steps;
+}
+
+void WireWriter::writePosition(const glm::vec3 & position)
+{
+    for (int i = 0; i < 3; i++)
+        writeSignedVarint(quantize(position[i]));
+}
+
+glm::vec3 WireReader::readPosition()
+{
+    glm::vec3 position;
+    for (int i = 0; i < 3; i++)
+        position[i] = readSignedVarint() / POSITION_SCALE;
+    return position;
+}
+
+void WireWriter::writePosition(const glm::vec3 & position, const glm::vec3 & reference)
+{
+    for (int i = 0; i < 3; i++)
+        writeSignedVarint((int32_t)((int64_t)quantize(position[i]) - quantize(reference[i])));
+}
+
+glm::vec3 WireReader::readPosition(const glm::vec3 & reference)
+{
+    glm::vec3 position;
+    for (int i = 0; i < 3; i++)
+        position[i] = ((int64_t)quantize(reference[i]) + readSignedVarint()) / POSITION_SCALE;
+    return position;
+}
+
+// smallest three: drop the largest component (recovered from the unit
+// length), flip the sign so it is positive, and quantize the other three
+void WireWriter::writeOrientation(const glm::quat & orientation)
+{
+    float c[4] = { orientation.x, orientation.y, orientation.z, orientation.w };
+
+    int largest = 0;
+    for (int i = 1; i < 4; i++)
+        if (fabsf(c[i]) > fabsf(c[largest]))
+            largest = i;
+
+    float sign = c[largest] < 0.0f ? -1.0f : 1.0f;
+
+    uint32_t packed = (uint32_t)largest;
+    int shift = 2;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (i == largest)
+            continue;
+
+        float v = c[i] * sign;
+        if (v > QUAT_RANGE) v = QUAT_RANGE;
+        if (v < -QUAT_RANGE) v = -QUAT_RANGE;
+
+        uint32_t q = (uint32_t)floorf((v + QUAT_RANGE) / (2.0f * QUAT_RANGE) * QUAT_MAX + 0.5f);
+        packed |= q << shift;
+        shift += QUAT_COMPONENT_BITS;
+    }
+
+    writeU32(packed);
+}
+
+glm::quat WireReader::readOrientation()
+{
+    uint32_t packed = readU32();
+    int largest = packed & 3;
+    int shift = 2;
+
+    float c[4];
+    float sum = 0.0f;
+
+    for (int i = 0; i < 4; i++)
+    {
+        if (i == largest)
+            continue;
+
+        uint32_t q = (packed >> shift) & QUAT_MAX;
+        shift += QUAT_COMPONENT_BITS;
+
+        c[i] = (float)q / QUAT_MAX * (2.0f * QUAT_RANGE) - QUAT_RANGE;
+        sum += c[i] * c[i];
+    }
+
+    c[largest] = sum < 1.0f ? sqrtf(1.0f - sum) : 0.0f;
+
+    return glm::normalize(glm::quat(c[3], c[0], c[1], c[2]));
+}
+
+glm::vec3 posePosition(const glm::mat4 & pose)
+{
+    return glm::vec3(pose[3][0], pose[3][1], pose[3][2]);
+}
+
+glm::quat poseOrientation(const glm::mat4 & pose)
+{
+    return glm::normalize(glm::quat_cast(pose));
+}
+
+glm::mat4 makePose(const glm::vec3 & position, const glm::quat & orientation)
+{
+    glm::mat4 pose = glm::mat4_cast(orientation);
+    pose[3] = glm::vec4(position, 1.0f);
+    return pose;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <stdint.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// Explicit little-endian encoding for everything that goes on the wire,
+// so the bytes no longer depend on compiler padding or host endianness.
+
+// head position is sent as fixed point with this many steps per meter
+#define POSITION_SCALE 1024.0f
+
+// bits per component of a smallest-three quaternion
+#define QUAT_COMPONENT_BITS 10
+
+class WireWriter
+{
+public:
+    WireWriter(char * buffer, int size) : data((uint8_t *)buffer), capacity(size), pos(0), overflow(false) {}
+
+    void writeByte(uint8_t value)
+    {
+        if (pos < capacity)
+            data[pos++] = value;
+        else
+            overflow = true;
+    }
+
+    void writeU32(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            writeByte((uint8_t)(value >> (8 * i)));
+    }
+
+    // LEB128: 7 bits per byte, small values take one byte
+    void writeVarint(uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            writeByte((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        writeByte((uint8_t)value);
+    }
+
+    void writeVarint64(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            writeByte((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        writeByte((uint8_t)value);
+    }
+
+    // zigzag so small negative numbers stay small
+    void writeSignedVarint(int32_t value)
+    {
+        writeVarint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }
+
+    // a NaN coordinate goes as 0, one past about a thousand km as the
+    // furthest that can be sent
+    void writePosition(const glm::vec3 & position);
+    void writeOrientation(const glm::quat & orientation);
+
+    // position as fixed point steps from a reference both sides know,
+    // so a head that barely moved costs a byte per axis
+    void writePosition(const glm::vec3 & position, const glm::vec3 & reference);
+
+    int size() const { return pos; }
+    bool ok() const { return !overflow; }
+
+private:
+    uint8_t * data;
+    int capacity;
+    int pos;
+    bool overflow;
+};
+
+class WireReader
+{
+public:
+    WireReader(const char * buffer, int size) : data((const uint8_t *)buffer), length(size), pos(0), underflow(false) {}
+
+    uint8_t readByte()
+    {
+        if (pos < length)
+            return data[pos++];
+        underflow = true;
+        return 0;
+    }
+
+    uint32_t readU32()
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+            value |= (uint32_t)readByte() << (8 * i);
+        return value;
+    }
+
+    uint32_t readVarint()
+    {
+        uint32_t value = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            uint8_t b = readByte();
+            value |= (uint32_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return value;
+        }
+        underflow = true;
+        return 0;
+    }
+
+    uint64_t readVarint64()
+    {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 70; shift += 7)
+        {
+            uint8_t b = readByte();
+            value |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80))
+                return value;
+        }
+        underflow = true;
+        return 0;
+    }
+
+    int32_t readSignedVarint()
+    {
+        uint32_t v = readVarint();
+        return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+    }
+
+    glm::vec3 readPosition();
+    glm::quat readOrientation();
+    glm::vec3 readPosition(const glm::vec3 & reference);
+
+    int remaining() const { return length - pos; }
+    bool ok() const { return !underflow; }
+
+private:
+    const uint8_t * data;
+    int length;
+    int pos;
+    bool underflow;
+};
+
+// split a rigid head pose into its translation and rotation and back
+glm::vec3 posePosition(const glm::mat4 & pose);
+glm::quat poseOrientation(const glm::mat4 & pose);
+glm::mat4 makePose(const glm::vec3 & position, const glm::quat & orientation);
@@ -22,6 +22,7 @@ limitations under the License.
 #include <exception>
 #include <algorithm>
 #include "ServerGame.h"
+#include "FixedStep.h"
 #include <Windows.h>
 
 #define __STDC_FORMAT_MACROS 1
@@ -562,6 +563,11 @@ private:
 	uvec2 _renderTargetSize;
 	uvec2 _mirrorSize;
 
+	ovrPosef _eyePoses[2];
+
+	// Fixed rate simulation
+	FixedStep _simulation;
+
 public:
 RiftApp() {
 	using namespace ovr;
@@ -666,8 +672,12 @@ protected:
 		GlfwApp::onKey(key, scancode, action, mods);
 	}
 
-	void draw() final override {
+	void setTickRate(double hz) {
+		_simulation.setRate(hz);
+	}
 
+	// Once per frame: sample tracking, then advance the game at a fixed rate
+	void update() final override {
 
 		// HAND TRACKING
 		displayMidpointSeconds = ovr_GetPredictedDisplayTime(_session, 0);
@@ -686,12 +696,20 @@ protected:
 		handRotation[1] = handPoses[1].Orientation;
 
 		// Eye
-		ovrPosef eyePoses[2];
-		ovr_GetEyePoses(_session, frame, true, _viewScaleDesc.HmdToEyePose, eyePoses, &_sceneLayer.SensorSampleTime);
+		ovr_GetEyePoses(_session, frame, true, _viewScaleDesc.HmdToEyePose, _eyePoses, &_sceneLayer.SensorSampleTime);
 		// Head
-		HeadPose = ovr::toGlm(eyePoses[ovrEye_Left]) + ovr::toGlm(eyePoses[ovrEye_Right]);
+		HeadPose = ovr::toGlm(_eyePoses[ovrEye_Left]) + ovr::toGlm(_eyePoses[ovrEye_Right]);
 		HeadPose = glm::scale(HeadPose, glm::vec3(0.5f));
 
+		// Simulation
+		int ticks = _simulation.advance(ovr_GetTimeInSeconds());
+		for (int i = 0; i < ticks; i++) {
+			tick();
+		}
+	}
+
+	// Per eye passes only draw what update() decided
+	void draw() final override {
 		int curIndex;
 		ovr_GetTextureSwapChainCurrentIndex(_session, _eyeTexture, &curIndex);
 		GLuint curTexId;
@@ -709,8 +727,8 @@ protected:
 			}
 			const auto& vp = _sceneLayer.Viewport[eye];
 			glViewport(vp.Pos.x, vp.Pos.y, vp.Size.w, vp.Size.h);
-			_sceneLayer.RenderPose[eye] = eyePoses[eye];
-			renderScene(_eyeProjections[eye], ovr::toGlm(eyePoses[eye]));
+			_sceneLayer.RenderPose[eye] = _eyePoses[eye];
+			renderScene(_eyeProjections[eye], ovr::toGlm(_eyePoses[eye]));
 		});
 		glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, 0, 0);
 		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
@@ -727,6 +745,8 @@ protected:
 		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 	}
 
+	virtual void tick() = 0;
+
 	virtual void renderScene(const glm::mat4& projection, const glm::mat4& headPose) = 0;
 };
 
@@ -747,6 +767,7 @@ protected:
 #include "Model.h"
 #include "Mesh.h"
 #include "Line.h"
+#include "Board.h"
 #include <ctime>
 #include <irrKlang.h>
 #include <ft2build.h>
@@ -821,18 +842,18 @@ public:
 	std::vector<std::pair<int, int>> P; // Patrol Boat * 1 (2*1 grid)
 
 	// Game Data
-	int myBoard[10][10];
-	int rivalBoard[10][10];
+	Board myBoard;
+	Board rivalBoard;
 
 	int selectedIdx;
 
 	int numHits = 0;
 	int numDamages = 0;
 
-	const int EMPTY = 0;
-	const int MARKED = 1;
-	const int MISSED = -1;
-	const int SHOOTED = 2;
+	const int EMPTY = CELL_EMPTY;
+	const int MARKED = CELL_MARKED;
+	const int MISSED = CELL_MISSED;
+	const int SHOOTED = CELL_SHOOTED;
 	
 	// Text Rendering
 	string shipMessage, directionMessage, endMessage;
@@ -1408,12 +1429,8 @@ public:
 	  rival_board_matrices.clear();
 	  my_board_positions.clear();
 	  rival_board_positions.clear();
-	  for (int x = 0; x < GRID_SIZE; x++) {
-		  for (int y = 0; y < GRID_SIZE; y++) {
-			  myBoard[x][y] = EMPTY;
-			  rivalBoard[x][y] = EMPTY;
-		  }
-	  }
+	  myBoard.clear();
+	  rivalBoard.clear();
 
 	  selectedIdx = 0;
 	  numHits = 0;
@@ -1524,6 +1541,24 @@ protected:
 	// Server
 	server = std::unique_ptr<ServerGame>(new ServerGame());
 
+	// record the match for the replay tool when asked to
+	const char * replayPath = getenv("VR_REPLAY_LOG");
+	if (replayPath != NULL)
+		server->logTraffic(replayPath);
+
+	// how far the other side's guess of our head may drift, in mm,
+	// before a pose is sent. 0 sends every frame
+	const char * threshold = getenv("VR_POSE_THRESHOLD_MM");
+	if (threshold != NULL) {
+		server->headReckoning.positionThreshold = (float)atof(threshold) / 1000.0f;
+		if (server->headReckoning.positionThreshold <= 0.0f) {
+			server->headReckoning.angleThreshold = 0.0f;
+			server->headReckoning.keepalive = 0;
+		}
+	}
+
+	server->start();
+
 	// Model
 	rose = std::unique_ptr<Object>(new Object("Asset/Model/Rose/rose.obj"));
 	sculpture = std::unique_ptr<Object>(new Object("Asset/Model/Sculpture/Handler.obj"));
@@ -1563,21 +1598,17 @@ protected:
     scene->reset();
   }
 
-  void renderScene(const glm::mat4& projection, const glm::mat4& headPose) override
+  // Input, game rules and networking, once per simulation tick
+  void tick() override
   {
-	 // Model Positions
-	  rose->toWorld = scene->RHOrientationPosition * glm::scale(glm::mat4(1.0f), glm::vec3(0.004f));
-	  sculpture->toWorld = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.0f, -0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.002f));
-	
-
-	  if (scene->numHits == 16) {
+	  if (scene->numHits == FLEET_CELLS) {
 		  scene->numHits = 0;
 		  soundEngine->play2D("../audio/End.mp3", GL_FALSE); // Audio
 		  gameMode = END;
 		  resultMode = WIN;
 	  }
 
-	  if (scene->numDamages == 16) {
+	  if (scene->numDamages == FLEET_CELLS) {
 		  scene->numDamages = 0;
 		  soundEngine->play2D("../audio/End.mp3", GL_FALSE); // Audio
 		  gameMode = END;
@@ -1693,10 +1724,6 @@ protected:
 				  buttonAPressed = false;
 			  }
 		  }
-
-		  if (buttonAPressed) {
-			  RenderWarship();
-		  }
 	  }
 
 
@@ -1713,12 +1740,9 @@ protected:
 				  buttonYPressed = false;
 			  }
 		  }
-		  rose->render(projection, glm::inverse(headPose),true);
 	  }
 
 	  if (gameMode == END) {
-		  rose->render(projection, glm::inverse(headPose), true);
-		  sculpture->render(projection, glm::inverse(headPose), true);
 		  float dist = sqrt(handPosition[ovrHand_Right].x * handPosition[ovrHand_Right].x + handPosition[ovrHand_Right].y * handPosition[ovrHand_Right].y
 			  + (handPosition[ovrHand_Right].z + 0.5f) * (handPosition[ovrHand_Right].z + 0.5f));
 		  if (dist < 0.09f) {
@@ -1749,25 +1773,17 @@ protected:
 		  }
 	 }
 
-	  // Render Scene
-      scene->render(projection, glm::inverse(headPose));
-	  
-
 	  // Update Server
+	  server->my_headPose = HeadPose;
 	  server->update();
 	
+	  // the server already told the attacker whether it hit
 	  if (server->other_attack.first != -1) {
-		  if (scene->myBoard[server->other_attack.first][server->other_attack.second] == scene->MARKED) {
-			  scene->myBoard[server->other_attack.first][server->other_attack.second] = scene->SHOOTED;
-			  server->my_damage.first = server->other_attack.first;
-			  server->my_damage.second = server->other_attack.second;
+		  if (scene->myBoard.shoot(server->other_attack.first, server->other_attack.second) == SHOT_HIT) {
 			  server->other_attack.first = -1;
 			  server->other_attack.second = -1;
 			  scene->numDamages++;
 		  }
-		  else {
-			  scene->myBoard[server->other_attack.first][server->other_attack.second] = scene->MISSED;
-		  }
 	  }
 	  
 	  
@@ -1782,12 +1798,33 @@ protected:
 	  if (server->game_mode) {
 		  playerMode = MY;
 	  }
+  }
 
-	 
-	  server->my_headPose = HeadPose;
-	  otherHead->toWorld = server->other_headPose * glm::scale(glm::mat4(1.0f), glm::vec3(0.02f));
+  // Per eye pass, draws only
+  void renderScene(const glm::mat4& projection, const glm::mat4& headPose) override
+  {
+	 // Model Positions
+	  rose->toWorld = scene->RHOrientationPosition * glm::scale(glm::mat4(1.0f), glm::vec3(0.004f));
+	  sculpture->toWorld = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, -0.0f, -0.5f)) * glm::scale(glm::mat4(1.0f), glm::vec3(0.002f));
+
+	  if (((gameMode == PREPARE && selectingMode == DONE) || gameMode == ON) && buttonAPressed) {
+		  RenderWarship();
+	  }
+
+	  if (gameMode == ON) {
+		  rose->render(projection, glm::inverse(headPose), true);
+	  }
+
+	  if (gameMode == END) {
+		  rose->render(projection, glm::inverse(headPose), true);
+		  sculpture->render(projection, glm::inverse(headPose), true);
+	  }
+
+	  // Render Scene
+      scene->render(projection, glm::inverse(headPose));
+
+	  otherHead->toWorld = server->otherHeadPoseAt(clockMicros()) * glm::scale(glm::mat4(1.0f), glm::vec3(0.02f));
 	  otherHead->render(projection, glm::inverse(headPose), true);
-	 
   }
 
   
@@ -1799,22 +1836,15 @@ protected:
 			  selectingMode = DONE;
 			  buttonAPressed = false;
 
-			  int row, column;
-			  std::pair<int, int> curr;
-			  for (int i = 0; i < 100; i++)
-			  {
-				  row = i % 10;
-				  column = (i - row) / 10;
-				  curr = std::make_pair(row, column);
-				  if (std::find(scene->A.begin(), scene->A.end(), curr) != scene->A.end() || std::find(scene->B.begin(), scene->B.end(), curr) != scene->B.end() ||
-					  std::find(scene->C.begin(), scene->C.end(), curr) != scene->C.end() || std::find(scene->S.begin(), scene->S.end(), curr) != scene->S.end() ||
-					  std::find(scene->P.begin(), scene->P.end(), curr) != scene->P.end()) {
-					  scene->myBoard[row][column] = scene->MARKED;
-				  }
-			  }
+			  scene->myBoard.placeShip(scene->A);
+			  scene->myBoard.placeShip(scene->B);
+			  scene->myBoard.placeShip(scene->C);
+			  scene->myBoard.placeShip(scene->S);
+			  scene->myBoard.placeShip(scene->P);
 
 			  scene->shipMessage = "All Warships Ready";
 
+			  server->my_fleet = scene->myBoard;
 			  server->my_done = true;
 		  }
 		  else {
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdio.h>
+
+// What the test programs share: each check prints ok or FAILED with
+// what it was about, and main ends with return checked(), which prints
+// the verdict and makes the exit code nonzero if any check failed.
+
+static int failures = 0;
+
+static void check(bool ok, const char * what)
+{
+	printf("%s: %s\n", ok ? "ok" : "FAILED", what);
+	if (!ok)
+		failures++;
+}
+
+static int checked()
+{
+	printf("%s\n", failures == 0 ? "passed" : "FAILED");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,229 @@
+// Measures stream reassembly with FrameBuffer against a plain linear
+// buffer that memmoves what is left after each recv.
+//
+// A stream of frames sized like the real traffic (mostly poses, some
+// snapshots) is fed in as fragments of random size, the way TCP hands
+// it to recv under load, and every frame handed out is read. Both
+// buffers must come up with the same frames; the report is frames and
+// megabytes per second at each fragment size.
+//
+// usage: FrameBench [-m megabytes] [-f max_fragment]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include "FrameBuffer.h"
+#include "BufferPool.h"
+
+struct Result
+{
+	uint64_t frames = 0;
+	uint64_t digest = 0;
+	double seconds = 0.0;
+};
+
+// reads both ends of a payload, cheap enough not to hide what the
+// buffers cost, and enough to tell if they disagree
+static uint64_t fold(uint64_t digest, const char * data, int length)
+{
+	if (length == 0)
+		return digest * 31;
+
+	return digest * 31 + (unsigned char)data[0] * 7 + (unsigned char)data[length - 1] + length;
+}
+
+// frames back to back, about bytes long
+static std::vector<char> makeStream(size_t bytes)
+{
+	std::vector<char> stream;
+	stream.reserve(bytes + FRAME_HEADER_SIZE + 512);
+
+	while (stream.size() < bytes)
+	{
+		// four in five a pose, the rest snapshots
+		int length = rand() % 5 != 0 ? 15 + rand() % 16 : 100 + rand() % 413;
+
+		char header[FRAME_HEADER_SIZE];
+		writeFrameHeader(header, length);
+		stream.insert(stream.end(), header, header + FRAME_HEADER_SIZE);
+
+		for (int i = 0; i < length; i++)
+			stream.push_back((char)rand());
+	}
+
+	return stream;
+}
+
+// recv sizes, 1 to maxFragment bytes, the same for both buffers
+static std::vector<int> makeFragments(size_t bytes, int maxFragment)
+{
+	std::vector<int> fragments;
+	size_t total = 0;
+
+	while (total < bytes)
+	{
+		int fragment = 1 + rand() % maxFragment;
+		fragments.push_back(fragment);
+		total += fragment;
+	}
+
+	return fragments;
+}
+
+static Result feedFrameBuffer(const std::vector<char> & stream, const std::vector<int> & fragments)
+{
+	BufferPool pool;
+	FrameBuffer frames(pool);
+	Result result;
+
+	size_t position = 0;
+	size_t next = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	while (position < stream.size())
+	{
+		// a recv takes what the fragment has, up to what fits
+		int fragment = fragments[next++ % fragments.size()];
+		int count = fragment < frames.writable() ? fragment : frames.writable();
+		if ((size_t)count > stream.size() - position)
+			count = (int)(stream.size() - position);
+
+		memcpy(frames.writePtr(), &stream[position], count);
+		frames.commit(count);
+		position += count;
+
+		const char * payload;
+		int length;
+
+		while (frames.nextFrame(payload, length))
+		{
+			result.digest = fold(result.digest, payload, length);
+			result.frames++;
+		}
+
+		if (frames.corrupt())
+			break;
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+// the usual first attempt: recv onto the end, hand out frames from the
+// front, then move what is left down
+static Result feedLinear(const std::vector<char> & stream, const std::vector<int> & fragments)
+{
+	std::vector<char> buffer(RECV_BUFFER_HIGH_WATER);
+	int used = 0;
+	Result result;
+
+	size_t position = 0;
+	size_t next = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	while (position < stream.size())
+	{
+		int fragment = fragments[next++ % fragments.size()];
+		int count = fragment < (int)buffer.size() - used ? fragment : (int)buffer.size() - used;
+		if ((size_t)count > stream.size() - position)
+			count = (int)(stream.size() - position);
+
+		memcpy(&buffer[used], &stream[position], count);
+		used += count;
+		position += count;
+
+		int read = 0;
+
+		while (used - read >= FRAME_HEADER_SIZE)
+		{
+			int length = readFrameHeader(&buffer[read]);
+			if (used - read < FRAME_HEADER_SIZE + length)
+				break;
+
+			result.digest = fold(result.digest, &buffer[read + FRAME_HEADER_SIZE], length);
+			result.frames++;
+			read += FRAME_HEADER_SIZE + length;
+		}
+
+		memmove(&buffer[0], &buffer[read], used - read);
+		used -= read;
+	}
+
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+static void report(const char * name, const Result & result, size_t bytes)
+{
+	printf("  %-12s %10.0f frames/s  %8.1f MB/s\n", name,
+		result.frames / result.seconds, bytes / result.seconds / 1e6);
+}
+
+static void usage()
+{
+	printf("usage: FrameBench [-m megabytes] [-f max_fragment]\n");
+	printf("  -m  stream length (default 64)\n");
+	printf("  -f  largest recv, in bytes (default: runs 16, 64, 512 and 1460)\n");
+}
+
+int main(int argc, char ** argv)
+{
+	int megabytes = 64;
+	int maxFragment = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-m") == 0)
+			megabytes = atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-f") == 0)
+			maxFragment = atoi(argv[++i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (megabytes < 1 || maxFragment < 0) {
+		usage();
+		return 1;
+	}
+
+	srand(1);
+	std::vector<char> stream = makeStream((size_t)megabytes * 1000000);
+
+	std::vector<int> maxFragments;
+	if (maxFragment > 0)
+		maxFragments.push_back(maxFragment);
+	else {
+		maxFragments.push_back(16);
+		maxFragments.push_back(64);
+		maxFragments.push_back(512);
+		maxFragments.push_back(1460);
+	}
+
+	bool agreed = true;
+
+	for (size_t i = 0; i < maxFragments.size(); i++)
+	{
+		std::vector<int> fragments = makeFragments(stream.size(), maxFragments[i]);
+
+		Result ring = feedFrameBuffer(stream, fragments);
+		Result linear = feedLinear(stream, fragments);
+
+		printf("%zu bytes in fragments of 1 to %d bytes, %llu frames\n", stream.size(),
+			maxFragments[i], (unsigned long long)ring.frames);
+		report("FrameBuffer", ring, stream.size());
+		report("memmove", linear, stream.size());
+
+		if (ring.frames != linear.frames || ring.digest != linear.digest)
+		{
+			printf("  the two buffers handed out different frames\n");
+			agreed = false;
+		}
+	}
+
+	return agreed ? 0 : 1;
+}
@@ -0,0 +1,941 @@
+// Bot clients for load testing a server.
+//
+// Opens N connections, sends INIT_CONNECTION, then head poses and
+// attacks at fixed rates the way a headset would, and reports
+// throughput and round-trip latency.
+//
+// Bots play the dedicated server's side of the protocol: they decode
+// its SNAPSHOT deltas into a MatchState and ack the newest one with
+// every packet they send. With -x each bot drops its connection every
+// so many seconds and resumes its seat with its session token, and the
+// time from reconnecting to holding the resynced state is reported.
+//
+// Each bot sends its fleet once seated, and the server resolves shots
+// against it; the time from firing to seeing a hit in a snapshot is
+// reported. With -e bots keep their fleet to themselves and report
+// hits back like older clients, which costs the attacker a second
+// round trip.
+//
+// With -s that many more connections spectate, spread over the bots'
+// matches. Spectators see both players' probe numbers, and the time
+// from a bot sending a probe to a spectator decoding it is reported as
+// the fan-out latency; how it and the spectator message rate hold up
+// as -s grows shows what each extra spectator costs the server.
+//
+// Round trips are measured through the server without changing the
+// protocol: every pose a bot sends carries its own probe number in
+// position.x and the partner's latest probe number in position.y.
+// When a bot sees its own probe come back in position.y, the time
+// since it was sent is one round trip through the server and the
+// partner. The partner only echoes with its next pose, so a round trip
+// includes up to one pose interval of waiting on top of the network.
+// Poses are latest-wins, so under load some probes are replaced before
+// they return; those are counted as superseded.
+//
+// With -k the heads move instead of carrying probes: a slight sway,
+// and a quick look to the side every few seconds. Each bot sends a
+// pose only when its partner's extrapolation would be off by more than
+// the threshold (DeadReckoning), and each bot measures how far its
+// partner's head, extrapolated from what arrived, is from where it
+// really is. -k 0 sends every frame, for comparison.
+//
+// With -l every connection goes through shared memory instead of tcp
+// (LocalChannel), to a server on the same host; comparing the round
+// trips with and without shows what the loopback stack costs.
+//
+// usage: LoadGenerator [-h host] [-p port] [-n bots] [-r pose_hz]
+//                      [-a attack_hz] [-d seconds] [-x reconnect_seconds]
+//                      [-s spectators] [-e] [-k threshold_mm] [-l]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "ServerNetwork.h"
+#include "NetworkData.h"
+#include "FrameBuffer.h"
+#include "OutboundQueue.h"
+#include "Board.h"
+#include "MatchState.h"
+#include "DeadReckoning.h"
+#include "LocalChannel.h"
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#pragma comment (lib, "Ws2_32.lib")
+#define poll WSAPoll
+typedef WSAPOLLFD pollfd_t;
+#else
+#include <poll.h>
+typedef struct pollfd pollfd_t;
+#endif
+
+// probe numbers travel as whole meters, which stay exact well inside
+// the wire format's position range
+#define PROBE_RANGE (1 << 20)
+
+// send times kept per bot for matching returning probes
+#define PROBE_HISTORY 1024
+
+// with -k, every bot looks to the side for LOOK_US once per LOOK_PERIOD_US
+#define LOOK_PERIOD_US 4000000
+#define LOOK_US 500000
+
+static uint64_t nowUs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct Bot
+{
+	SOCKET socket = INVALID_SOCKET;
+
+	// -l: the connection, socket is then its doorbell
+	LocalChannel * local = NULL;
+
+	FrameBuffer * frames = NULL;
+	OutboundQueue * out = NULL;
+
+	bool connected = false;
+
+	uint64_t nextPose = 0;
+	uint64_t nextAttack = 0;
+
+	// probes
+	uint32_t probe = 0;
+	uint32_t partnerProbe = 0;
+	uint64_t sentAt[PROBE_HISTORY];
+	uint32_t lastReturned = 0;
+
+	// next cell to fire at, row major, and when each was fired at
+	int nextCell = 0;
+	uint64_t firedAt[BOARD_SIZE * BOARD_SIZE];
+	std::pair<int, int> pendingDamage = std::make_pair(-1, -1);
+
+	// match as of the newest snapshot, and the ones deltas may be
+	// taken against
+	MatchState state;
+	SnapshotHistory history;
+	int seat = -1;
+
+	// to resume the seat with, 0 until the match fills
+	uint64_t token = 0;
+	uint64_t nextReconnect = 0;
+
+	// when the current resume started, 0 if none is under way
+	uint64_t resumeStarted = 0;
+
+	// the match the server put this bot in, valid once token is set
+	unsigned int match = 0;
+
+	// spectators: the bot whose match this connection watches, and
+	// when it asked to
+	int watching = -1;
+	uint64_t joinedAt = 0;
+
+	// -k: when this bot's pose is worth sending, and the partner's
+	// head as this bot would draw it
+	DeadReckoning reckoning;
+	PoseBuffer partnerHead{0};
+};
+
+struct Totals
+{
+	uint64_t sent = 0;
+	uint64_t received = 0;
+	uint64_t bytesSent = 0;
+	uint64_t bytesReceived = 0;
+	uint64_t attacks = 0;
+	uint64_t damages = 0;
+	uint64_t superseded = 0;
+	uint64_t disconnects = 0;
+	uint64_t snapshots = 0;
+	uint64_t fullSnapshots = 0;
+	uint64_t undecodable = 0;
+	uint64_t spectated = 0;
+	uint64_t bytesSpectated = 0;
+	uint64_t spectatorsJoined = 0;
+	uint64_t poses = 0;
+
+	// microseconds
+	std::vector<uint32_t> rtt;
+	std::vector<uint32_t> resumes;
+	std::vector<uint32_t> fanout;
+	std::vector<uint32_t> hits;
+
+	// -k: partner head error, micrometers and millidegrees
+	std::vector<uint32_t> drift;
+	std::vector<uint32_t> driftAngle;
+};
+
+// every bot's ships: one per row, 5 4 3 2 2 cells from column 0
+static Board botFleet()
+{
+	static const int lengths[] = { 5, 4, 3, 2, 2 };
+	Board board;
+
+	for (int ship = 0; ship < 5; ship++)
+	{
+		std::vector<std::pair<int, int> > cells;
+		for (int i = 0; i < lengths[ship]; i++)
+			cells.push_back(std::make_pair(ship * 2, i));
+		board.placeShip(cells);
+	}
+
+	return board;
+}
+
+// bots report hits themselves (-e) instead of sending their fleet
+static bool echoHits = false;
+
+// connect through shared memory (-l)
+static bool connectLocal = false;
+
+// -k threshold in mm, heads move and poses are dead reckoned. negative
+// when bots send probes instead
+static float reckonMm = -1.0f;
+
+// the head every bot wears with -k, so a partner knows where it really is
+static glm::mat4 syntheticHead(uint64_t time)
+{
+	const float pi = 3.14159265f;
+	double t = time / 1e6;
+
+	// breathing and a little yaw sway
+	glm::vec3 position(0.0f, 1.6f + 0.002f * (float)sin(2.0 * pi * 0.25 * t), 0.0f);
+	float yaw = 0.01f * (float)sin(2.0 * pi * 0.2 * t);
+
+	// and a look to the side, out and back
+	uint64_t phase = time % LOOK_PERIOD_US;
+	if (phase < LOOK_US) {
+		float w = (float)sin(pi * (double)phase / LOOK_US);
+		yaw += 0.5f * w;
+		position.x += 0.05f * w;
+	}
+
+	return makePose(position, glm::angleAxis(yaw, glm::vec3(0.0f, 1.0f, 0.0f)));
+}
+
+static void usage()
+{
+	printf("usage: LoadGenerator [-h host] [-p port] [-n bots] [-r pose_hz] [-a attack_hz] [-d seconds] [-x reconnect_seconds] [-s spectators] [-e] [-k mm] [-l]\n");
+	printf("  -h  server host (default 127.0.0.1)\n");
+	printf("  -p  server port (default %s)\n", DEFAULT_PORT);
+	printf("  -n  connections, paired by the server (default 100)\n");
+	printf("  -r  head poses per second per bot (default 90)\n");
+	printf("  -a  attacks per second per bot (default 1)\n");
+	printf("  -d  seconds to run (default 10)\n");
+	printf("  -x  seconds between each bot dropping and resuming, 0 = never (default 0)\n");
+	printf("  -s  extra connections watching the bots' matches (default 0)\n");
+	printf("  -e  report hits back instead of sending the fleet, like older clients\n");
+	printf("  -k  move the heads and send a pose once the partner's guess is this many mm off,\n");
+	printf("      0 = every frame. replaces the round trip probes\n");
+	printf("  -l  connect through shared memory to a server on this host, Linux only\n");
+}
+
+static SOCKET connectTo(const char * host, const char * port)
+{
+	struct addrinfo hints;
+	struct addrinfo * result = NULL;
+
+	ZeroMemory(&hints, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+
+	if (getaddrinfo(host, port, &hints, &result) != 0)
+		return INVALID_SOCKET;
+
+	SOCKET s = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+
+	if (s != INVALID_SOCKET && connect(s, result->ai_addr, (int)result->ai_addrlen) == SOCKET_ERROR)
+	{
+		closesocket(s);
+		s = INVALID_SOCKET;
+	}
+
+	freeaddrinfo(result);
+
+	if (s == INVALID_SOCKET)
+		return INVALID_SOCKET;
+
+	int value = 1;
+	setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char *)&value, sizeof(value));
+	NetworkServices::setNonBlocking(s);
+
+	return s;
+}
+
+// connect a bot the way -l says, false if the server isn't there
+static bool open(Bot & bot, const char * host, const char * port)
+{
+	if (connectLocal) {
+		bot.local = LocalChannel::connect(port);
+		bot.socket = bot.local != NULL ? bot.local->socket : INVALID_SOCKET;
+	}
+	else
+		bot.socket = connectTo(host, port);
+
+	return bot.socket != INVALID_SOCKET;
+}
+
+static void hangUp(Bot & bot)
+{
+	if (bot.local != NULL)
+		delete bot.local;
+	else
+		closesocket(bot.socket);
+
+	bot.local = NULL;
+	bot.socket = INVALID_SOCKET;
+}
+
+// write what the bot queued, FlushResults
+static int flush(Bot & bot)
+{
+	if (bot.local == NULL)
+		return bot.out->flush(bot.socket);
+
+	const char * buffers[SEND_GATHER_MAX];
+	int lengths[SEND_GATHER_MAX];
+
+	while (!bot.out->empty())
+	{
+		int parts = bot.out->gather(buffers, lengths, SEND_GATHER_MAX);
+		int total = 0;
+		for (int i = 0; i < parts; i++)
+			total += lengths[i];
+
+		int written = bot.local->write(buffers, lengths, parts);
+
+		if (written == SOCKET_ERROR || !bot.out->consume(written))
+			return FLUSH_ERROR;
+
+		// full until the server reads, which rings the doorbell
+		if (written < total) {
+			bot.local->wantSpace(true);
+			return FLUSH_BLOCKED;
+		}
+	}
+
+	return FLUSH_DONE;
+}
+
+static void queueFrame(Bot & bot, Totals & totals, char * data, int size, bool latestWins)
+{
+	writeFrameHeader(data, size);
+
+	bool queued = latestWins ? bot.out->pushPose(data, FRAME_HEADER_SIZE + size)
+		: bot.out->push(data, FRAME_HEADER_SIZE + size);
+
+	if (queued) {
+		totals.sent++;
+		totals.bytesSent += FRAME_HEADER_SIZE + size;
+	}
+}
+
+static void queuePacket(Bot & bot, Totals & totals, const Packet & packet, bool latestWins)
+{
+	char data[FRAME_HEADER_SIZE + PACKET_MAX_SIZE];
+	int size = packet.serialize(data + FRAME_HEADER_SIZE);
+	queueFrame(bot, totals, data, size, latestWins);
+}
+
+// cells the server has us down as having fired at
+static int firedCount(const Bot & bot)
+{
+	int count = 0;
+
+	for (int cell = 0; cell < BOARD_SIZE * BOARD_SIZE; cell++)
+		if (bot.state.shots[bot.seat][cell] != CELL_EMPTY)
+			count++;
+
+	return count;
+}
+
+static void sendDue(Bot & bot, Totals & totals, uint64_t now, uint64_t poseInterval, uint64_t attackInterval)
+{
+	Packet packet;
+	packet.packet_type = ACTION_EVENT;
+	packet.attack = std::make_pair(-1, -1);
+	packet.damage = std::make_pair(-1, -1);
+	packet.done = true;
+
+	bool event = false;
+
+	// fire only in turn, once both fleets are placed and the server
+	// has our last shot, or the server drops it
+	const MatchState & state = bot.state;
+	bool ourTurn = bot.seat >= 0 && state.done[0] && state.done[1] && state.turn == bot.seat &&
+		firedCount(bot) == bot.nextCell;
+
+	if (attackInterval > 0 && now >= bot.nextAttack && ourTurn && bot.nextCell < BOARD_SIZE * BOARD_SIZE)
+	{
+		packet.attack = std::make_pair(bot.nextCell / BOARD_SIZE, bot.nextCell % BOARD_SIZE);
+		bot.firedAt[bot.nextCell] = now;
+		bot.nextCell++;
+		bot.nextAttack += attackInterval;
+		totals.attacks++;
+		event = true;
+	}
+
+	if (bot.pendingDamage.first != -1)
+	{
+		packet.damage = bot.pendingDamage;
+		bot.pendingDamage = std::make_pair(-1, -1);
+		event = true;
+	}
+
+	if (!event && now < bot.nextPose)
+		return;
+
+	if (now >= bot.nextPose)
+		bot.nextPose += poseInterval;
+
+	if (reckonMm >= 0.0f)
+	{
+		glm::mat4 head = syntheticHead(now);
+
+		// a frame whose pose the partner can guess costs nothing
+		if (!event && reckonMm > 0.0f && !bot.reckoning.due(head, now))
+			return;
+
+		bot.reckoning.sent(head, now);
+		packet.headPose = head;
+		packet.timestamp = now;
+	}
+	else
+	{
+		bot.probe = (bot.probe + 1) % PROBE_RANGE;
+		bot.sentAt[bot.probe % PROBE_HISTORY] = now;
+
+		packet.headPose = makePose(glm::vec3((float)bot.probe, (float)bot.partnerProbe, 0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	}
+
+	packet.ack = bot.state.seq;
+
+	if (!event)
+		totals.poses++;
+
+	queuePacket(bot, totals, packet, !event);
+}
+
+// the server checks on connections it hasn't heard from in a while
+static void answerPing(Bot & bot, Totals & totals, const char * payload, int length, uint64_t now)
+{
+	ClockPacket clock;
+	if (!clock.deserialize(payload, length))
+		return;
+
+	clock.packet_type = PONG;
+	clock.received = now;
+	clock.transmit = now;
+
+	char data[FRAME_HEADER_SIZE + CLOCK_PACKET_MAX_SIZE];
+	queueFrame(bot, totals, data, clock.serialize(data + FRAME_HEADER_SIZE), false);
+}
+
+static void handle(Bot & bot, Totals & totals, const char * payload, int length, uint64_t now)
+{
+	totals.received++;
+	totals.bytesReceived += FRAME_HEADER_SIZE + length;
+
+	unsigned int type = peekPacketType(payload, length);
+
+	if (type == SESSION_TOKEN)
+	{
+		TokenPacket token;
+		if (!token.deserialize(payload, length))
+			return;
+
+		// the first token means a new match, a resumed bot gets none
+		if (bot.token == 0 && !echoHits) {
+			FleetPacket fleet;
+			fleet.fromBoard(botFleet());
+
+			char data[FRAME_HEADER_SIZE + FLEET_PACKET_MAX_SIZE];
+			queueFrame(bot, totals, data, fleet.serialize(data + FRAME_HEADER_SIZE), false);
+		}
+
+		bot.token = token.token;
+		bot.match = token.match;
+		return;
+	}
+
+	if (type == RESYNC)
+	{
+		if (!bot.state.readResync(payload, length, bot.seat)) {
+			totals.undecodable++;
+			return;
+		}
+
+		bot.history.store(bot.state);
+
+		if (bot.resumeStarted != 0) {
+			totals.resumes.push_back((uint32_t)(now - bot.resumeStarted));
+			bot.resumeStarted = 0;
+		}
+		return;
+	}
+
+	if (type != SNAPSHOT)
+		return;
+
+	MatchState previous = bot.state;
+
+	if (!bot.state.readSnapshot(payload, length, bot.history, bot.seat)) {
+		totals.undecodable++;
+		return;
+	}
+
+	bot.history.store(bot.state);
+	totals.snapshots++;
+
+	WireReader header(payload, length);
+	header.readVarint();
+	header.readVarint();
+	if (header.readVarint() == 0)
+		totals.fullSnapshots++;
+
+	int partner = 1 - bot.seat;
+	glm::vec3 position = bot.state.position[partner];
+
+	if (reckonMm >= 0.0f)
+	{
+		// stamped by the partner on our own clock; repeats are dropped
+		if (bot.state.poseTime[partner] != 0)
+			bot.partnerHead.push(makePose(position, bot.state.orientation[partner]), bot.state.poseTime[partner]);
+	}
+	else
+	{
+		bot.partnerProbe = (uint32_t)position.x;
+
+		uint32_t returned = (uint32_t)position.y;
+
+		// our probe back from the partner, the first time we see it
+		if (returned != 0 && returned != bot.lastReturned &&
+			(bot.probe - returned) % PROBE_RANGE < PROBE_HISTORY)
+		{
+			uint32_t skipped = (returned - bot.lastReturned) % PROBE_RANGE;
+			if (bot.lastReturned != 0 && skipped > 1)
+				totals.superseded += skipped - 1;
+
+			totals.rtt.push_back((uint32_t)(now - bot.sentAt[returned % PROBE_HISTORY]));
+			bot.lastReturned = returned;
+		}
+	}
+
+	for (int cell = 0; cell < BOARD_SIZE * BOARD_SIZE; cell++)
+	{
+		int row = cell / BOARD_SIZE;
+		int column = cell % BOARD_SIZE;
+
+		// the partner fired at us: call every other cell a hit
+		if (echoHits && bot.state.shots[partner][cell] == CELL_MISSED &&
+			previous.shots[partner][cell] == CELL_EMPTY && (row + column) % 2 == 0)
+			bot.pendingDamage = std::make_pair(row, column);
+
+		if (bot.state.shots[bot.seat][cell] == CELL_SHOOTED && previous.shots[bot.seat][cell] != CELL_SHOOTED) {
+			totals.damages++;
+			totals.hits.push_back((uint32_t)(now - bot.firedAt[cell]));
+		}
+	}
+}
+
+// -k: how far off the partner's head is, drawn from what arrived
+static void measureDrift(const Bot & bot, Totals & totals, uint64_t now)
+{
+	glm::mat4 guess;
+
+	if (!bot.partnerHead.sample(now, guess))
+		return;
+
+	glm::mat4 truth = syntheticHead(now);
+
+	float d = fabsf(glm::dot(poseOrientation(guess), poseOrientation(truth)));
+	float angle = 2.0f * acosf(d > 1.0f ? 1.0f : d);
+
+	totals.drift.push_back((uint32_t)(glm::length(posePosition(guess) - posePosition(truth)) * 1e6f));
+	totals.driftAngle.push_back((uint32_t)(angle * 180.0f / 3.14159265f * 1000.0f));
+}
+
+// what a spectator gets: the match stream, and in it the watched bot's
+// probes on their way to its partner
+static void watch(Bot & spectator, const Bot & player, Totals & totals, const char * payload, int length, uint64_t now)
+{
+	totals.spectated++;
+	totals.bytesSpectated += FRAME_HEADER_SIZE + length;
+
+	unsigned int type = peekPacketType(payload, length);
+	int seat;
+
+	if (type == RESYNC)
+	{
+		if (spectator.state.readResync(payload, length, seat))
+			spectator.history.store(spectator.state);
+		else
+			totals.undecodable++;
+		return;
+	}
+
+	if (type != SNAPSHOT)
+		return;
+
+	if (!spectator.state.readSnapshot(payload, length, spectator.history, seat)) {
+		totals.undecodable++;
+		return;
+	}
+
+	spectator.history.store(spectator.state);
+
+	if (player.seat < 0)
+		return;
+
+	uint32_t probe = (uint32_t)spectator.state.position[player.seat].x;
+
+	if (probe != 0 && probe != spectator.lastReturned &&
+		(player.probe - probe) % PROBE_RANGE < PROBE_HISTORY)
+	{
+		totals.fanout.push_back((uint32_t)(now - player.sentAt[probe % PROBE_HISTORY]));
+		spectator.lastReturned = probe;
+	}
+}
+
+// start watching the match of the bot a spectator was given
+static void join(Bot & spectator, const Bot & player, Totals & totals, BufferPool & pool,
+	const char * host, const char * port, uint64_t now)
+{
+	spectator.joinedAt = now;
+
+	if (!open(spectator, host, port)) {
+		totals.disconnects++;
+		return;
+	}
+
+	spectator.connected = true;
+	spectator.frames = new FrameBuffer(pool);
+	spectator.out = new OutboundQueue(pool);
+	totals.spectatorsJoined++;
+
+	TokenPacket request;
+	request.packet_type = SPECTATE;
+	request.token = player.match;
+
+	char data[FRAME_HEADER_SIZE + TOKEN_PACKET_MAX_SIZE];
+	int size = request.serialize(data + FRAME_HEADER_SIZE);
+	writeFrameHeader(data, size);
+	spectator.out->push(data, FRAME_HEADER_SIZE + size);
+}
+
+static void dropBot(Bot & bot, Totals & totals)
+{
+	hangUp(bot);
+	bot.connected = false;
+	totals.disconnects++;
+}
+
+// hang up and take the seat back on a fresh connection
+static void reconnect(Bot & bot, Totals & totals, BufferPool & pool, const char * host, const char * port, uint64_t now)
+{
+	hangUp(bot);
+
+	delete bot.frames;
+	delete bot.out;
+	bot.frames = new FrameBuffer(pool);
+	bot.out = new OutboundQueue(pool);
+
+	if (!open(bot, host, port)) {
+		bot.connected = false;
+		totals.disconnects++;
+		return;
+	}
+
+	bot.resumeStarted = now;
+
+	TokenPacket resume;
+	resume.packet_type = RESUME;
+	resume.token = bot.token;
+
+	char data[FRAME_HEADER_SIZE + TOKEN_PACKET_MAX_SIZE];
+	queueFrame(bot, totals, data, resume.serialize(data + FRAME_HEADER_SIZE), false);
+}
+
+static uint32_t percentile(const std::vector<uint32_t> & sorted, double p)
+{
+	if (sorted.empty())
+		return 0;
+
+	size_t index = (size_t)ceil(p * sorted.size()) - 1;
+	return sorted[std::min(index, sorted.size() - 1)];
+}
+
+int main(int argc, char ** argv)
+{
+	const char * host = "127.0.0.1";
+	const char * port = DEFAULT_PORT;
+	int botCount = 100;
+	double poseRate = 90.0;
+	double attackRate = 1.0;
+	int seconds = 10;
+	double reconnectSeconds = 0.0;
+	int spectatorCount = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-e") == 0) { echoHits = true; continue; }
+		if (strcmp(argv[i], "-l") == 0) { connectLocal = true; continue; }
+
+		if (i + 1 >= argc) { usage(); return 1; }
+
+		if (strcmp(argv[i], "-h") == 0) host = argv[++i];
+		else if (strcmp(argv[i], "-p") == 0) port = argv[++i];
+		else if (strcmp(argv[i], "-n") == 0) botCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-r") == 0) poseRate = atof(argv[++i]);
+		else if (strcmp(argv[i], "-a") == 0) attackRate = atof(argv[++i]);
+		else if (strcmp(argv[i], "-d") == 0) seconds = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-x") == 0) reconnectSeconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "-s") == 0) spectatorCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-k") == 0) reckonMm = (float)atof(argv[++i]);
+		else { usage(); return 1; }
+	}
+
+	if (botCount <= 0 || poseRate <= 0.0 || spectatorCount < 0) {
+		usage();
+		return 1;
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+	BufferPool pool;
+	// players first, then spectators spread over them
+	std::vector<Bot> bots(botCount + spectatorCount);
+	Totals totals;
+
+	uint64_t poseInterval = (uint64_t)(1000000.0 / poseRate);
+	uint64_t attackInterval = attackRate > 0.0 ? (uint64_t)(1000000.0 / attackRate) : 0;
+	uint64_t reconnectInterval = (uint64_t)(reconnectSeconds * 1000000.0);
+
+	for (int i = 0; i < botCount; i++)
+	{
+		Bot & bot = bots[i];
+
+		if (!open(bot, host, port)) {
+			printf("bot %d could not connect to %s:%s\n", i, host, port);
+			continue;
+		}
+
+		bot.connected = true;
+		bot.frames = new FrameBuffer(pool);
+		bot.out = new OutboundQueue(pool);
+
+		// spread the bots over one pose interval so they don't all send at once
+		uint64_t now = nowUs();
+		bot.nextPose = now + poseInterval * i / botCount;
+		bot.nextAttack = now + (attackInterval ? attackInterval * i / botCount : 0);
+		bot.nextReconnect = now + reconnectInterval + reconnectInterval * i / botCount;
+
+		Packet init;
+		init.packet_type = INIT_CONNECTION;
+		init.attack = std::make_pair(-1, -1);
+		init.damage = std::make_pair(-1, -1);
+		init.done = false;
+		init.headPose = glm::mat4(1.0f);
+		queuePacket(bot, totals, init, false);
+	}
+
+	for (int i = 0; i < spectatorCount; i++)
+		bots[botCount + i].watching = i % botCount;
+
+	for (int i = 0; i < botCount && reckonMm > 0.0f; i++)
+		bots[i].reckoning.positionThreshold = reckonMm / 1000.0f;
+
+	uint64_t start = nowUs();
+	uint64_t end = start + (uint64_t)seconds * 1000000;
+
+	// connected bots and their poll entries
+	std::vector<pollfd_t> fds;
+	std::vector<int> polled;
+
+	for (uint64_t now = start; now < end; now = nowUs())
+	{
+		fds.clear();
+		polled.clear();
+
+		for (int i = 0; i < (int)bots.size(); i++)
+		{
+			Bot & bot = bots[i];
+
+			// a spectator joins once the server has told its bot the match
+			if (bot.watching >= 0 && bot.joinedAt == 0 && bots[bot.watching].token != 0)
+				join(bot, bots[bot.watching], totals, pool, host, port, now);
+
+			if (!bot.connected)
+				continue;
+
+			if (bot.watching < 0 && reconnectInterval > 0 && bot.token != 0 && now >= bot.nextReconnect) {
+				bot.nextReconnect += reconnectInterval;
+				reconnect(bot, totals, pool, host, port, now);
+
+				if (!bot.connected)
+					continue;
+			}
+
+			if (bot.watching < 0)
+				sendDue(bot, totals, now, poseInterval, attackInterval);
+
+			if (flush(bot) == FLUSH_ERROR) {
+				dropBot(bot, totals);
+				continue;
+			}
+
+			pollfd_t pfd;
+			pfd.fd = bot.socket;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			// a local bot's room for more rings like data would
+			if (!bot.out->empty() && bot.local == NULL)
+				pfd.events |= POLLOUT;
+
+			fds.push_back(pfd);
+			polled.push_back(i);
+		}
+
+		if (fds.empty()) {
+			printf("no bots left connected\n");
+			break;
+		}
+
+		// sleep until the next send is due, or data comes in
+		int wait_ms = (int)(poseInterval / 4000);
+
+		// a local bot with something waiting already keeps it from
+		// sleeping, the others arm their doorbells
+		for (size_t k = 0; k < fds.size() && wait_ms > 0; k++)
+		{
+			if (bots[polled[k]].local != NULL && !bots[polled[k]].local->sleep())
+				wait_ms = 0;
+		}
+
+		poll(&fds[0], (unsigned long)fds.size(), wait_ms);
+
+		now = nowUs();
+
+		for (size_t k = 0; k < fds.size(); k++)
+		{
+			Bot & bot = bots[polled[k]];
+			bool rang = (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+			int n;
+
+			if (bot.local != NULL)
+			{
+				// the ring is looked at whether it rang or not
+				bot.local->quiet();
+				if (rang)
+					bot.local->drain();
+
+				n = bot.local->read(bot.frames->writePtr(), bot.frames->writable());
+			}
+			else if (rang)
+				n = NetworkServices::receiveMessage(bot.socket, bot.frames->writePtr(), bot.frames->writable());
+			else
+				continue;
+
+			if (n == 0 || (n == SOCKET_ERROR && !NetworkServices::wouldBlock())) {
+				dropBot(bot, totals);
+				continue;
+			}
+
+			if (n <= 0)
+				continue;
+
+			bot.frames->commit(n);
+
+			const char * payload;
+			int length;
+
+			while (bot.frames->nextFrame(payload, length))
+			{
+				if (peekPacketType(payload, length) == PING)
+					answerPing(bot, totals, payload, length, now);
+				else if (bot.watching >= 0)
+					watch(bot, bots[bot.watching], totals, payload, length, now);
+				else
+					handle(bot, totals, payload, length, now);
+			}
+		}
+
+		// what each bot would draw for its partner right now
+		for (int i = 0; i < botCount && reckonMm >= 0.0f; i++)
+		{
+			if (bots[i].connected)
+				measureDrift(bots[i], totals, now);
+		}
+	}
+
+	double elapsed = (nowUs() - start) / 1000000.0;
+
+	std::sort(totals.rtt.begin(), totals.rtt.end());
+	std::sort(totals.resumes.begin(), totals.resumes.end());
+	std::sort(totals.fanout.begin(), totals.fanout.end());
+	std::sort(totals.hits.begin(), totals.hits.end());
+	std::sort(totals.drift.begin(), totals.drift.end());
+	std::sort(totals.driftAngle.begin(), totals.driftAngle.end());
+
+	printf("%d bots for %.1f s, %.0f poses/s and %.1f attacks/s each\n", botCount, elapsed, poseRate, attackRate);
+	printf("sent      %llu messages (%.0f/s, %.2f MB/s)\n", (unsigned long long)totals.sent,
+		totals.sent / elapsed, totals.bytesSent / elapsed / 1e6);
+	printf("received  %llu messages (%.0f/s, %.2f MB/s)\n", (unsigned long long)totals.received,
+		totals.received / elapsed, totals.bytesReceived / elapsed / 1e6);
+	printf("attacks   %llu sent, %llu hits reported back\n", (unsigned long long)totals.attacks,
+		(unsigned long long)totals.damages);
+	printf("poses     %llu without an event (%.1f/s per bot)\n", (unsigned long long)totals.poses,
+		totals.poses / elapsed / botCount);
+	if (reckonMm >= 0.0f) {
+		printf("drift     partner head off by mm p50 %.1f  p99 %.1f  max %.1f\n",
+			percentile(totals.drift, 0.50) / 1000.0, percentile(totals.drift, 0.99) / 1000.0,
+			(totals.drift.empty() ? 0 : totals.drift.back()) / 1000.0);
+		printf("          and by degrees p50 %.2f  p99 %.2f  max %.2f\n",
+			percentile(totals.driftAngle, 0.50) / 1000.0, percentile(totals.driftAngle, 0.99) / 1000.0,
+			(totals.driftAngle.empty() ? 0 : totals.driftAngle.back()) / 1000.0);
+	}
+	printf("hits (us) fired to seen, p50 %u  p99 %u  max %u\n", percentile(totals.hits, 0.50),
+		percentile(totals.hits, 0.99), totals.hits.empty() ? 0 : totals.hits.back());
+	printf("rtt       %llu samples, %llu probes superseded\n", (unsigned long long)totals.rtt.size(),
+		(unsigned long long)totals.superseded);
+	printf("rtt (us)  p50 %u  p99 %u  p999 %u  max %u\n", percentile(totals.rtt, 0.50),
+		percentile(totals.rtt, 0.99), percentile(totals.rtt, 0.999),
+		totals.rtt.empty() ? 0 : totals.rtt.back());
+	printf("snapshots %llu decoded, %llu of them full, %llu against an unknown base\n",
+		(unsigned long long)totals.snapshots, (unsigned long long)totals.fullSnapshots,
+		(unsigned long long)totals.undecodable);
+	if (reconnectInterval > 0)
+		printf("resumes   %llu, us p50 %u  p99 %u  max %u\n", (unsigned long long)totals.resumes.size(),
+			percentile(totals.resumes, 0.50), percentile(totals.resumes, 0.99),
+			totals.resumes.empty() ? 0 : totals.resumes.back());
+	if (spectatorCount > 0) {
+		printf("spectated %llu joined, %llu messages (%.0f/s, %.2f MB/s)\n",
+			(unsigned long long)totals.spectatorsJoined, (unsigned long long)totals.spectated,
+			totals.spectated / elapsed, totals.bytesSpectated / elapsed / 1e6);
+		printf("fan-out   %llu samples, us p50 %u  p99 %u  p999 %u  max %u\n",
+			(unsigned long long)totals.fanout.size(), percentile(totals.fanout, 0.50),
+			percentile(totals.fanout, 0.99), percentile(totals.fanout, 0.999),
+			totals.fanout.empty() ? 0 : totals.fanout.back());
+	}
+	printf("dropped   %llu connections\n", (unsigned long long)totals.disconnects);
+
+	for (int i = 0; i < (int)bots.size(); i++)
+	{
+		if (bots[i].connected)
+			hangUp(bots[i]);
+		delete bots[i].frames;
+		delete bots[i].out;
+	}
+
+	return 0;
+}
@@ -0,0 +1,162 @@
+// Checks that a server hangs up on a local client that breaks its
+// rings, instead of copying past them.
+//
+// The client here is hostile: it connects by hand, maps the segment
+// the server hands it and writes ring positions no ring can have, one
+// direction at a time. A server that trusted them would read or write
+// outside the segment's data; one that doesn't drops the session and
+// tells the client it hung up.
+//
+// usage: LocalChannelTest [port]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/un.h>
+#include "ServerNetwork.h"
+#include "Check.h"
+
+// connect to the server's local socket the way LocalChannel::connect
+// does, accepting on network in between, and map what it hands out
+static LocalSegment * connectByHand(ServerNetwork & network, const char * port, SOCKET & socket, unsigned int & id)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	int length = snprintf(address.sun_path + 1, sizeof(address.sun_path) - 1, "%s%s", LOCAL_SOCKET_PREFIX, port);
+
+	socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+	if (::connect(socket, (struct sockaddr *)&address, (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1 + length)) != 0)
+		return NULL;
+
+	// queued in the backlog: the server's next wait sees it
+	id = INVALID_SESSION;
+	for (int tries = 0; tries < 100 && id == INVALID_SESSION; tries++)
+	{
+		network.waitForEvents(10);
+		network.acceptNewClient(id);
+	}
+
+	if (id == INVALID_SESSION)
+		return NULL;
+
+	char byte;
+	struct iovec part;
+	part.iov_base = &byte;
+	part.iov_len = 1;
+
+	char control[CMSG_SPACE(sizeof(int))];
+	memset(control, 0, sizeof(control));
+
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &part;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	if (recvmsg(socket, &message, MSG_CMSG_CLOEXEC) != 1 || CMSG_FIRSTHDR(&message) == NULL)
+		return NULL;
+
+	int memory;
+	memcpy(&memory, CMSG_DATA(CMSG_FIRSTHDR(&message)), sizeof(int));
+
+	void * mapped = mmap(NULL, sizeof(LocalSegment), PROT_READ | PROT_WRITE, MAP_SHARED, memory, 0);
+	close(memory);
+
+	return mapped != MAP_FAILED ? (LocalSegment *)mapped : NULL;
+}
+
+static bool closed(ServerNetwork & network, unsigned int id)
+{
+	return network.sessions.find(id) == NULL &&
+		std::find(network.closedClients.begin(), network.closedClients.end(), id) != network.closedClients.end();
+}
+
+// a tail past what the ring holds: the server's read would copy the
+// claimed length out of memory beyond the ring
+static void brokenTail(ServerNetwork & network, const char * port)
+{
+	SOCKET socket;
+	unsigned int id;
+	LocalSegment * segment = connectByHand(network, port, socket, id);
+
+	check(segment != NULL, "hostile client connected");
+	if (segment == NULL)
+		return;
+
+	segment->toServer.tail.store(segment->toServer.head.load() + 0x80000000u);
+
+	// wider than the segment, so nothing but the check stops the copy
+	std::vector<char> buffer(4 * sizeof(LocalSegment));
+
+	for (int tries = 0; tries < 100 && network.sessions.find(id) != NULL; tries++)
+	{
+		network.waitForEvents(10);
+
+		std::vector<unsigned int> ready = network.readyClients;
+		for (size_t i = 0; i < ready.size(); i++)
+			network.receiveData(ready[i], &buffer[0], (int)buffer.size());
+	}
+
+	check(closed(network, id), "session with a broken tail dropped on read");
+	check(segment->closed.load() != 0, "client told the server hung up");
+
+	network.closedClients.clear();
+	munmap(segment, sizeof(LocalSegment));
+	closesocket(socket);
+}
+
+// a head ahead of the tail: the server's write would see the ring's
+// room wrap around to most of the address space
+static void brokenHead(ServerNetwork & network, const char * port)
+{
+	SOCKET socket;
+	unsigned int id;
+	LocalSegment * segment = connectByHand(network, port, socket, id);
+
+	check(segment != NULL, "hostile client connected");
+	if (segment == NULL)
+		return;
+
+	segment->toClient.head.store(segment->toClient.tail.load() + 0x80000000u);
+
+	std::vector<char> payload(LOCAL_RING_SIZE / 2, 'x');
+	bool sent = true;
+
+	// more than the ring holds in all, had the ring been honest
+	for (int i = 0; i < 4 && sent; i++)
+		sent = network.sendTo(id, &payload[0], (int)payload.size());
+
+	check(!sent, "send to a broken head refused");
+	check(closed(network, id), "session with a broken head dropped on write");
+	check(segment->closed.load() != 0, "client told the server hung up");
+
+	network.closedClients.clear();
+	munmap(segment, sizeof(LocalSegment));
+	closesocket(socket);
+}
+
+int main(int argc, char ** argv)
+{
+	const char * port = argc > 1 ? argv[1] : "6889";
+
+	ServerNetwork network(port, false);
+
+	if (network.ListenSocket == INVALID_SOCKET)
+	{
+		printf("can't listen on %s\n", port);
+		return 1;
+	}
+
+	// large sends stay queued rather than dropping the client as slow
+	network.send_high_water = 4 * LOCAL_RING_SIZE;
+
+	brokenTail(network, port);
+	brokenHead(network, port);
+
+	return checked();
+}
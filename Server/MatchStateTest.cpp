@@ -0,0 +1,389 @@
+// Checks the match codecs offline: snapshots, resyncs and the LZ
+// compressor under them.
+//
+// A made up match runs for a while, poses, flags and shots changing
+// at random, and each state is encoded as a SNAPSHOT against several
+// bases: none, the one before, a few back, and the oldest the history
+// still holds. Each must decode on the far side, from that side's own
+// copy of the base, to the state that was encoded. A RESYNC of the
+// state must decode to it for each seat and for spectators. A NaN or
+// huge position must encode as 0 or the furthest one there is.
+//
+// The compressor must round trip empty, incompressible and highly
+// repetitive input. Decompressing input that was cut short must fail,
+// and damaged input must never be written past the buffer it was
+// given, whether or not it happens to still decode.
+//
+// usage: MatchStateTest
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "MatchState.h"
+#include "WireFormat.h"
+#include "Check.h"
+
+// how many states the match runs through
+#define STEPS 200
+
+// snapshot bases tried for each state, as distance back. 0 = none
+static const int BASES[] = { 0, 1, 4, SNAPSHOT_HISTORY - 1 };
+#define BASE_COUNT (int)(sizeof(BASES) / sizeof(BASES[0]))
+
+// bytes past a decompression buffer that must stay untouched
+#define GUARD 64
+#define GUARD_BYTE 0x5A
+
+static float randomFloat(float range)
+{
+	return (rand() / (float)RAND_MAX * 2.0f - 1.0f) * range;
+}
+
+// one step of play: some of a head moves, a flag flips, a cell is
+// fired at or reported hit
+static void play(MatchState & state, int step)
+{
+	int seat = rand() % MATCH_SEATS;
+
+	if (rand() % 2 == 0)
+	{
+		state.position[seat] = glm::vec3(randomFloat(2.0f), 1.6f + randomFloat(0.3f), randomFloat(2.0f));
+		state.orientation[seat] = glm::angleAxis(randomFloat(3.1f), glm::vec3(0.0f, 1.0f, 0.0f)) *
+			glm::angleAxis(randomFloat(0.5f), glm::vec3(1.0f, 0.0f, 0.0f));
+		state.poseTime[seat] = 1000000ull + step * 11111ull;
+	}
+
+	if (rand() % 10 == 0)
+		state.done[seat] = !state.done[seat];
+
+	if (rand() % 5 == 0)
+		state.turn = 1 - state.turn;
+
+	if (rand() % 3 == 0)
+		state.shots[seat][rand() % (BOARD_SIZE * BOARD_SIZE)] = rand() % 2 ? CELL_MISSED : CELL_SHOOTED;
+}
+
+// what the far side should hold: everything the same, poses to within
+// their quantization. a player isn't sent its own pose
+static bool same(const MatchState & got, const MatchState & want, int seat)
+{
+	if (got.seq != want.seq || got.turn != want.turn || memcmp(got.shots, want.shots, sizeof(want.shots)) != 0)
+		return false;
+
+	for (int s = 0; s < MATCH_SEATS; s++)
+	{
+		if (got.done[s] != want.done[s])
+			return false;
+
+		if (s == seat)
+			continue;
+
+		if (glm::length(got.position[s] - want.position[s]) > 2.0f / POSITION_SCALE ||
+			fabsf(glm::dot(got.orientation[s], want.orientation[s])) < 0.999f ||
+			got.poseTime[s] != want.poseTime[s])
+			return false;
+	}
+
+	return true;
+}
+
+static bool guardIntact(const char * buffer, int capacity)
+{
+	for (int i = 0; i < GUARD; i++)
+		if ((uint8_t)buffer[capacity + i] != GUARD_BYTE)
+			return false;
+	return true;
+}
+
+// compress and decompress length bytes. returns the compressed size,
+// -1 if the round trip didn't give them back
+static int roundTrip(const char * source, int length)
+{
+	static char compressed[LZ_BOUND(4096)];
+	static char restored[4096 + GUARD];
+
+	int size = lzCompress(source, length, compressed, sizeof(compressed));
+	if (size < 0)
+		return -1;
+
+	memset(restored, GUARD_BYTE, sizeof(restored));
+
+	if (!lzDecompress(compressed, size, restored, length) || memcmp(restored, source, length) != 0 ||
+		!guardIntact(restored, length))
+		return -1;
+
+	return size;
+}
+
+static void checkSnapshots()
+{
+	// the server's side: the states it sent. the far side's: what it
+	// decoded, which deltas are applied to
+	MatchState server;
+	SnapshotHistory sent;
+	MatchState players[MATCH_SEATS + 1];
+	SnapshotHistory decoded[MATCH_SEATS + 1];
+
+	int bad[BASE_COUNT] = { 0 };
+	int tried[BASE_COUNT] = { 0 };
+	int wrongSeat = 0;
+	int largest = 0;
+
+	for (int step = 1; step <= STEPS; step++)
+	{
+		play(server, step);
+		server.seq++;
+		sent.store(server);
+
+		// each player, then spectators
+		for (int who = 0; who <= MATCH_SEATS; who++)
+		{
+			int seat = who < MATCH_SEATS ? who : SPECTATOR_SEAT;
+
+			for (int b = 0; b < BASE_COUNT; b++)
+			{
+				const MatchState * base = NULL;
+
+				if (BASES[b] != 0)
+				{
+					base = sent.find(server.seq - BASES[b]);
+					if (base == NULL)
+						continue;
+				}
+
+				char data[SNAPSHOT_MAX_SIZE];
+				int size = server.writeSnapshot(base, seat, data);
+
+				// nothing new for this player: what it holds still stands
+				if (size == 0)
+				{
+					MatchState held = *decoded[who].find(base->seq);
+					held.seq = server.seq;
+
+					tried[b]++;
+					if (!same(held, server, seat))
+						bad[b]++;
+
+					if (BASES[b] == 1)
+						players[who] = held;
+					continue;
+				}
+
+				MatchState far = players[who];
+				int farSeat = -2;
+
+				tried[b]++;
+				if (size < 0 || !far.readSnapshot(data, size, decoded[who], farSeat) || !same(far, server, seat))
+					bad[b]++;
+				else if (farSeat != seat)
+					wrongSeat++;
+
+				if (size > largest)
+					largest = size;
+
+				// carry on from the delta against the one before
+				if (BASES[b] == 1 || (BASES[b] == 0 && step == 1))
+					players[who] = far;
+			}
+
+			decoded[who].store(players[who]);
+		}
+	}
+
+	printf("%d states, largest snapshot %d bytes\n", STEPS, largest);
+
+	for (int b = 0; b < BASE_COUNT; b++)
+	{
+		char what[96];
+		if (BASES[b] == 0)
+			snprintf(what, sizeof(what), "%d full snapshots decode to the state", tried[b]);
+		else
+			snprintf(what, sizeof(what), "%d snapshots %d back decode to the state", tried[b], BASES[b]);
+		check(tried[b] > 0 && bad[b] == 0, what);
+	}
+
+	check(wrongSeat == 0, "snapshots say who they are for");
+
+	// a base the far side no longer holds
+	char data[SNAPSHOT_MAX_SIZE];
+	int size = server.writeSnapshot(sent.find(server.seq - (SNAPSHOT_HISTORY - 1)), SPECTATOR_SEAT, data);
+	SnapshotHistory empty;
+	MatchState far;
+	int seat;
+
+	check(size > 0 && !far.readSnapshot(data, size, empty, seat), "a delta against a lost base is refused");
+
+	// and one cut short
+	int refused = 0;
+	for (int cut = 0; cut < size; cut++)
+		if (!far.readSnapshot(data, cut, sent, seat))
+			refused++;
+
+	check(refused == size, "every truncated snapshot is refused");
+
+	// a head gone to NaN or off into the distance still encodes, as 0
+	// or as far as can be sent, full or as a delta
+	MatchState wild = server;
+	wild.seq++;
+	wild.position[0] = glm::vec3(NAN, 1e30f, -INFINITY);
+	wild.position[1] = glm::vec3(-1e30f, INFINITY, NAN);
+
+	SnapshotHistory wilder;
+	wilder.store(server);
+
+	int full = wild.writeSnapshot(NULL, SPECTATOR_SEAT, data);
+	bool fullOk = full > 0 && far.readSnapshot(data, full, empty, seat);
+	glm::vec3 fullPosition = far.position[0];
+
+	int delta = wild.writeSnapshot(&server, SPECTATOR_SEAT, data);
+	bool deltaOk = delta > 0 && far.readSnapshot(data, delta, wilder, seat);
+
+	float furthest = far.position[0].y;
+
+	check(fullOk && deltaOk && fullPosition.x == 0.0f && far.position[0].x == 0.0f && far.position[1].z == 0.0f &&
+		furthest > 1e6f && furthest < 2e6f && far.position[0].z == -furthest && far.position[1].x == -furthest &&
+		far.position[1].y == furthest, "NaN and huge positions are sent as 0 and the furthest there is");
+}
+
+static void checkResyncs()
+{
+	MatchState server;
+	for (int step = 1; step <= STEPS; step++)
+		play(server, step);
+	server.seq = STEPS;
+
+	int bad = 0;
+	int size = 0;
+	char data[RESYNC_MAX_SIZE];
+
+	for (int who = 0; who <= MATCH_SEATS; who++)
+	{
+		int seat = who < MATCH_SEATS ? who : SPECTATOR_SEAT;
+		size = server.writeResync(seat, data);
+
+		MatchState far;
+		int farSeat = -2;
+
+		// a resync carries both poses, the player's own included
+		if (size < 0 || !far.readResync(data, size, farSeat) || farSeat != seat || !same(far, server, SPECTATOR_SEAT))
+			bad++;
+	}
+
+	printf("resync %d bytes, %d flat\n", size, RESYNC_IMAGE_SIZE);
+	check(bad == 0, "resyncs decode to the state, for each seat and spectators");
+
+	int refused = 0;
+	for (int cut = 0; cut < size; cut++)
+	{
+		MatchState far;
+		int seat;
+		if (!far.readResync(data, cut, seat))
+			refused++;
+	}
+
+	check(refused == size, "every truncated resync is refused");
+}
+
+static void checkCompression()
+{
+	static char source[4096];
+
+	check(roundTrip(source, 0) >= 0, "empty input round trips");
+
+	for (int i = 0; i < (int)sizeof(source); i++)
+		source[i] = (char)rand();
+
+	int noise = roundTrip(source, sizeof(source));
+	printf("4096 random bytes compress to %d, bound %d\n", noise, LZ_BOUND(4096));
+	check(noise >= 0 && noise <= LZ_BOUND(4096), "incompressible input round trips within the bound");
+
+	memset(source, 'x', sizeof(source));
+	int run = roundTrip(source, sizeof(source));
+
+	for (int i = 0; i < (int)sizeof(source); i++)
+		source[i] = "abcdefg"[i % 7];
+	int pattern = roundTrip(source, sizeof(source));
+
+	printf("4096 bytes of one byte compress to %d, of a 7 byte pattern to %d\n", run, pattern);
+	check(run >= 0 && run < 64 && pattern >= 0 && pattern < 64, "repetitive input round trips, and shrinks");
+
+	// some of each, for the damage below
+	for (int i = 0; i < 1024; i++)
+		source[i] = i % 3 == 0 ? (char)rand() : "board"[i % 5];
+
+	char compressed[LZ_BOUND(1024)];
+	int size = lzCompress(source, 1024, compressed, sizeof(compressed));
+	char restored[1024 + GUARD];
+
+	int claimed = 0;
+	int overran = 0;
+
+	for (int cut = 0; cut < size; cut++)
+	{
+		memset(restored, GUARD_BYTE, sizeof(restored));
+		if (lzDecompress(compressed, cut, restored, 1024))
+			claimed++;
+		if (!guardIntact(restored, 1024))
+			overran++;
+	}
+
+	check(claimed == 0 && overran == 0, "truncated input is refused, and never overruns");
+
+	// random damage may happen to still decode, but never past the
+	// buffer, a short one too
+	int failed = 0;
+	overran = 0;
+
+	for (int trial = 0; trial < 2000; trial++)
+	{
+		char damaged[LZ_BOUND(1024)];
+		memcpy(damaged, compressed, size);
+
+		for (int hits = 1 + rand() % 4; hits > 0; hits--)
+			damaged[rand() % size] = (char)rand();
+
+		int capacity = trial % 2 == 0 ? 1024 : 1 + rand() % 1024;
+
+		memset(restored, GUARD_BYTE, sizeof(restored));
+
+		if (!lzDecompress(damaged, size, restored, capacity))
+			failed++;
+		if (!guardIntact(restored, capacity))
+			overran++;
+	}
+
+	printf("2000 damaged inputs, %d refused\n", failed);
+	check(overran == 0, "damaged input never overruns");
+
+	// the ways a sequence can point outside what it has
+	const char offsetZero[] = { 0x10, 'a', 0x00, 0x00, 0x00 };
+	const char offsetBack[] = { 0x10, 'a', 0x02, 0x00, 0x00 };
+	const char literalsPast[] = { (char)0x40, 'a', 'b' };
+	const char longPast[] = { (char)0xF0, (char)0xFF, (char)0xFF, 'a' };
+	const char matchClosing[] = { 0x11, 'a' };
+
+	check(!lzDecompress(offsetZero, sizeof(offsetZero), restored, 1024) &&
+		!lzDecompress(offsetBack, sizeof(offsetBack), restored, 1024) &&
+		!lzDecompress(literalsPast, sizeof(literalsPast), restored, 1024) &&
+		!lzDecompress(longPast, sizeof(longPast), restored, 1024) &&
+		!lzDecompress(matchClosing, sizeof(matchClosing), restored, 1024) &&
+		!lzDecompress(compressed, 0, restored, 0), "malformed sequences are refused");
+
+	memset(restored, GUARD_BYTE, sizeof(restored));
+	check(!lzDecompress(compressed, size, restored, 1000) && guardIntact(restored, 1000) &&
+		!lzDecompress(compressed, size, restored, 1023), "output longer than expected is refused, not cut");
+
+	char spare[1100];
+	check(!lzDecompress(compressed, size, spare, 1100), "output shorter than expected is refused");
+}
+
+int main()
+{
+	srand(1);
+
+	checkSnapshots();
+	checkResyncs();
+	checkCompression();
+
+	return checked();
+}
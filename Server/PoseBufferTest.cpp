@@ -0,0 +1,192 @@
+// Checks the remote head's jitter buffer offline, on a made up clock.
+//
+// A head turning and swaying at a known rate sends its pose at 30 Hz,
+// one in seven lost and each arriving 10 to 30 ms late. The far side
+// draws it at 90 Hz through a PoseBuffer and, for comparison, the way
+// it used to: snapped to the newest pose. The buffered head must stay
+// close to the real one as it was a playout delay ago, and move by
+// about as much each frame as the real one does; the snapped one
+// stands still and then jumps. When poses stop coming the head must
+// run on for a bounded time and then hold still.
+//
+// usage: PoseBufferTest
+#include <stdio.h>
+#include <math.h>
+#include <deque>
+#include "PoseBuffer.h"
+#include "WireFormat.h"
+#include "Check.h"
+
+#define PI 3.14159265f
+
+// the sender's rate, the drawing rate and the one in how many lost
+#define SEND_HZ 30
+#define DRAW_HZ 90
+#define LOSE_EVERY 7
+
+// when the run starts, well clear of a zero clock
+#define START_US 1000000000ull
+
+// the real head at time, in microseconds: looking left and right once
+// every two seconds, nodding a little, swaying side to side
+static glm::mat4 trueHead(uint64_t time)
+{
+	float t = (time - START_US) / 1e6f;
+
+	float yaw = 0.8f * sinf(2 * PI * 0.5f * t);
+	float pitch = 0.2f * sinf(2 * PI * 0.7f * t);
+	glm::vec3 position(0.1f * sinf(2 * PI * 0.3f * t), 1.6f + 0.02f * sinf(2 * PI * 0.9f * t), 0.0f);
+
+	glm::quat orientation = glm::angleAxis(yaw, glm::vec3(0, 1, 0)) * glm::angleAxis(pitch, glm::vec3(1, 0, 0));
+
+	return makePose(position, orientation);
+}
+
+static float degreesBetween(const glm::mat4 & a, const glm::mat4 & b)
+{
+	float cosine = fabsf(glm::dot(poseOrientation(a), poseOrientation(b)));
+	return 2.0f * acosf(cosine > 1.0f ? 1.0f : cosine) * 180.0f / PI;
+}
+
+static float mmBetween(const glm::mat4 & a, const glm::mat4 & b)
+{
+	return glm::distance(posePosition(a), posePosition(b)) * 1000.0f;
+}
+
+struct InFlight
+{
+	glm::mat4 pose;
+	uint64_t sent;
+	uint64_t arrives;
+};
+
+int main()
+{
+	PoseBuffer buffer;
+	std::deque<InFlight> network;
+
+	glm::mat4 snapped;
+	bool anyArrived = false;
+
+	uint64_t nextSend = START_US;
+	int sends = 0;
+
+	float worstDegrees = 0.0f;
+	float worstMm = 0.0f;
+
+	// largest change from one drawn frame to the next
+	float trueStep = 0.0f;
+	float bufferedStep = 0.0f;
+	float snappedStep = 0.0f;
+
+	glm::mat4 lastTrue, lastBuffered, lastSnapped;
+	uint64_t frameUs = 1000000 / DRAW_HZ;
+	uint64_t end = START_US + 10000000;
+	int frames = 0;
+
+	for (uint64_t now = START_US; now < end; now += frameUs)
+	{
+		// the sender, on its own schedule
+		while (nextSend <= now)
+		{
+			if (++sends % LOSE_EVERY != 0)
+			{
+				InFlight packet;
+				packet.pose = trueHead(nextSend);
+				packet.sent = nextSend;
+				packet.arrives = nextSend + 10000 + (sends * 7919) % 20000;
+				network.push_back(packet);
+			}
+
+			nextSend += 1000000 / SEND_HZ;
+		}
+
+		// what has arrived by now, in the order it arrived
+		for (std::deque<InFlight>::iterator iter = network.begin(); iter != network.end(); )
+		{
+			if (iter->arrives > now)
+			{
+				++iter;
+				continue;
+			}
+
+			buffer.push(iter->pose, iter->sent);
+			snapped = iter->pose;
+			anyArrived = true;
+			iter = network.erase(iter);
+		}
+
+		glm::mat4 drawn;
+		if (!buffer.sample(now, drawn) || !anyArrived)
+			continue;
+
+		glm::mat4 truth = trueHead(now - buffer.delay);
+
+		// once the buffer has filled past its delay
+		if (now >= START_US + 2 * buffer.delay)
+		{
+			float degrees = degreesBetween(drawn, truth);
+			float mm = mmBetween(drawn, truth);
+
+			if (degrees > worstDegrees)
+				worstDegrees = degrees;
+			if (mm > worstMm)
+				worstMm = mm;
+
+			if (frames > 0)
+			{
+				float step = degreesBetween(truth, lastTrue);
+				if (step > trueStep)
+					trueStep = step;
+
+				step = degreesBetween(drawn, lastBuffered);
+				if (step > bufferedStep)
+					bufferedStep = step;
+
+				step = degreesBetween(snapped, lastSnapped);
+				if (step > snappedStep)
+					snappedStep = step;
+			}
+
+			frames++;
+		}
+
+		lastTrue = truth;
+		lastBuffered = drawn;
+		lastSnapped = snapped;
+	}
+
+	printf("%d frames at %d Hz from poses at %d Hz, one in %d lost\n", frames, DRAW_HZ, SEND_HZ, LOSE_EVERY);
+	printf("buffered head off by at most %.3f degrees and %.2f mm\n", worstDegrees, worstMm);
+	printf("largest step per frame: real %.2f, buffered %.2f, snapped %.2f degrees\n",
+		trueStep, bufferedStep, snappedStep);
+
+	check(worstDegrees < 1.0f, "buffered head within a degree of the real one");
+	check(worstMm < 2.0f, "buffered head within 2 mm of the real one");
+	check(bufferedStep < 1.25f * trueStep, "buffered head moves as smoothly as the real one");
+	check(snappedStep > 2.0f * trueStep, "snapped head jumps, for comparison");
+
+	// the sender goes quiet: the head runs on, then holds still
+	uint64_t lastPose = end;
+	PoseBuffer quiet;
+	for (uint64_t time = START_US; time <= lastPose; time += 1000000 / SEND_HZ)
+		quiet.push(trueHead(time), time);
+
+	glm::mat4 early, stopped, later;
+	quiet.sample(lastPose + quiet.delay + quiet.maxExtrapolation / 2, early);
+	quiet.sample(lastPose + quiet.delay + quiet.maxExtrapolation, stopped);
+	quiet.sample(lastPose + quiet.delay + 10 * quiet.maxExtrapolation, later);
+
+	glm::mat4 newest;
+	quiet.sample(lastPose + quiet.delay, newest);
+
+	check(degreesBetween(newest, early) > 0.0f || mmBetween(newest, early) > 0.0f, "late poses are extrapolated");
+	check(degreesBetween(stopped, later) == 0.0f && mmBetween(stopped, later) == 0.0f, "extrapolation stops at its limit");
+
+	// a pose older than the newest is dropped
+	uint64_t droppedBefore = quiet.dropped;
+	quiet.push(trueHead(lastPose - 1000), lastPose - 1000);
+	check(quiet.dropped == droppedBefore + 1, "an out of order pose is dropped");
+
+	return checked();
+}
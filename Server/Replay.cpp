@@ -0,0 +1,156 @@
+// Replays a traffic log recorded with VR_REPLAY_LOG through
+// ServerGame, without sockets or a headset.
+//
+// Every inbound message is handed to the game at its recorded time and
+// the render side is updated after it, the way the headset loop would
+// see it. What the game ends up showing (the other player's attacks,
+// damage, done flag and head pose) is folded into a digest after each
+// message, so two runs over the same log must print the same digest:
+// a change in it means the game logic changed what players see.
+//
+// By default the log is read as fast as the game takes it, which makes
+// it a benchmark built from a real match; -t paces it at the recorded
+// rate (or a multiple of it).
+//
+// usage: Replay [-t speed] [-l loops] log
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "ServerGame.h"
+#include "ReplayLog.h"
+
+// FNV-1a, 64 bit
+#define DIGEST_OFFSET 0xcbf29ce484222325ull
+#define DIGEST_PRIME 0x100000001b3ull
+
+static uint64_t fold(uint64_t digest, const void * data, size_t length)
+{
+	const uint8_t * bytes = (const uint8_t *)data;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		digest ^= bytes[i];
+		digest *= DIGEST_PRIME;
+	}
+
+	return digest;
+}
+
+// what the render loop would act on after this message. attacks and
+// damage are consumed, like the headset does
+static uint64_t observe(ServerGame & game, uint64_t digest)
+{
+	int cells[4] = { game.other_attack.first, game.other_attack.second,
+		game.other_damage.first, game.other_damage.second };
+	digest = fold(digest, cells, sizeof(cells));
+
+	uint8_t done = game.other_done ? 1 : 0;
+	digest = fold(digest, &done, 1);
+
+	digest = fold(digest, &game.other_headPose, sizeof(game.other_headPose));
+	digest = fold(digest, &game.other_headPoseTime, sizeof(game.other_headPoseTime));
+
+	game.other_attack = std::make_pair(-1, -1);
+	game.other_damage = std::make_pair(-1, -1);
+
+	return digest;
+}
+
+static void usage()
+{
+	printf("usage: Replay [-t speed] [-l loops] log\n");
+	printf("  -t  pace at the recorded rate times speed (default: as fast as possible)\n");
+	printf("  -l  times to play the log (default 1)\n");
+}
+
+int main(int argc, char ** argv)
+{
+	double speed = 0.0;
+	int loops = 1;
+	const char * path = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+			speed = atof(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-l") == 0)
+			loops = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && path == NULL)
+			path = argv[i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (path == NULL || loops < 1 || speed < 0.0) {
+		usage();
+		return 1;
+	}
+
+	ReplayReader log;
+
+	if (!log.open(path))
+		return 1;
+
+	// no sockets: the log is the only traffic
+	ServerGame game(NULL);
+
+	uint64_t digest = DIGEST_OFFSET;
+	uint64_t inbound = 0;
+	uint64_t outbound = 0;
+	uint64_t bytes = 0;
+	uint64_t recorded = 0;
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	for (int loop = 0; loop < loops; loop++)
+	{
+		log.rewind();
+
+		ReplayRecord record;
+		uint64_t first = 0;
+		std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+
+		while (log.next(record))
+		{
+			if (first == 0)
+				first = record.time;
+
+			recorded = record.time - first;
+
+			// what the game sent is in the log for reading, not replaying
+			if (record.direction != REPLAY_INBOUND) {
+				outbound++;
+				continue;
+			}
+
+			if (speed > 0.0)
+				std::this_thread::sleep_until(loopStart +
+					std::chrono::microseconds((uint64_t)(recorded / speed)));
+
+			game.replay(record.time, record.session, record.payload, record.length);
+			game.update();
+
+			digest = observe(game, digest);
+
+			inbound++;
+			bytes += record.length;
+		}
+	}
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (log.truncated)
+		printf("log ends in a partial record, replayed up to it\n");
+
+	printf("%s: %.1f s recorded, %llu messages in, %llu out\n", path, recorded / 1e6,
+		(unsigned long long)inbound / loops, (unsigned long long)outbound / loops);
+	printf("replayed %d time(s) in %.3f s: %.0f messages/s, %.2f MB/s\n", loops, elapsed,
+		inbound / elapsed, bytes / elapsed / 1e6);
+	printf("digest %016llx\n", (unsigned long long)digest);
+
+	return 0;
+}
@@ -0,0 +1,112 @@
+// Checks FixedStep, which paces the headset's game logic and sends.
+//
+// Frames are handed to advance() on a made up clock. Over a run the
+// ticks it returns must add up to the tick rate, whatever the frame
+// rate and however uneven the frames; a stall must cost at most
+// MAX_TICKS_PER_FRAME ticks and its backlog be forgotten; and a rate
+// change must take effect from the next frame on.
+//
+// usage: TickRateTest
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "FixedStep.h"
+#include "Check.h"
+
+// when runs start, well clear of the zero the clock starts from
+#define START 100.0
+
+// what advancing through a run of frames gave
+struct Run
+{
+	int ticks = 0;
+	int most = 0;
+	double end = START;
+};
+
+// seconds of frames at frameHz from start, each up to jitter of a
+// frame early or late
+static Run play(FixedStep & step, double frameHz, double seconds, double start = START, double jitter = 0.0)
+{
+	Run run;
+	int frames = (int)(frameHz * seconds);
+
+	for (int i = 0; i <= frames; i++)
+	{
+		double offset = i > 0 && i < frames ? jitter * (rand() / (double)RAND_MAX * 2.0 - 1.0) : 0.0;
+		run.end = start + (i + offset) / frameHz;
+
+		int ticks = step.advance(run.end);
+		run.ticks += ticks;
+		if (ticks > run.most)
+			run.most = ticks;
+	}
+
+	return run;
+}
+
+static bool near(int ticks, double expected)
+{
+	return fabs(ticks - expected) <= 1.0;
+}
+
+int main()
+{
+	const double seconds = 10.0;
+
+	FixedStep first;
+	check(first.getRate() == SIM_TICK_HZ && first.advance(START) == 0, "the first frame only starts the clock");
+
+	double frameRates[] = { 45.0, 72.0, 90.0, 120.0, 144.0 };
+
+	for (size_t i = 0; i < sizeof(frameRates) / sizeof(frameRates[0]); i++)
+	{
+		FixedStep step;
+		Run run = play(step, frameRates[i], seconds);
+
+		FixedStep uneven;
+		Run jittered = play(uneven, frameRates[i], seconds, START, 0.4);
+
+		printf("%.0f Hz frames: %d ticks, at most %d a frame; uneven %d, at most %d\n", frameRates[i], run.ticks,
+			run.most, jittered.ticks, jittered.most);
+
+		char what[96];
+		snprintf(what, sizeof(what), "ticks at the tick rate from %.0f Hz frames", frameRates[i]);
+		check(near(run.ticks, SIM_TICK_HZ * seconds) && near(jittered.ticks, SIM_TICK_HZ * seconds), what);
+
+		// a tick landing exactly on a frame may round to the next one
+		int most = (int)ceil(SIM_TICK_HZ / frameRates[i]) + 1;
+		check(run.most <= most && jittered.most <= most + 1, "no bursts of ticks");
+	}
+
+	// a one second hitch is not caught up on tick by tick
+	FixedStep stalled;
+	stalled.advance(START);
+	int during = stalled.advance(START + 1.0);
+	int after = stalled.advance(START + 1.0 + 1.0 / SIM_TICK_HZ);
+
+	printf("one second stall: %d ticks, then %d\n", during, after);
+	check(during == MAX_TICKS_PER_FRAME, "a stall runs at most MAX_TICKS_PER_FRAME ticks");
+	check(after <= 1, "and its backlog is forgotten");
+
+	// just under the cap is all run, with nothing left over
+	FixedStep behind;
+	behind.advance(START);
+	check(behind.advance(START + (MAX_TICKS_PER_FRAME - 0.5) / SIM_TICK_HZ) == MAX_TICKS_PER_FRAME - 1,
+		"a backlog under the cap is caught up in one frame");
+
+	// half a run at one rate, half at another
+	FixedStep changing;
+	Run fast = play(changing, 90.0, seconds / 2);
+	changing.setRate(30.0);
+	Run slow = play(changing, 90.0, seconds / 2, fast.end);
+
+	printf("rate change: %d ticks at %.0f Hz, then %d at %.0f Hz\n", fast.ticks, SIM_TICK_HZ, slow.ticks,
+		changing.getRate());
+	check(changing.getRate() == 30.0, "the new rate is kept");
+	check(near(fast.ticks, SIM_TICK_HZ * seconds / 2) && near(slow.ticks, 30.0 * seconds / 2),
+		"ticks follow the rate from the change on");
+	check(slow.most == 1, "a slower rate than the frames ticks at most once a frame");
+
+	return checked();
+}
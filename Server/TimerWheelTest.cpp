@@ -0,0 +1,229 @@
+// Checks TimerWheel against a plain list of timers.
+//
+// Random schedules, cancels and turns of the wheel, with delays from
+// none to days and time moving in steps from a microsecond to hours,
+// are applied to both. After every turn the wheel must have fired
+// exactly the timers the list says are due, none early, and a wait
+// it asks for must never run past the next one due, also when the
+// wheel is behind the clock the wait starts at.
+//
+// usage: TimerWheelTest [-s seed] [-n operations]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include "TimerWheel.h"
+#include "Check.h"
+
+// the model: every live timer by key, and the tick it is due in
+struct ModelTimer
+{
+	uint64_t handle;
+	uint64_t tick;
+	int kind;
+};
+
+static uint64_t random64()
+{
+	return ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ (uint64_t)rand();
+}
+
+// microseconds, mostly short, sometimes past every level's first turn
+static uint64_t randomDelay()
+{
+	int pick = rand() % 100;
+
+	if (pick < 60)
+		return random64() % 300000;
+	if (pick < 85)
+		return random64() % 70000000;
+	if (pick < 95)
+		return random64() % (3 * 86400000000ull);
+
+	// further than the wheel reaches in one turn
+	return random64() % (100 * 86400000000ull);
+}
+
+// how far the clock moves in one turn
+static uint64_t randomStep()
+{
+	int pick = rand() % 100;
+
+	if (pick < 70)
+		return random64() % 5000;
+	if (pick < 95)
+		return random64() % 2000000;
+	if (pick < 99)
+		return random64() % 600000000;
+
+	return random64() % (2 * 86400000000ull);
+}
+
+static void usage()
+{
+	printf("usage: TimerWheelTest [-s seed] [-n operations]\n");
+}
+
+int main(int argc, char ** argv)
+{
+	unsigned int seed = 1;
+	int operations = 200000;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+			seed = (unsigned int)atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+			operations = atoi(argv[++i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	srand(seed);
+
+	// not on a tick boundary, and far from zero
+	uint64_t now = 5000000000000ull + 123;
+	TimerWheel wheel(now);
+
+	std::map<uint64_t, ModelTimer> model;
+	std::vector<uint64_t> gone;
+	uint64_t nextKey = 1;
+
+	uint64_t fired = 0;
+	uint64_t cancelled = 0;
+	uint64_t waits = 0;
+
+	int unknownFired = 0;
+	int firedEarly = 0;
+	int notFired = 0;
+	int waitTooLong = 0;
+	int waitCapIgnored = 0;
+	int sizeWrong = 0;
+	int nowWrong = 0;
+
+	for (int op = 0; op < operations; op++)
+	{
+		int pick = rand() % 100;
+
+		if (pick < 40)
+		{
+			// now and then one already due
+			uint64_t at = rand() % 20 == 0 ? now - random64() % 10000 : now + randomDelay();
+			int kind = rand() % 4;
+			uint64_t key = nextKey++;
+
+			ModelTimer timer;
+			timer.handle = wheel.schedule(at, kind, key);
+			timer.tick = (at + TIMER_TICK_US - 1) / TIMER_TICK_US;
+			timer.kind = kind;
+			model[key] = timer;
+		}
+		else if (pick < 55)
+		{
+			// a live timer, or one that fired or was cancelled already,
+			// which must be ignored
+			if (!model.empty() && (gone.empty() || rand() % 4 != 0))
+			{
+				std::map<uint64_t, ModelTimer>::iterator iter = model.lower_bound(1 + random64() % nextKey);
+				if (iter == model.end())
+					iter = model.begin();
+
+				wheel.cancel(iter->second.handle);
+				gone.push_back(iter->second.handle);
+				model.erase(iter);
+				cancelled++;
+			}
+			else if (!gone.empty())
+				wheel.cancel(gone[rand() % gone.size()]);
+		}
+		else
+		{
+			// the wait asked for once some time passed since the last
+			// turn, against the earliest timer due
+			uint64_t waitStart = now + random64() % 3000;
+			int cap = rand() % 2 == 0 ? -1 : rand() % 50;
+			int wait = wheel.timeout(waitStart, cap);
+			waits++;
+
+			if (model.empty())
+			{
+				if (wait != cap)
+					waitCapIgnored++;
+			}
+			else
+			{
+				uint64_t earliest = UINT64_MAX;
+				for (std::map<uint64_t, ModelTimer>::iterator iter = model.begin(); iter != model.end(); ++iter)
+				{
+					if (iter->second.tick < earliest)
+						earliest = iter->second.tick;
+				}
+
+				uint64_t due = earliest * TIMER_TICK_US;
+				uint64_t longest = due <= waitStart ? 0 : (due - waitStart + 999) / 1000;
+
+				if (wait < 0 || (uint64_t)wait > longest)
+					waitTooLong++;
+				if (cap >= 0 && wait > cap)
+					waitCapIgnored++;
+			}
+
+			now += randomStep();
+			wheel.advance(now);
+
+			if (wheel.now() != now / TIMER_TICK_US * TIMER_TICK_US)
+				nowWrong++;
+
+			uint64_t tick = now / TIMER_TICK_US;
+			TimerEvent event;
+
+			while (wheel.expired(event))
+			{
+				std::map<uint64_t, ModelTimer>::iterator iter = model.find(event.key);
+
+				if (iter == model.end() || iter->second.kind != event.kind)
+				{
+					unknownFired++;
+					continue;
+				}
+
+				if (iter->second.tick > tick)
+					firedEarly++;
+
+				gone.push_back(iter->second.handle);
+				model.erase(iter);
+				fired++;
+			}
+
+			for (std::map<uint64_t, ModelTimer>::iterator iter = model.begin(); iter != model.end(); ++iter)
+			{
+				if (iter->second.tick <= tick)
+					notFired++;
+			}
+		}
+
+		if (wheel.size() != model.size())
+			sizeWrong++;
+
+		// old handles only matter for a while
+		if (gone.size() > 4096)
+			gone.erase(gone.begin(), gone.begin() + 2048);
+	}
+
+	printf("seed %u: %d operations, %llu fired, %llu cancelled, %llu waits, %zu left\n", seed, operations,
+		(unsigned long long)fired, (unsigned long long)cancelled, (unsigned long long)waits, model.size());
+
+	check(unknownFired == 0, "only live timers fire, each once");
+	check(firedEarly == 0, "no timer fires before its tick");
+	check(notFired == 0, "every timer due fires on the turn that reaches it");
+	check(waitTooLong == 0, "a wait never runs past the next timer due");
+	check(waitCapIgnored == 0, "a wait is cut short, never made longer");
+	check(sizeWrong == 0, "size counts the live timers");
+	check(nowWrong == 0, "now is the last turn, to the tick");
+	check(fired > 0 && cancelled > 0, "timers fired and were cancelled");
+
+	return checked();
+}
@@ -0,0 +1,227 @@
+// Checks the UDP transport over a bad link on loopback.
+//
+// Two transports talk through their LinkConditioners, each direction
+// losing a fifth of its datagrams and delaying the rest by 20 to 50 ms
+// so they reorder. One side sends numbered game events on the reliable
+// channel and numbered head poses on the unreliable one at a headset's
+// rates. Every event must arrive once and in order, in spite of the
+// loss; a pose must never arrive after a newer one, and most of them
+// must arrive at all. Then a stray pose from a third address must not
+// become a peer, and the sender, gone quiet, must be forgotten.
+//
+// usage: UdpLossTest [-l loss] [-j jitter_ms]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "UdpTransport.h"
+#include "Check.h"
+
+// what is sent, and how long the senders get before giving up
+#define EVENTS 150
+#define POSES 450
+#define POSE_INTERVAL_MS 11
+#define EVENT_INTERVAL_MS 30
+#define DEADLINE_MS 30000
+
+// the receiver's numbering of the sender, and where it starts counting
+#define SENDER_ID 1
+#define RECEIVER_BASE_ID 100
+
+static uint64_t nowMs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// first byte the channel, then the number
+static void encode(char * data, char channel, int number)
+{
+	data[0] = channel;
+	memcpy(data + 1, &number, sizeof(number));
+}
+
+static int decode(const char * data)
+{
+	int number;
+	memcpy(&number, data + 1, sizeof(number));
+	return number;
+}
+
+static void usage()
+{
+	printf("usage: UdpLossTest [-l loss] [-j jitter_ms]\n");
+	printf("  -l  fraction of datagrams lost each way (default 0.2)\n");
+	printf("  -j  delay on top of 20 ms, up to (default 30)\n");
+}
+
+int main(int argc, char ** argv)
+{
+	float loss = 0.2f;
+	int jitter = 30;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-l") == 0)
+			loss = (float)atof(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-j") == 0)
+			jitter = atoi(argv[++i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+#ifdef _WIN32
+	WSADATA wsaData;
+	WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+
+	srand(1);
+
+	UdpTransport receiver("0");
+	UdpTransport sender("0");
+
+	char port[16];
+	snprintf(port, sizeof(port), "%u", receiver.localPort());
+
+	if (!sender.addPeer(SENDER_ID, "127.0.0.1", port))
+	{
+		printf("could not reach the receiver on port %s\n", port);
+		return 1;
+	}
+
+	// both ways: acks come back over the same bad link
+	LinkConditioner link;
+	link.loss = loss;
+	link.latency_ms = 20;
+	link.jitter_ms = jitter;
+	sender.conditioner = link;
+	receiver.conditioner = link;
+
+	int eventsSent = 0;
+	int posesSent = 0;
+	int nextEvent = 0;
+	int eventsOutOfOrder = 0;
+	int fromElsewhere = 0;
+	int posesReceived = 0;
+	int lastPose = -1;
+	int posesStale = 0;
+
+	unsigned int nextId = RECEIVER_BASE_ID;
+	unsigned int senderId = 0;
+
+	UdpTransport::Handler onReceive = [&](unsigned int peer, const char * payload, int length)
+	{
+		if (length != 1 + (int)sizeof(int))
+			return;
+
+		if (senderId == 0)
+			senderId = peer;
+		else if (peer != senderId)
+			fromElsewhere++;
+
+		int number = decode(payload);
+
+		if (payload[0] == 'e')
+		{
+			if (number != nextEvent)
+				eventsOutOfOrder++;
+			nextEvent = number + 1;
+		}
+		else
+		{
+			if (number <= lastPose)
+				posesStale++;
+			lastPose = number;
+			posesReceived++;
+		}
+	};
+
+	// the sender only hears acks, from the receiver it already knows
+	UdpTransport::Handler ignore = [](unsigned int, const char *, int) {};
+	unsigned int senderNextId = RECEIVER_BASE_ID;
+
+	uint64_t start = nowMs();
+	uint64_t nextPoseAt = start;
+	uint64_t nextEventAt = start;
+
+	char message[1 + sizeof(int)];
+
+	while (nextEvent < EVENTS && nowMs() - start < DEADLINE_MS)
+	{
+		uint64_t now = nowMs();
+
+		if (posesSent < POSES && now >= nextPoseAt)
+		{
+			encode(message, 'p', posesSent++);
+			sender.send(SENDER_ID, message, sizeof(message), false);
+			nextPoseAt += POSE_INTERVAL_MS;
+		}
+
+		// a full window holds the next event back until acks free it
+		if (eventsSent < EVENTS && now >= nextEventAt)
+		{
+			encode(message, 'e', eventsSent);
+			if (sender.send(SENDER_ID, message, sizeof(message), true))
+			{
+				eventsSent++;
+				nextEventAt += EVENT_INTERVAL_MS;
+			}
+		}
+
+		sender.update();
+		receiver.update();
+		sender.receive(senderNextId, ignore);
+		receiver.receive(nextId, onReceive);
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	printf("%.1f%% loss, 20 to %d ms delay: %d of %d events in %.1f s, %llu resends\n", loss * 100.0f,
+		20 + jitter, nextEvent, EVENTS, (nowMs() - start) / 1000.0, (unsigned long long)sender.resends);
+	printf("poses: %d of %d arrived, %llu dropped as stale\n", posesReceived, posesSent,
+		(unsigned long long)receiver.stalePosesDropped);
+
+	check(nextEvent == EVENTS, "every event arrived");
+	check(eventsOutOfOrder == 0, "events arrived once each, in order");
+	check(fromElsewhere == 0, "everything came from the one sender");
+	check(loss == 0.0f || sender.resends > 0, "lost events were resent");
+	check(posesStale == 0, "no pose arrived after a newer one");
+	check(posesReceived > (int)(posesSent * (1.0f - loss) / 2), "most poses arrived");
+
+	// a pose from an address that never started a reliable stream is a
+	// stray, and doesn't become a peer
+	UdpTransport stranger("0");
+	stranger.addPeer(SENDER_ID, "127.0.0.1", port);
+	encode(message, 'p', 0);
+	stranger.send(SENDER_ID, message, sizeof(message), false);
+
+	receiver.conditioner = LinkConditioner();
+	uint64_t strangerSent = nowMs();
+
+	while (receiver.strangersIgnored == 0 && nowMs() - strangerSent < 1000)
+	{
+		receiver.receive(nextId, onReceive);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	check(receiver.strangersIgnored > 0 && receiver.peerIds().size() == 1, "a stray pose made no peer");
+
+	// the sender goes quiet, and the receiver forgets it
+	receiver.peerTimeout_ms = 200;
+	uint64_t quietFrom = nowMs();
+
+	while (receiver.hasPeers() && nowMs() - quietFrom < 2000)
+	{
+		receiver.update();
+		receiver.receive(nextId, onReceive);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	check(!receiver.hasPeers(), "a silent peer was removed");
+	check(receiver.removedPeers.size() == 1 && receiver.removedPeers[0] == senderId, "and reported to the owner");
+
+	return checked();
+}
@@ -0,0 +1,145 @@
+// Checks that one io_uring session can't take every provided buffer.
+//
+// A peer floods a session whose owner never reads. The session must
+// never hold more than URING_SESSION_BUFFERS, which leaves the rest of
+// the buffers to another session and the flood to fill the socket, and
+// its receive must start again once the owner reads it down.
+//
+// Skipped where the kernel has no io_uring to give.
+//
+// usage: UringTest
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "ServerNetwork.h"
+#include "Check.h"
+
+// the peer: writes until the socket stays full, from a thread of its
+// own as another process would. a send from the thread that armed the
+// receive would run it on the spot, before the network could reap
+static void flood(SOCKET socket, std::atomic<size_t> * total)
+{
+	char chunk[URING_BUFFER_SIZE];
+	memset(chunk, 'x', sizeof(chunk));
+
+	// full for long enough means the server stopped taking
+	for (int full = 0; full < 100; )
+	{
+		int sent = (int)send(socket, chunk, sizeof(chunk), MSG_DONTWAIT | MSG_NOSIGNAL);
+
+		if (sent > 0)
+		{
+			*total += sent;
+			full = 0;
+		}
+		else
+		{
+			full++;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+// read what the session holds, returning the bytes
+static size_t drain(ServerNetwork & network, unsigned int id)
+{
+	std::vector<char> buffer(64 * 1024);
+	size_t total = 0;
+
+	for (;;)
+	{
+		int received = network.receiveData(id, &buffer[0], (int)buffer.size());
+		if (received <= 0)
+			return total;
+		total += received;
+	}
+}
+
+int main()
+{
+	ServerNetwork network(NULL, false, ENGINE_URING);
+
+	if (network.engine != ENGINE_URING)
+	{
+		printf("skipped, no io_uring\n");
+		return 0;
+	}
+
+	int hogPair[2];
+	int otherPair[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, hogPair) != 0 || socketpair(AF_UNIX, SOCK_STREAM, 0, otherPair) != 0)
+	{
+		printf("socketpair failed with error: %d\n", errno);
+		return 1;
+	}
+
+	NetworkServices::setNonBlocking(hogPair[0]);
+	NetworkServices::setNonBlocking(otherPair[0]);
+
+	unsigned int hog = network.adoptClient(hogPair[0]);
+	unsigned int other = network.adoptClient(otherPair[0]);
+
+	std::atomic<size_t> flooded(0);
+	std::thread peer(flood, hogPair[1], &flooded);
+
+	// pumped like a server's loop, with an owner that never reads it,
+	// for longer than the peer takes to give up
+	Session * session = network.sessions.find(hog);
+	int most = 0;
+
+	for (int i = 0; i < 300; i++)
+	{
+		network.waitForEvents(1);
+		if (session->receivedCount > most)
+			most = session->receivedCount;
+	}
+
+	peer.join();
+
+	printf("flooded %zu bytes, session holds %d buffers\n", (size_t)flooded, session->receivedCount);
+
+	// one buffer per receive, and none armed at the cap: exactly it
+	check(most <= URING_SESSION_BUFFERS, "flooded session never held more than the cap");
+	check(session->receivedCount == URING_SESSION_BUFFERS, "flooded session filled up to the cap");
+	check(session->receivePaused, "flooded session's receive stopped");
+	check(flooded < (size_t)URING_BUFFERS * URING_BUFFER_SIZE, "flood held back by its socket");
+
+	// another session still gets buffers
+	const char hello[] = "hello";
+	send(otherPair[1], hello, sizeof(hello), MSG_NOSIGNAL);
+
+	char buffer[64];
+	int received = SOCKET_ERROR;
+
+	for (int i = 0; i < 100 && received <= 0; i++)
+	{
+		network.waitForEvents(10);
+		received = network.receiveData(other, buffer, sizeof(buffer));
+	}
+
+	check(received == (int)sizeof(hello), "other session received while the flood is held");
+
+	// reading the hog down lets the rest of the flood in
+	size_t read = drain(network, hog);
+
+	for (int i = 0; i < 200 && read < flooded; i++)
+	{
+		network.waitForEvents(10);
+		read += drain(network, hog);
+	}
+
+	check(!session->receivePaused, "drained session receives again");
+	check(read == flooded, "every flooded byte arrived once read");
+
+	network.closeClient(hog);
+	network.closeClient(other);
+	closesocket(hogPair[1]);
+	closesocket(otherPair[1]);
+
+	return checked();
+}
@@ -0,0 +1,218 @@
+// Compares the Packet wire format with the struct memcpy it replaced.
+//
+// A fixed set of packets like a headset sends (mostly head poses with
+// a timestamp and snapshot ack, now and then an attack or damage) is
+// encoded and decoded over and over both ways. Reported per packet:
+// bytes on the wire, nanoseconds to encode and to decode, and how far
+// the decoded head pose is from the one sent. At 90 poses a second
+// the byte counts are also given as each player's bandwidth.
+//
+// usage: WireBench [-n packets] [-l loops]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+#include "NetworkData.h"
+
+// the Packet as it used to go out: the struct itself, padding and all
+struct LegacyPacket {
+
+	unsigned int packet_type;
+	std::pair<int, int> attack;
+	std::pair<int, int> damage;
+	bool done;
+	glm::mat4 headPose;
+
+	void serialize(char * data) {
+		memcpy(data, (const void *)this, sizeof(LegacyPacket));
+	}
+
+	void deserialize(char * data) {
+		memcpy((void *)this, data, sizeof(LegacyPacket));
+	}
+};
+
+// head poses per second per player
+#define BENCH_POSE_HZ 90
+
+static float uniform(float low, float high)
+{
+	return low + (high - low) * (float)rand() / (float)RAND_MAX;
+}
+
+// a head somewhere in the play space, looking any way at all
+static glm::mat4 randomPose()
+{
+	glm::quat orientation;
+	float norm;
+
+	do {
+		orientation = glm::quat(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+		norm = sqrtf(glm::dot(orientation, orientation));
+	} while (norm < 0.1f || norm > 1.0f);
+
+	glm::vec3 position(uniform(-2, 2), uniform(0, 2), uniform(-2, 2));
+
+	return makePose(position, glm::normalize(orientation));
+}
+
+static std::vector<Packet> samplePackets(int count)
+{
+	std::vector<Packet> packets(count);
+	uint64_t time = 1000000;
+
+	for (int i = 0; i < count; i++)
+	{
+		Packet & packet = packets[i];
+		packet.packet_type = ACTION_EVENT;
+		packet.headPose = randomPose();
+		packet.timestamp = time += 1000000 / BENCH_POSE_HZ;
+		packet.ack = 1 + i / 3;
+
+		// one in ten carries a shot, and one in ten a shot's result
+		if (i % 10 == 0)
+			packet.attack = std::make_pair(rand() % BOARD_SIZE, rand() % BOARD_SIZE);
+		else if (i % 10 == 5)
+			packet.damage = std::make_pair(rand() % BOARD_SIZE, rand() % BOARD_SIZE);
+	}
+
+	return packets;
+}
+
+static double secondsSince(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void usage()
+{
+	printf("usage: WireBench [-n packets] [-l loops]\n");
+	printf("  -n  distinct packets (default 4096)\n");
+	printf("  -l  times each packet is encoded and decoded (default 500)\n");
+}
+
+int main(int argc, char ** argv)
+{
+	int count = 4096;
+	int loops = 500;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+			count = atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-l") == 0)
+			loops = atoi(argv[++i]);
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	if (count < 1 || loops < 1) {
+		usage();
+		return 1;
+	}
+
+	srand(1);
+	std::vector<Packet> packets = samplePackets(count);
+
+	std::vector<LegacyPacket> legacy(count);
+	for (int i = 0; i < count; i++)
+	{
+		legacy[i].packet_type = packets[i].packet_type;
+		legacy[i].attack = packets[i].attack;
+		legacy[i].damage = packets[i].damage;
+		legacy[i].done = packets[i].done;
+		legacy[i].headPose = packets[i].headPose;
+	}
+
+	std::vector<char> wire((size_t)count * sizeof(LegacyPacket));
+	std::vector<int> lengths(count);
+	double operations = (double)count * loops;
+
+	// anything read back, so neither loop can be left out
+	uint64_t sink = 0;
+
+	// memcpy, as it was
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int loop = 0; loop < loops; loop++)
+		for (int i = 0; i < count; i++)
+			legacy[i].serialize(&wire[(size_t)i * sizeof(LegacyPacket)]);
+	double legacyEncode = secondsSince(start);
+
+	LegacyPacket legacyOut;
+	start = std::chrono::steady_clock::now();
+	for (int loop = 0; loop < loops; loop++)
+		for (int i = 0; i < count; i++)
+		{
+			legacyOut.deserialize(&wire[(size_t)i * sizeof(LegacyPacket)]);
+			sink += legacyOut.attack.first + (int)legacyOut.headPose[3][0];
+		}
+	double legacyDecode = secondsSince(start);
+
+	// the wire format
+	uint64_t bytes = 0;
+	start = std::chrono::steady_clock::now();
+	for (int loop = 0; loop < loops; loop++)
+	{
+		bytes = 0;
+		for (int i = 0; i < count; i++)
+		{
+			lengths[i] = packets[i].serialize(&wire[(size_t)i * PACKET_MAX_SIZE]);
+			bytes += lengths[i];
+		}
+	}
+	double wireEncode = secondsSince(start);
+
+	Packet decoded;
+	int failed = 0;
+	start = std::chrono::steady_clock::now();
+	for (int loop = 0; loop < loops; loop++)
+		for (int i = 0; i < count; i++)
+		{
+			if (!decoded.deserialize(&wire[(size_t)i * PACKET_MAX_SIZE], lengths[i]))
+				failed++;
+			sink += decoded.attack.first + (int)decoded.headPose[3][0];
+		}
+	double wireDecode = secondsSince(start);
+
+	// what the quantization costs
+	float worstMm = 0.0f;
+	float worstDegrees = 0.0f;
+	for (int i = 0; i < count; i++)
+	{
+		decoded.deserialize(&wire[(size_t)i * PACKET_MAX_SIZE], lengths[i]);
+
+		float mm = glm::distance(posePosition(decoded.headPose), posePosition(packets[i].headPose)) * 1000.0f;
+		float cosine = fabsf(glm::dot(poseOrientation(decoded.headPose), poseOrientation(packets[i].headPose)));
+		float degrees = 2.0f * acosf(cosine > 1.0f ? 1.0f : cosine) * 180.0f / 3.14159265f;
+
+		if (mm > worstMm)
+			worstMm = mm;
+		if (degrees > worstDegrees)
+			worstDegrees = degrees;
+	}
+
+	double wireBytes = (double)bytes / count;
+	double legacyBytes = (double)sizeof(LegacyPacket);
+
+	printf("%d packets, each encoded and decoded %d times\n", count, loops);
+	printf("memcpy    %5.1f bytes  encode %6.1f ns  decode %6.1f ns  %6.1f kbit/s per player\n",
+		legacyBytes, legacyEncode / operations * 1e9, legacyDecode / operations * 1e9,
+		(legacyBytes + FRAME_HEADER_SIZE) * 8 * BENCH_POSE_HZ / 1000.0);
+	printf("wire      %5.1f bytes  encode %6.1f ns  decode %6.1f ns  %6.1f kbit/s per player\n",
+		wireBytes, wireEncode / operations * 1e9, wireDecode / operations * 1e9,
+		(wireBytes + FRAME_HEADER_SIZE) * 8 * BENCH_POSE_HZ / 1000.0);
+	printf("pose error at most %.2f mm and %.3f degrees\n", worstMm, worstDegrees);
+
+	if (failed > 0)
+		printf("%d packets failed to decode\n", failed);
+
+	// keeps sink alive
+	if (sink == 1)
+		printf("\n");
+
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+// Headless dedicated server: the match server without the headset,
+// GL or audio, for packing many instances onto plain Linux boxes.
+//
+// Each status line gives the cores the process kept busy since the
+// last one and the matches open per busy core. Loaded with
+// LoadGenerator -n bots, which fills bots / 2 matches, that is the
+// matches-per-core figure to size hosts by.
+//
+// usage: DedicatedServer [-p port] [-t shards] [-s stats_seconds] [-u] [-m metrics_port]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <chrono>
+#include "MatchServer.h"
+#include "MetricsServer.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+static volatile sig_atomic_t stopping = 0;
+
+static void onSignal(int)
+{
+	stopping = 1;
+}
+
+// cpu time used by every thread of this process so far
+static double processCpuSeconds()
+{
+#ifdef _WIN32
+	FILETIME created, exited, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user);
+
+	ULARGE_INTEGER kernelTime, userTime;
+	kernelTime.LowPart = kernel.dwLowDateTime;
+	kernelTime.HighPart = kernel.dwHighDateTime;
+	userTime.LowPart = user.dwLowDateTime;
+	userTime.HighPart = user.dwHighDateTime;
+
+	// 100 ns units
+	return (kernelTime.QuadPart + userTime.QuadPart) / 1e7;
+#else
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+		(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+static void usage()
+{
+	printf("usage: DedicatedServer [-p port] [-t shards] [-s stats_seconds] [-u] [-m metrics_port]\n");
+	printf("  -p  tcp port to listen on (default %s)\n", DEFAULT_PORT);
+	printf("  -t  worker threads, 0 = one per core (default 0)\n");
+	printf("  -s  seconds between status lines, 0 = none (default 10)\n");
+	printf("  -u  serve sessions through io_uring instead of epoll (Linux 6.0 or later)\n");
+	printf("  -m  serve Prometheus metrics on localhost:metrics_port/metrics (default off)\n");
+}
+
+int main(int argc, char ** argv)
+{
+	const char * port = DEFAULT_PORT;
+	unsigned int shards = 0;
+	int statsSeconds = 10;
+	int engine = ENGINE_POLL;
+	const char * metricsPort = NULL;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (i + 1 < argc && strcmp(argv[i], "-p") == 0)
+			port = argv[++i];
+		else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+			shards = (unsigned int)atoi(argv[++i]);
+		else if (i + 1 < argc && strcmp(argv[i], "-s") == 0)
+			statsSeconds = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-u") == 0)
+			engine = ENGINE_URING;
+		else if (i + 1 < argc && strcmp(argv[i], "-m") == 0)
+			metricsPort = argv[++i];
+		else {
+			usage();
+			return 1;
+		}
+	}
+
+	signal(SIGINT, onSignal);
+	signal(SIGTERM, onSignal);
+
+	MatchServer server(shards, port, engine);
+
+	printf("listening on port %s with %d shards\n", port, (int)server.shards.size());
+
+	// after the server, which starts winsock
+	MetricsServer * metrics = NULL;
+	if (metricsPort != NULL)
+	{
+		metrics = new MetricsServer(metricsPort);
+		if (metrics->listening())
+			printf("metrics on http://localhost:%s/metrics\n", metricsPort);
+	}
+
+	uint64_t lastMessages = 0;
+	uint64_t lastSyscalls = 0;
+	double lastCpu = processCpuSeconds();
+	std::chrono::steady_clock::time_point lastStats = std::chrono::steady_clock::now();
+
+	std::chrono::steady_clock::time_point nextStats =
+		std::chrono::steady_clock::now() + std::chrono::seconds(statsSeconds);
+
+	while (!stopping)
+	{
+		server.pump(SHARD_WAIT_MS);
+
+		if (statsSeconds > 0 && std::chrono::steady_clock::now() >= nextStats)
+		{
+			uint64_t messages = server.messagesRelayed() + server.spectatorSends() + server.messagesReceived();
+			uint64_t syscalls = server.syscalls();
+
+			printf("matches %u players %u spectators %u relayed %llu spectator sends %llu received %llu\n",
+				server.activeMatches(), server.activePlayers(), server.activeSpectators(),
+				(unsigned long long)server.messagesRelayed(), (unsigned long long)server.spectatorSends(),
+				(unsigned long long)server.messagesReceived());
+
+			// what moving a message in or out cost the shards, since the last line
+			if (messages > lastMessages)
+				printf("syscalls %.3f per message\n", (double)(syscalls - lastSyscalls) / (messages - lastMessages));
+
+			// how many cores the shards kept busy, and what each held
+			double cpu = processCpuSeconds();
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			double cores = (cpu - lastCpu) / std::chrono::duration<double>(now - lastStats).count();
+
+			if (cores > 0.0)
+				printf("cpu %.2f cores, %.0f matches per core\n", cores, server.activeMatches() / cores);
+
+			lastMessages = messages;
+			lastSyscalls = syscalls;
+			lastCpu = cpu;
+			lastStats = now;
+			nextStats += std::chrono::seconds(statsSeconds);
+		}
+	}
+
+	printf("shutting down\n");
+
+	delete metrics;
+
+	return 0;
+}